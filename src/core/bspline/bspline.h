@@ -3,21 +3,52 @@
 #include "maths/maths.h"
 #include <functional>
 #include <vector>
+#include <map>
 
 namespace Basis {  
     static constexpr double NOD_THRESHOLD = 1.E-15;								// grid space that is considered zero
+    static constexpr double QUADRATURE_TOLERANCE = 1.E-15;						// default error of a quadrature near r = 0
+    static constexpr double QUADRATURE_CHECK_LIMIT = 100.;						// times the tolerance, before the check warns
     static constexpr complex I =  complex(0,1);
 
 	class GaussQuadrature {
 		static constexpr double GAUSS_POINTS_CONVERGENCE_THRESHOLD = 2.E-15;	
-		const int NGAUSS = 64;													// how many points
+		int _numPoints;																// how many points
 
 		std::vector<double> _points, _weights;
 	public:
-		bool Initialize();
-		complex Integrate(complex xmin, complex xmax, std::function<complex(complex)> f) const;
+		static constexpr int MAX_POINTS = 64;
+
+		bool Initialize(int points = MAX_POINTS);
+		template <class F>
+		complex Integrate(complex xmin, complex xmax, F&& f) const;
+
+		// on [0, 1]
+		const std::vector<double>& getPoints() const;
+		const std::vector<double>& getWeights() const;
 	};
 
+	// a template, so the integrand inlines
+	template <class F>
+	complex GaussQuadrature::Integrate(complex xmin, complex xmax, F&& f) const {
+		complex width = xmax - xmin;
+		complex sum = 0.;
+		complex c = 0.;
+		complex t = 0., y = 0., elem = 0.;
+		
+		if (std::abs(width) < NOD_THRESHOLD) return 0;	// spacing is too small, return 0;
+		for (int i = 0; i < _numPoints; i++) {
+			elem = f(xmin + width * _points[i]) * _weights[i];
+			y = elem - c;
+			t = sum + y;
+			c = (t-sum) - y;
+			sum = t;
+		}
+
+
+		return sum*width;
+	}
+
     class BSpline {
     public:
 		enum Sequence {
@@ -46,6 +77,19 @@ namespace Basis {
 				return r0 + std::real((R - r0)*std::exp(-I*theta));
 			}
 		};
+		enum Integrand {
+			Polynomial,								// f = 1: the product of two bsplines, exact with 'order' points
+			General									// any f (1/r, 1/r^2, exp(-r), ...): 'order'+2 points, more near r = 0
+		};
+		struct RadialOperator {						// <B_i^(dn1)| f |B_j^(dn2)>
+			std::function<complex(complex)> f;		// of (complex) r, empty for 1 (a Polynomial integrand)
+			int dn1, dn2;
+			bool closed = false;					// f = scale*r^power, integrated in closed form (see Power)
+			int power = 0;
+			complex scale = 1.;
+		};
+		// scale*r^power (power >= -2) without quadrature, 'f' is still set for the quadrature check
+		static RadialOperator Power(int power, complex scale = 1., int dn1 = 0, int dn2 = 0);
     private:
 		struct BSplineCoeff {
 			std::vector<std::vector<complex>> d;
@@ -59,9 +103,16 @@ namespace Basis {
 			CoeffMatrix(size_t order, size_t num_knots);
 			BSplineCoeff& operator() (size_t order, size_t bspline);
 		};
+		struct NodeMap {							// inverse of the node sequence: x -> (fractional) node index
+			Sequence seq;
+			bool valid;								// false: unknown or degenerate sequence, binary search instead
+			double xmin, a, b, c, d;				// depend on seq, see InitializeNodeMap
+
+			double operator() (double x) const;
+		};
 
-        GaussQuadrature _glQuad;
         ECS _ecs;
+        NodeMap _nodeMap;
 
         
 		std::vector<double> _grid;                  // real locations of the nodes
@@ -74,23 +125,47 @@ namespace Basis {
 
         
 		std::vector<BSplineCoeff> _bsCoeffs;        // polynomial coefficients for each interval
+		std::vector<complex> _intervalCoeffs;       // the same by grid interval q: [(q*order + s)*order + d] of bspline q+s, for the kernels
+
+		// the nonzero bsplines at the quadrature points of every interval q, one table per Integrand
+		static constexpr int TABLE_DERIVATIVES = 2;	// tabulated dn = 0, 1 (higher ones are evaluated)
+		struct QuadratureTable {
+			std::vector<int> offset;                // [q] first point of interval q, [intervals] all of them
+			std::vector<complex> r, w;              // [offset[q] + p] (complex) r, weight*width
+			std::vector<complex> b[TABLE_DERIVATIVES];	// [offset[q]*order + s*points + p] of bspline q+s
+
+			int Points(int q) const { return offset[q + 1] - offset[q]; }
+		};
+		QuadratureTable _tables[2];
+		std::map<int, GaussQuadrature> _rules;      // by number of points
+		double _quadTolerance = QUADRATURE_TOLERANCE;
+		bool _quadCheck = false;                    // compare every IntegrateOperators with MAX_POINTS
         
         // factorial storage
 		const int DIMFACT = 127;
 		std::vector<double> _partialFactorial, _factorial;
         
         
+		void InitializeNodeMap(Sequence seq, double xmin, double xmax, double param);
 		void InitializeFactorials();
 		void InitializeBSplines();
+		void InitializeTables();
+		int QuadraturePoints(int q, Integrand kind) const;
+		const complex* Tabulated(const QuadratureTable& table, int q, int s, int dn, std::vector<complex>& scratch) const;
+		void CheckQuadrature(const std::vector<RadialOperator>& ops, const std::vector<std::vector<complex>>& results) const;
+		void IntegratePower(int q, const RadialOperator& op, std::vector<complex>& block) const;
 		void InitializeBSpline(const std::vector<complex>& knots, BSplineCoeff& out);
 		void InitializeBSplineOfOrder(const std::vector<complex>& knots, int order, CoeffMatrix& coeff);
 		void PropagateCoeffients(const std::vector<complex>& knots, int tbs, int order, CoeffMatrix& coeff);
     public:
 		int Initialize(int order, int nodes, double xmin, double xmax, Sequence seq = Linear, const ECS& ecs = {0.9, Pi/4.}, double param = 0.);
+		void setQuadrature(double tolerance, bool check = false);          // before Initialize
 
 		// get the bs'th Bspline (derivative dn)
 		complex bspline(double x, int bs, int dn = 0) const;                // x-before ecs rotation
 		complex bspline(complex x, int bs, int dn = 0) const;               // x-after ecs rotation
+		complex bspline(double x, int bs, int dn, int i) const;             // x in grid interval i (no lookup)
+		complex bspline(complex x, int bs, int dn, int i) const;            // x in grid interval i (no lookup)
 		std::vector<complex> getBSpline(const std::vector<double>& x, int bs, int dn = 0) const;// x-before ecs rotation
 
 		// evaluate function expanded in Bspline basis at x - dn is the order of the derivative
@@ -106,11 +181,15 @@ namespace Basis {
         // integrate a function over restricted bounds
 		complex Integrate(double xmin, double xmax, int bs1, int bs2, std::function<complex(complex)> f, int dn1 = 0, int dn2 = 0) const;
 
+		// every operator over the whole grid in one pass, for the bsplines that are not skipped
+		// each result is N*N (N = getNumBSplines()), the band is filled at [i + j*N]
+		std::vector<std::vector<complex>> IntegrateOperators(const std::vector<RadialOperator>& ops) const;
+
 		// helper functions
 		const std::vector<double>& getGrid() const;
 		int getNumBSplines() const;
 		int getOrder() const;
-		int whichInterval(double x) const;
+		int whichInterval(double x) const;                                  // a node belongs to the interval on its left, -1 outside the grid
 		void setSkipFirst(bool flag = true);
 		void setSkipLast(bool flag = true);
     };   
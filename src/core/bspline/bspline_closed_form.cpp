@@ -0,0 +1,157 @@
+#include "bspline.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace Basis {
+	// the moments and the sums over them cancel a few digits more with every order, so
+	// they are done in long double (the interval polynomials themselves stay double)
+	typedef std::complex<long double> lcomplex;
+
+	// moments[m] = integral of u^m r^power dr over one grid interval, where r = a + h*u and u = 0..1
+	// (a and h are complex past the ecs point). Returns how many of the first moments diverge
+	// because r = 0 starts the interval, those are left 0.
+	static int PowerMoments(lcomplex a, lcomplex h, int power, int count, std::vector<lcomplex>& moments) {
+		moments.assign(count, 0.L);
+
+		if (power >= 0) {
+			// (a + h u)^n = sum_j C(n,j) a^(n-j) h^j u^j
+			std::vector<lcomplex> binomial(power + 1);
+			for (int j = 0; j <= power; j++) {
+				lcomplex c = 1.L;
+				for (int k = 0; k < j; k++)
+					c *= (long double)(power - k) / (k + 1) * h;
+				for (int k = 0; k < power - j; k++)
+					c *= a;
+				binomial[j] = c;
+			}
+			for (int m = 0; m < count; m++) {
+				for (int j = 0; j <= power; j++)
+					moments[m] += binomial[j] / (long double)(m + j + 1);
+				moments[m] *= h;
+			}
+			return 0;
+		}
+
+		if (a == 0.L) {
+			// r^power = h^power u^power
+			lcomplex hn = (power == -1 ? lcomplex(1.L) : 1.L / h);	// h^(power+1)
+			for (int m = -power; m < count; m++)
+				moments[m] = hn / (long double)(m + power + 1);
+			return -power;
+		}
+
+		// in beta = a/h: J[m] = int u^m/(beta+u) du, K[m] = int u^m/(beta+u)^2 du
+		// and the moments are J (power -1) or K/h (power -2)
+		static constexpr long double SERIES_BETA = 1.25L;	// up to here the recurrence loses at most 1.25^m to round off
+		lcomplex beta = a / h;
+		std::vector<lcomplex> J(count), K(count);
+		if (std::abs(beta) < SERIES_BETA) {
+			J[0] = std::log((beta + 1.L) / beta);
+			K[0] = 1.L / (beta * (beta + 1.L));
+			for (int m = 1; m < count; m++) {
+				J[m] = 1.L / (long double)m - beta * J[m - 1];
+				K[m] = J[m - 1] - beta * K[m - 1];
+			}
+		} else {
+			// the same recurrences run down, from the top moment as a series:
+			// 1/(beta+u)^n = beta^-n sum_j C(j+n-1, j) (-u/beta)^j, which converges like beta^-j
+			int top = count - 1;
+			lcomplex x = -1.L / beta, xj = 1.L, sumJ = 0.L, sumK = 0.L;
+			for (int j = 0; j < 4000; j++) {
+				lcomplex term = xj / (long double)(top + j + 1);
+				sumJ += term;
+				sumK += (long double)(j + 1) * term;
+				if (std::abs((long double)(j + 1) * term) < 0.1L * std::numeric_limits<long double>::epsilon() * std::abs(sumK))
+					break;
+				xj *= x;
+			}
+			J[top] = sumJ / beta;
+			K[top] = sumK / (beta * beta);
+			for (int m = top; m > 0; m--) {
+				J[m - 1] = (1.L / (long double)m - J[m]) / beta;
+				K[m - 1] = (J[m - 1] - K[m]) / beta;
+			}
+		}
+		for (int m = 0; m < count; m++)
+			moments[m] = (power == -1 ? J[m] : K[m] / h);
+		return 0;
+	}
+
+	BSpline::RadialOperator BSpline::Power(int power, complex scale, int dn1, int dn2) {
+		RadialOperator op;
+		op.f = [power, scale](complex r) -> complex {
+			complex rn = 1.;
+			for (int k = 0; k < std::abs(power); k++)
+				rn *= r;
+			return (power < 0 ? scale / rn : scale * rn);
+		};
+		op.dn1 = dn1;
+		op.dn2 = dn2;
+		op.closed = (power >= -2);
+		op.power = power;
+		op.scale = scale;
+		return op;
+	}
+
+	// block[s1*order + s2] = <B_(q+s1)^(dn1)| scale*r^power |B_(q+s2)^(dn2)> on grid interval q: the
+	// coefficients (in u) of the two polynomials against the moments. NaN where the integral
+	// diverges, or needs a moment that does.
+	void BSpline::IntegratePower(int q, const RadialOperator& op, std::vector<complex>& block) const {
+		int k = _order;
+		lcomplex a = _ecs_grid[q], h = lcomplex(_ecs_grid[q + 1]) - a;
+		std::vector<lcomplex> moments;
+		int divergent = PowerMoments(a, h, op.power, 2*k - 1, moments);
+
+		// the dn'th derivative in u, degree d at [s*order + d]
+		auto derivative = [&](int dn, std::vector<lcomplex>& E) {
+			E.assign(k*k, 0.L);
+			lcomplex invIntN = 1.L;
+			for (int n = 0; n < dn; n++)
+				invIntN /= h;
+			const double* fall = &_partialFactorial[dn * DIMFACT];
+			for (int s = 0; s < k; s++)
+				for (int d = dn; d < k; d++)
+					E[s*k + d - dn] = invIntN * (long double)fall[d] * lcomplex(_intervalCoeffs[(q*k + s)*k + d]);
+		};
+		std::vector<lcomplex> E1, E2, G(k*k);
+		derivative(op.dn1, E1);
+		derivative(op.dn2, E2);
+
+		// G[d1*order + s2] = sum_d2 moments[d1+d2] E2[s2*order + d2]
+		for (int d1 = 0; d1 < k; d1++) {
+			for (int s2 = 0; s2 < k; s2++) {
+				lcomplex sum = 0.L;
+				for (int d2 = 0; d2 < k; d2++)
+					sum += moments[d1 + d2] * E2[s2*k + d2];
+				G[d1*k + s2] = sum;
+			}
+		}
+		block.assign(k*k, 0.);
+		for (int s1 = 0; s1 < k; s1++) {
+			for (int s2 = 0; s2 < k; s2++) {
+				lcomplex sum = 0.L;
+				for (int d1 = 0; d1 < k; d1++)
+					sum += E1[s1*k + d1] * G[d1*k + s2];
+				block[s1*k + s2] = op.scale * complex(sum);
+				if (divergent == 0)
+					continue;
+
+				// the product must vanish at r = 0 fast enough for the moments that diverge
+				long double largest1 = 0., largest2 = 0.;
+				for (int d = 0; d < k; d++) {
+					largest1 = std::max(largest1, std::abs(E1[s1*k + d]));
+					largest2 = std::max(largest2, std::abs(E2[s2*k + d]));
+				}
+				for (int m = 0; m < divergent; m++) {
+					lcomplex coeff = 0.L;
+					for (int d1 = 0; d1 <= m && d1 < k; d1++)
+						if (m - d1 < k)
+							coeff += E1[s1*k + d1] * E2[s2*k + m - d1];
+					if (std::abs(coeff) > NOD_THRESHOLD * largest1 * largest2)
+						block[s1*k + s2] = std::numeric_limits<double>::quiet_NaN();
+				}
+			}
+		}
+	}
+}
@@ -1,4 +1,5 @@
 #include "bspline.h"
+#include "bspline_kernel.h"
 
 #include <complex>
 
@@ -13,26 +14,24 @@ namespace Basis {
 	}
 
 	complex BSpline::bspline(double x, int bs, int dn) const {
-		if (bs < 0 || bs >= _numBSplines) return 0;
+		return bspline(x, bs, dn, whichInterval(x));	// which grid interval is 'x'
+	}
+	complex BSpline::bspline(double x, int bs, int dn, int i) const {
+		if (bs < 0 || bs >= _numBSplines || i < 0) return 0;
 
-		int i = whichInterval(x);						// which grid interval is 'x'
 		int interval = i - bs + _order-1;					// which interval is this in the bspline
 
 		if (interval < 0 || interval > _order-1) return 0;
 
 
-		complex sum = 0;
-		double xx = 1;
 		double invInt = 1. / (_grid[i + 1] - _grid[i]);
 		double r = (x - _grid[i]) * invInt;
 
-		const auto& coeff = _bsCoeffs[bs];
-
-		for (int d = dn; d < _order; d++) {
-			// std::cout << "interval: " << interval << " degree: " << d << " = " << coeff(interval, d) << std::endl;
-			sum += _partialFactorial[d + dn * DIMFACT] * coeff(interval, d) * xx;
-			xx *= r;
-		}
+		const complex* coeff = &_intervalCoeffs[(i*_order + bs - i)*_order];
+		const double* fall = &_partialFactorial[dn * DIMFACT];
+		complex sum = DispatchOrder(_order, [&](auto K) {
+			return BSplineKernel<decltype(K)::value>::Evaluate(_order, coeff, fall, dn, r);
+		});
 		// 
 		double invIntN = 1.;
 		for (int k = 0; k < dn; k++)
@@ -41,28 +40,25 @@ namespace Basis {
 		return sum * invIntN;
 	}
 	complex BSpline::bspline(complex x, int bs, int dn) const {
-		if (bs < 0 || bs >= _numBSplines) return 0;
+		return bspline(x, bs, dn, whichInterval(_ecs.x(x)));	// which grid interval is 'x'
+	}
+	complex BSpline::bspline(complex x, int bs, int dn, int i) const {
+		if (bs < 0 || bs >= _numBSplines || i < 0) return 0;
 
-		int i = whichInterval(_ecs.x(x));	// which grid interval is 'x'
 		int interval = i - bs + _order-1;					// which interval is this in the bspline
 
 		if (interval < 0 || interval > _order-1) return 0;
 
 
-		complex sum = 0;
-		complex xx = 1;
 		// can be optimized??
 		complex invInt = 1. / (_ecs_grid[i + 1] - _ecs_grid[i]);
 		complex r = (x - _ecs_grid[i]) * invInt;		// << this should be real
 
-
-		const auto& coeff = _bsCoeffs[bs];
-
-		for (int d = dn; d < _order; d++) {
-			// std::cout << "interval: " << interval << " degree: " << d << " = " << coeff(interval, d) << std::endl;
-			sum += _partialFactorial[d + dn*DIMFACT] * coeff(interval, d) * xx;
-			xx *= r;
-		}
+		const complex* coeff = &_intervalCoeffs[(i*_order + bs - i)*_order];
+		const double* fall = &_partialFactorial[dn * DIMFACT];
+		complex sum = DispatchOrder(_order, [&](auto K) {
+			return BSplineKernel<decltype(K)::value>::Evaluate(_order, coeff, fall, dn, r);
+		});
 
 		// 
 		complex invIntN = 1.;
@@ -106,7 +102,7 @@ namespace Basis {
 		for (int Bs = Bsmi; Bs < Bsma; Bs++) {
 			if (Bs - nskip >= fc.size())                   // BUGFIX:: I think this ONLY happens if we are skipping the LAST spline??
 				continue;
-			total += bspline(x, Bs, dn) * fc[Bs - nskip];
+			total += bspline(x, Bs, dn, i) * fc[Bs - nskip];
 		}
 		return total;
 	}
@@ -1,4 +1,6 @@
 #include "bspline.h"
+#include <algorithm>
+#include <cmath>
 
 
 namespace Basis {
@@ -12,11 +14,63 @@ namespace Basis {
 		return _order;
 	}
 	int BSpline::whichInterval(double x) const {
-		for (int i = 0; i < (int)_grid.size(); i++) {
-			if (_grid[i] <= x && x <= _grid[i + 1])
+		if (!(_grid.front() <= x && x <= _grid.back())) return -1;
+
+		// the inverse of the node sequence lands on the interval up to round off
+		if (_nodeMap.valid) {
+			double guess = _nodeMap(x);
+			int i = (guess >= 0. ? int(std::min(guess, _nodes - 2.)) : 0);
+			if (i > 0 && x <= _grid[i])
+				i--;
+			else if (x > _grid[i + 1])
+				i++;
+			if ((i == 0 || _grid[i] < x) && x <= _grid[i + 1])
 				return i;
 		}
-		return -1;
+		// any other grid
+		int j = std::lower_bound(_grid.begin(), _grid.end(), x) - _grid.begin();
+		return std::max(j - 1, 0);
+	}
+
+	// the node formulas of Initialize solved for the index
+	double BSpline::NodeMap::operator() (double x) const {
+		x -= xmin;
+		switch (seq) {
+			case Linear:
+				return a*x;
+			case Exponential:
+				return b*std::log1p(a*x);
+			case ParabolicLinear:
+				return (x < d ? std::sqrt(x/a) : (x - c)/b);
+			case Sinlike:
+				return c*std::pow(2./Pi*std::asin(std::min(a*x, 1.)), b);
+		}
+		return -1.;
+	}
+	void BSpline::InitializeNodeMap(Sequence seq, double xmin, double xmax, double param) {
+		_nodeMap = NodeMap{seq, true, xmin, 0., 0., 0., 0.};
+		if (seq == Linear) {
+			_nodeMap.a = (_nodes - 1.) / (xmax - xmin);
+		} else if (seq == Exponential) {
+			_nodeMap.a = (exp(param) - 1.) / (xmax - xmin);
+			_nodeMap.b = (_nodes - 1.) / param;
+		} else if (seq == ParabolicLinear) {
+			double i0 = std::floor(2.*(_nodes-1) / (1.+(xmax - xmin)/(param - xmin)));
+			_nodeMap.a = xmax / i0 /(2.*(_nodes-1) - i0);
+			_nodeMap.b = 2.*xmax /(2.*(_nodes-1) - i0);
+			_nodeMap.c = -xmax*i0 /(2.*(_nodes-1) - i0);
+			_nodeMap.d = _nodeMap.c + _nodeMap.b*i0;		// where the linear part starts
+		} else if (seq == Sinlike) {
+			_nodeMap.a = 1. / xmax;
+			_nodeMap.b = 1. / param;
+			_nodeMap.c = _nodes - 1.;
+		}
+
+		// degenerate parameters (g = 0, a = 0, ...) give nonsense, search those grids instead
+		for (int i = 0; i < _nodes && _nodeMap.valid; i++) {
+			double index = _nodeMap(_grid[i]);
+			_nodeMap.valid = std::isfinite(index) && std::abs(index - i) < 1.;
+		}
 	}
 	
 	const std::vector<double>& BSpline::getGrid() const {
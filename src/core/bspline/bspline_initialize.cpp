@@ -1,7 +1,10 @@
 #include "bspline.h"
+#include "bspline_kernel.h"
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <algorithm>
+#include <cmath>
 
 using namespace std::complex_literals;
 
@@ -50,6 +53,7 @@ namespace Basis {
 		// file.close();
 		// exit(0);
 		}
+		InitializeNodeMap(seq, xmin, xmax, param);
 
 
         // initialize ecs
@@ -79,11 +83,9 @@ namespace Basis {
 
 
 
-		// initialize Gauss-Legendre quadrature
-		_glQuad.Initialize();
-
 		InitializeFactorials();
 		InitializeBSplines();
+		InitializeTables();
 
 		return 0;
 	}
@@ -119,6 +121,85 @@ namespace Basis {
 
 			InitializeBSpline(vec, _bsCoeffs[bs]);
 		}
+
+		// bspline q+s is on its interval order-1-s on grid interval q
+		_intervalCoeffs.assign((_nodes - 1)*_order*_order, 0.);
+		for (int q = 0; q < _nodes - 1; q++)
+			for (int s = 0; s < _order; s++)
+				for (int d = 0; d < _order; d++)
+					_intervalCoeffs[(q*_order + s)*_order + d] = _bsCoeffs[q + s](_order - 1 - s, d);
+	}
+	void BSpline::setQuadrature(double tolerance, bool check) {
+		_quadTolerance = tolerance;
+		_quadCheck = check;
+	}
+	// Gauss-Legendre with n points converges like rho^-2n, rho the sum of the semi-axes of the
+	// largest ellipse around the interval (mapped to [-1, 1]) without a singularity. Here the
+	// singularity is the 1/r (or 1/r^2) at r = 0, which only matters for the first few intervals.
+	int BSpline::QuadraturePoints(int q, Integrand kind) const {
+		if (kind == Polynomial)
+			return _order;							// degree 2*(order-1) is exact
+
+		double a = _grid[q], b = _grid[q + 1];
+		if (a <= 0. && b >= 0.)
+			return GaussQuadrature::MAX_POINTS;		// contains the origin, nothing to converge on
+		double x0 = std::abs(b + a) / (b - a);
+		double rho = x0 + std::sqrt(x0*x0 - 1.);
+		// the rate is that of the potential, the product of the two B-splines adds order-1 points
+		int points = std::ceil(-std::log(_quadTolerance) / (2.*std::log(rho))) + _order - 1;
+		return std::min(std::max(points, _order + 2), GaussQuadrature::MAX_POINTS);
+	}
+	// every bspline that is nonzero on an interval, at its quadrature points
+	void BSpline::InitializeTables() {
+		int intervals = _nodes - 1;
+
+		_rules.clear();
+		_rules[GaussQuadrature::MAX_POINTS].Initialize(GaussQuadrature::MAX_POINTS);
+
+		for (int kind = Polynomial; kind <= General; kind++) {
+			auto& table = _tables[kind];
+
+			table.offset.assign(intervals + 1, 0);
+			for (int q = 0; q < intervals; q++) {
+				int P = QuadraturePoints(q, Integrand(kind));
+				table.offset[q + 1] = table.offset[q] + P;
+				if (_rules.find(P) == _rules.end())
+					_rules[P].Initialize(P);
+			}
+			int total = table.offset[intervals];
+			table.r.assign(total, 0.);
+			table.w.assign(total, 0.);
+			for (int dn = 0; dn < TABLE_DERIVATIVES; dn++)
+				table.b[dn].assign(total*_order, 0.);
+
+			for (int q = 0; q < intervals; q++) {
+				complex lower = _ecs_grid[q];
+				complex width = _ecs_grid[q + 1] - lower;
+				if (std::abs(width) < NOD_THRESHOLD) continue;			// contributes nothing, as in GaussQuadrature::Integrate
+
+				int P = table.Points(q), first = table.offset[q];
+				const auto& points = _rules.at(P).getPoints();
+				const auto& weights = _rules.at(P).getWeights();
+				const complex* coeff = &_intervalCoeffs[q*_order*_order];
+				complex invIntN = 1.;						// d/dr of the variable across the interval, to the dn
+				std::vector<complex> values(_order);
+				for (int dn = 0; dn < TABLE_DERIVATIVES; dn++) {
+					const double* fall = &_partialFactorial[dn * DIMFACT];
+					DispatchOrder(_order, [&](auto K) {
+						for (int p = 0; p < P; p++) {
+							BSplineKernel<decltype(K)::value>::EvaluateAll(_order, coeff, fall, dn, points[p], values.data());
+							for (int s = 0; s < _order; s++)
+								table.b[dn][first*_order + s*P + p] = values[s] * invIntN;
+						}
+					});
+					invIntN /= width;
+				}
+				for (int p = 0; p < P; p++) {
+					table.r[first + p] = lower + width * points[p];
+					table.w[first + p] = weights[p] * width;
+				}
+			}
+		}
 	}
 	void BSpline::InitializeBSpline(const std::vector<complex>& knots, BSplineCoeff& out) {
 		CoeffMatrix coeff(_order-1, knots.size());
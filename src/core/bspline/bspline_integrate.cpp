@@ -1,18 +1,162 @@
 #include "bspline.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "utility/logger.h"
 
 namespace Basis {
 	complex BSpline::Integrate(int bs1, int bs2, int dn1, int dn2) const {
-		return Integrate(bs1, bs2, [](complex r) -> complex {
-				return 1.;
-			}, dn1, dn2);
+		return Integrate(bs1, bs2, nullptr, dn1, dn2);
 	}
+	// the whole grid comes from the tables (an empty 'f' is 1)
 	complex BSpline::Integrate(int bs1, int bs2, std::function<complex(complex)> f, int dn1, int dn2) const {
-		double xmin = _grid.front(), xmax = _grid.back();
-		return Integrate(xmin, xmax, bs1, bs2, f, dn1, dn2);
+		if (bs1 - _order + 1 > bs2 || bs2 - _order + 1 > bs1) return 0;
+		if (bs1 < 0 || bs2 < 0 || bs1 >= _numBSplines || bs2 >= _numBSplines) return 0;
+
+		const auto& table = _tables[f ? General : Polynomial];
+		int IntervalMin = std::max(0, std::max(bs1, bs2) - _order + 1);
+		int IntervalMax = std::min(_nodes - 2, std::min(bs1, bs2));
+		std::vector<complex> scratch1, scratch2;
+
+		complex total = 0., elem = 0., y = 0., t = 0., c = 0.;
+		for (int q = IntervalMin; q <= IntervalMax; q++) {
+			int P = table.Points(q);
+			const complex* b1 = Tabulated(table, q, bs1 - q, dn1, scratch1);
+			const complex* b2 = Tabulated(table, q, bs2 - q, dn2, scratch2);
+			const complex* r = &table.r[table.offset[q]];
+			const complex* w = &table.w[table.offset[q]];
+
+			elem = 0.;
+			if (f) {
+				for (int p = 0; p < P; p++)
+					elem += f(r[p]) * (b1[p] * b2[p]) * w[p];
+			} else {
+				for (int p = 0; p < P; p++)
+					elem += (b1[p] * b2[p]) * w[p];
+			}
+
+			y = elem - c;
+			t = total + y;
+			c = (t - total) - y;
+			total = t;
+		}
+		return total;
+	}
+	std::vector<std::vector<complex>> BSpline::IntegrateOperators(const std::vector<RadialOperator>& ops) const {
+		int N = getNumBSplines();
+		int first = (_skipFirst ? 1 : 0);
+		std::vector<std::vector<complex>> results(ops.size(), std::vector<complex>(N*N, 0.));
+		std::vector<complex> fw(GaussQuadrature::MAX_POINTS), scratch1, scratch2, block;
+
+		for (int q = 0; q < _nodes - 1; q++) {
+			for (int o = 0; o < ops.size(); o++) {
+				auto& op = ops[o];
+				auto& result = results[o];
+				const auto& table = _tables[op.f ? General : Polynomial];
+				int P = table.Points(q);
+				const complex* r = &table.r[table.offset[q]];
+				const complex* w = &table.w[table.offset[q]];
+				bool symmetric = (op.dn1 == op.dn2);
+
+				// f once per point instead of once per pair of bsplines
+				for (int p = 0; p < P; p++)
+					fw[p] = (op.f ? op.f(r[p]) * w[p] : w[p]);
+				if (op.closed)
+					IntegratePower(q, op, block);
+
+				for (int s1 = 0; s1 < _order; s1++) {
+					int i = q + s1 - first;
+					if (i < 0 || i >= N) continue;
+					const complex* b1 = Tabulated(table, q, s1, op.dn1, scratch1);
+
+					for (int s2 = (symmetric ? s1 : 0); s2 < _order; s2++) {
+						int j = q + s2 - first;
+						if (j < 0 || j >= N) continue;
+						const complex* b2 = Tabulated(table, q, s2, op.dn2, scratch2);
+
+						complex sum = 0.;
+						if (op.closed && !std::isnan(std::real(block[s1*_order + s2]))) {
+							sum = block[s1*_order + s2];
+						} else {
+							for (int p = 0; p < P; p++)
+								sum += fw[p] * (b1[p] * b2[p]);
+						}
+
+						result[i + j*N] += sum;
+						if (symmetric && s2 != s1)
+							result[j + i*N] += sum;
+					}
+				}
+			}
+		}
+
+		if (_quadCheck)
+			CheckQuadrature(ops, results);
+		return results;
 	}
+	// the P values of bspline q+s on interval q
+	const complex* BSpline::Tabulated(const QuadratureTable& table, int q, int s, int dn, std::vector<complex>& scratch) const {
+		int P = table.Points(q), first = table.offset[q];
+		if (dn < TABLE_DERIVATIVES)
+			return &table.b[dn][first*_order + s*P];
 
+		scratch.assign(P, 0.);
+		for (int p = 0; p < P; p++)
+			if (table.w[first + p] != 0.)
+				scratch[p] = bspline(table.r[first + p], q + s, dn, q);
+		return scratch.data();
+	}
+	// the same integrals with MAX_POINTS on every interval, without the tables. Polynomial
+	// integrands are exact, what differs there is round off. Each element is compared to the
+	// integral of the absolute value of its integrand, which is what the quadrature error
+	// scales with even where the element itself cancels to almost zero.
+	void BSpline::CheckQuadrature(const std::vector<RadialOperator>& ops, const std::vector<std::vector<complex>>& results) const {
+		int N = getNumBSplines();
+		int first = (_skipFirst ? 1 : 0);
+		const auto& rule = _rules.at(GaussQuadrature::MAX_POINTS);
+
+		for (int o = 0; o < ops.size(); o++) {
+			auto& op = ops[o];
+			if (!op.f) continue;
+
+			double deviation = 0.;
+			int worst_i = 0, worst_j = 0;
+			for (int i = 0; i < N; i++) {
+				for (int j = std::max(0, i - _order + 1); j < std::min(N, i + _order); j++) {
+					complex reference = 0.;
+					double scale = 0.;
+					for (int q = std::max(i, j) + first - _order + 1; q <= std::min(i, j) + first; q++) {
+						if (q < 0 || q > _nodes - 2) continue;
+						reference += rule.Integrate(_ecs_grid[q], _ecs_grid[q + 1], [&](complex x) {
+							return op.f(x) * bspline(x, i + first, op.dn1, q) * bspline(x, j + first, op.dn2, q);
+						});
+						scale += std::abs(rule.Integrate(_ecs_grid[q], _ecs_grid[q + 1], [&](complex x) {
+							return complex(std::abs(op.f(x) * bspline(x, i + first, op.dn1, q) * bspline(x, j + first, op.dn2, q)));
+						}));
+					}
+					if (scale <= 0.) continue;
+					double d = std::abs(reference - results[o][i + j*N]) / scale;
+					if (d > deviation) {
+						deviation = d;
+						worst_i = i;
+						worst_j = j;
+					}
+				}
+			}
+
+			std::stringstream ss;
+			ss << "Quadrature check of radial operator " << o << " (dn = " << op.dn1 << ", " << op.dn2
+			   << "): largest deviation from " << GaussQuadrature::MAX_POINTS
+			   << " points " << std::scientific << std::setprecision(2) << deviation
+			   << " of the element, at (" << worst_i << ", " << worst_j << ")";
+			if (deviation > QUADRATURE_CHECK_LIMIT*std::max(_quadTolerance, QUADRATURE_TOLERANCE))
+				LOG_WARN(ss.str());
+			else
+				LOG_INFO(ss.str());
+		}
+	}
 
 /* --- this is probably pointless? 
 TODO: check
@@ -52,8 +196,9 @@ function KahanSum(input)
 			complex lower_bound = _ecs.R(std::max(xmin, _grid[i]));		// start from xmin
 			complex upper_bound = _ecs.R(std::min(xmax, _grid[i + 1]));	// stop at xmax
 
-			elem = _glQuad.Integrate(lower_bound, upper_bound, [=](complex x) {
-				return f(x) * (bspline(x, bs1, dn1) * bspline(x, bs2, dn2));
+			// every quadrature point is inside interval i
+			elem = _rules.at(QuadraturePoints(i, General)).Integrate(lower_bound, upper_bound, [=](complex x) {
+				return f(x) * (bspline(x, bs1, dn1, i) * bspline(x, bs2, dn2, i));
 			});
 			
 			y = elem - c;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "maths/maths.h"
+#include <type_traits>
+
+namespace Basis {
+	// The polynomials of the bsplines that are nonzero on one grid interval, with the order K
+	// known at compile time so the loops over the coefficients unroll. K = 0 takes the order
+	// at run time, for the orders without their own instantiation.
+	template <int K>
+	struct BSplineKernel {
+		// coeff: [d] of one bspline in the variable r = 0..1 across the interval
+		// fall: [d] d!/(d-dn)! of the derivative dn
+		template <class T>
+		static complex Evaluate(int order, const complex* coeff, const double* fall, int dn, T r) {
+			const int k = (K > 0 ? K : order);
+			complex sum = 0.;
+			for (int d = k - 1; d >= dn; d--)				// Horner
+				sum = sum * r + fall[d] * coeff[d];
+			return sum;
+		}
+		// every bspline of the interval: coeff is [s*order + d], out is [s]
+		template <class T>
+		static void EvaluateAll(int order, const complex* coeff, const double* fall, int dn, T r, complex* out) {
+			const int k = (K > 0 ? K : order);
+			for (int s = 0; s < k; s++)
+				out[s] = Evaluate(k, coeff + s*k, fall, dn, r);
+		}
+	};
+
+	// f(std::integral_constant<int, K>()) with K = order, or K = 0 outside 4..12
+	template <class F>
+	auto DispatchOrder(int order, F&& f) -> decltype(f(std::integral_constant<int, 0>())) {
+		switch (order) {
+			case 4:  return f(std::integral_constant<int, 4>());
+			case 5:  return f(std::integral_constant<int, 5>());
+			case 6:  return f(std::integral_constant<int, 6>());
+			case 7:  return f(std::integral_constant<int, 7>());
+			case 8:  return f(std::integral_constant<int, 8>());
+			case 9:  return f(std::integral_constant<int, 9>());
+			case 10: return f(std::integral_constant<int, 10>());
+			case 11: return f(std::integral_constant<int, 11>());
+			case 12: return f(std::integral_constant<int, 12>());
+			default: return f(std::integral_constant<int, 0>());
+		}
+	}
+}
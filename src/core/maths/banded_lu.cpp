@@ -0,0 +1,118 @@
+#include "maths/banded_lu.h"
+#include <algorithm>
+#include <cmath>
+
+BandedLU::BandedLU() : _n(0), _kl(0), _ku(0), _width(0) {}
+BandedLU::BandedLU(int n, int kl, int ku) {
+    Resize(n, kl, ku);
+}
+
+void BandedLU::Resize(int n, int kl, int ku) {
+    _n = n; _kl = kl; _ku = ku;
+    _width = 2*kl + ku + 1;                     // kl sub, ku super and kl fill-in diagonals
+    _ab.assign(size_t(_n)*_width, 0.);
+    _pivots.assign(_n, 0);
+}
+void BandedLU::Zero() {
+    std::fill(_ab.begin(), _ab.end(), complex(0.));
+}
+int BandedLU::Size() const {
+    return _n;
+}
+size_t BandedLU::Bytes() const {
+    return _ab.size()*sizeof(complex) + _pivots.size()*sizeof(int);
+}
+
+bool BandedLU::Factor() {
+    BandedLU& A = *this;
+
+    for (int k = 0; k < _n; k++) {
+        int last_row = std::min(_n-1, k + _kl);
+        int last_col = std::min(_n-1, k + _kl + _ku);
+
+        // find the pivot in column k
+        int p = k;
+        double max = std::abs(A(k,k));
+        for (int i = k+1; i <= last_row; i++) {
+            if (std::abs(A(i,k)) > max) {
+                max = std::abs(A(i,k));
+                p = i;
+            }
+        }
+        _pivots[k] = p;
+        if (max == 0.)
+            return false;                       // singular
+
+        if (p != k)
+            for (int j = k; j <= last_col; j++)
+                std::swap(A(k,j), A(p,j));
+
+        // eliminate below the pivot. The multipliers are stored in place of
+        // the eliminated entries and are *not* swapped by later pivots.
+        complex inv_pivot = 1./A(k,k);
+        for (int i = k+1; i <= last_row; i++) {
+            complex l = A(i,k)*inv_pivot;
+            A(i,k) = l;
+            if (l == 0.) continue;
+
+            complex* row_i = &A(i,k+1);
+            const complex* row_k = &A(k,k+1);
+            for (int j = 0; j < last_col - k; j++)
+                row_i[j] -= l*row_k[j];
+        }
+    }
+    return true;
+}
+void BandedLU::Solve(complex* b) const {
+    const BandedLU& A = *this;
+
+    // forward substitution with L (and the row interchanges)
+    for (int k = 0; k < _n; k++) {
+        int last_row = std::min(_n-1, k + _kl);
+        if (_pivots[k] != k)
+            std::swap(b[k], b[_pivots[k]]);
+        for (int i = k+1; i <= last_row; i++)
+            b[i] -= A(i,k)*b[k];
+    }
+    // back substitution with U
+    for (int k = _n-1; k >= 0; k--) {
+        int last_col = std::min(_n-1, k + _kl + _ku);
+        complex sum = b[k];
+        const complex* row_k = &A(k,k+1);
+        for (int j = 0; j < last_col - k; j++)
+            sum -= row_k[j]*b[k+1+j];
+        b[k] = sum/A(k,k);
+    }
+}
+
+// Same as Solve(b) for several right hand sides at once, so the factors
+// are read once for all of them.
+void BandedLU::Solve(complex* b, int nrhs) const {
+    const BandedLU& A = *this;
+
+    for (int k = 0; k < _n; k++) {
+        int last_row = std::min(_n-1, k + _kl);
+        complex* b_k = b + size_t(k)*nrhs;
+        if (_pivots[k] != k)
+            std::swap_ranges(b_k, b_k + nrhs, b + size_t(_pivots[k])*nrhs);
+        for (int i = k+1; i <= last_row; i++) {
+            complex l = A(i,k);
+            complex* b_i = b + size_t(i)*nrhs;
+            for (int r = 0; r < nrhs; r++)
+                b_i[r] -= l*b_k[r];
+        }
+    }
+    for (int k = _n-1; k >= 0; k--) {
+        int last_col = std::min(_n-1, k + _kl + _ku);
+        complex* b_k = b + size_t(k)*nrhs;
+        const complex* row_k = &A(k,k+1);
+        for (int j = 0; j < last_col - k; j++) {
+            const complex* b_j = b + size_t(k+1+j)*nrhs;
+            for (int r = 0; r < nrhs; r++)
+                b_k[r] -= row_k[j]*b_j[r];
+        }
+        complex inv_diagonal = 1./A(k,k);
+        for (int r = 0; r < nrhs; r++)
+            b_k[r] *= inv_diagonal;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "maths/maths.h"
+
+// LU factorization with partial pivoting of a general band matrix with
+// kl sub-diagonals and ku super-diagonals (same scheme as LAPACK's gbtrf).
+// Each row is stored contiguously with room for the kl extra
+// super-diagonals that pivoting can create.
+class BandedLU {
+    int _n, _kl, _ku, _width;
+    std::vector<complex> _ab;
+    std::vector<int> _pivots;
+public:
+    BandedLU();
+    BandedLU(int n, int kl, int ku);
+
+    void Resize(int n, int kl, int ku);
+    void Zero();
+    bool Factor();                              // false if a zero pivot is found
+    void Solve(complex* b) const;               // in place, b has length Size()
+    void Solve(complex* b, int nrhs) const;     // nrhs interleaved right hand sides, b[row*nrhs + k]
+
+    int Size() const;
+    size_t Bytes() const;
+
+    // element (row, col) - only valid for -kl <= col-row <= ku (before Factor)
+    inline complex& operator() (int row, int col) {
+        return _ab[row*_width + (col - row + _kl)];
+    }
+    inline const complex& operator() (int row, int col) const {
+        return _ab[row*_width + (col - row + _kl)];
+    }
+};
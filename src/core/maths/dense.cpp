@@ -0,0 +1,241 @@
+#include "maths/dense.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Dense {
+
+bool Solve(int n, std::vector<complex> A, std::vector<complex>& B, int nrhs) {
+    auto a = [&](int i, int j) -> complex& { return A[i + j*n]; };
+    auto b = [&](int i, int j) -> complex& { return B[i + j*n]; };
+
+    for (int k = 0; k < n; k++) {
+        int p = k;
+        for (int i = k+1; i < n; i++)
+            if (std::abs(a(i,k)) > std::abs(a(p,k)))
+                p = i;
+        if (a(p,k) == 0.)
+            return false;
+        if (p != k) {
+            for (int j = k; j < n; j++) std::swap(a(k,j), a(p,j));
+            for (int j = 0; j < nrhs; j++) std::swap(b(k,j), b(p,j));
+        }
+        for (int i = k+1; i < n; i++) {
+            complex l = a(i,k)/a(k,k);
+            if (l == 0.) continue;
+            for (int j = k+1; j < n; j++) a(i,j) -= l*a(k,j);
+            for (int j = 0; j < nrhs; j++) b(i,j) -= l*b(k,j);
+        }
+    }
+    for (int j = 0; j < nrhs; j++) {
+        for (int k = n-1; k >= 0; k--) {
+            complex sum = b(k,j);
+            for (int i = k+1; i < n; i++) sum -= a(k,i)*b(i,j);
+            b(k,j) = sum/a(k,k);
+        }
+    }
+    return true;
+}
+
+void QR(int rows, int cols, std::vector<complex>& A, std::vector<complex>& R) {
+    R.assign(cols*cols, 0.);
+    for (int j = 0; j < cols; j++) {
+        complex* q = &A[j*rows];
+        // twice is enough (Giraud et al.) for the nearly dependent columns of a Krylov basis
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < j; i++) {
+                const complex* qi = &A[i*rows];
+                complex dot = 0.;
+                for (int r = 0; r < rows; r++) dot += std::conj(qi[r])*q[r];
+                for (int r = 0; r < rows; r++) q[r] -= dot*qi[r];
+                R[i + j*cols] += dot;
+            }
+        }
+        double norm = 0.;
+        for (int r = 0; r < rows; r++) norm += std::norm(q[r]);
+        norm = std::sqrt(norm);
+        R[j + j*cols] = norm;
+        if (norm > 0.)
+            for (int r = 0; r < rows; r++) q[r] /= norm;
+    }
+}
+
+// Givens rotation (c real, s complex) with [c s; -conj(s) c] [a; b] = [r; 0]
+static void Givens(complex a, complex b, double& c, complex& s) {
+    double na = std::abs(a), nb = std::abs(b);
+    if (nb == 0.) { c = 1.; s = 0.; return; }
+    if (na == 0.) { c = 0.; s = std::conj(b)/nb; return; }
+    double norm = std::hypot(na, nb);
+    c = na/norm;
+    s = (a/na)*std::conj(b)/norm;
+}
+
+bool Eigen(int n, std::vector<complex> A, std::vector<complex>& values, std::vector<complex>& vectors) {
+    auto a = [&](int i, int j) -> complex& { return A[i + j*n]; };
+    std::vector<complex> Z(n*n, 0.);
+    auto z = [&](int i, int j) -> complex& { return Z[i + j*n]; };
+    for (int i = 0; i < n; i++) z(i,i) = 1.;
+
+    // Householder reduction to upper Hessenberg form, A = Z H Z^H
+    std::vector<complex> v(n);
+    for (int k = 0; k < n-2; k++) {
+        double norm = 0.;
+        for (int i = k+1; i < n; i++) norm += std::norm(a(i,k));
+        norm = std::sqrt(norm);
+        if (norm == 0.) continue;
+
+        complex x0 = a(k+1,k);
+        complex alpha = -(std::abs(x0) > 0. ? x0/std::abs(x0) : complex(1.))*norm;
+        double vnorm = 0.;
+        for (int i = k+1; i < n; i++) {
+            v[i] = a(i,k) - (i == k+1 ? alpha : complex(0.));
+            vnorm += std::norm(v[i]);
+        }
+        vnorm = std::sqrt(vnorm);
+        if (vnorm == 0.) continue;
+        for (int i = k+1; i < n; i++) v[i] /= vnorm;
+
+        // A = (I - 2vv^H) A (I - 2vv^H), Z = Z (I - 2vv^H)
+        for (int j = 0; j < n; j++) {
+            complex dot = 0.;
+            for (int i = k+1; i < n; i++) dot += std::conj(v[i])*a(i,j);
+            for (int i = k+1; i < n; i++) a(i,j) -= 2.*v[i]*dot;
+        }
+        for (int i = 0; i < n; i++) {
+            complex dot = 0., dotz = 0.;
+            for (int j = k+1; j < n; j++) { dot += a(i,j)*v[j]; dotz += z(i,j)*v[j]; }
+            for (int j = k+1; j < n; j++) { a(i,j) -= 2.*dot*std::conj(v[j]); z(i,j) -= 2.*dotz*std::conj(v[j]); }
+        }
+        for (int i = k+2; i < n; i++) a(i,k) = 0.;
+    }
+
+    // shifted QR iterations to the Schur form H = Q T Q^H
+    std::vector<double> cs(n);
+    std::vector<complex> sn(n);
+    const double eps = std::numeric_limits<double>::epsilon();
+    int hi = n-1, iter = 0;
+    while (hi > 0) {
+        int lo = hi;
+        while (lo > 0 && std::abs(a(lo,lo-1)) > eps*(std::abs(a(lo,lo)) + std::abs(a(lo-1,lo-1))))
+            lo--;
+        if (lo == hi) {
+            a(hi,hi-1) = 0.;
+            hi--;
+            iter = 0;
+            continue;
+        }
+        if (++iter > 30*n)
+            return false;
+        if (lo > 0) a(lo,lo-1) = 0.;
+
+        // Wilkinson shift from the trailing 2x2 block (exceptional shift now and then)
+        complex mu;
+        if (iter % 11 == 0)
+            mu = a(hi,hi) + std::abs(a(hi,hi-1));
+        else {
+            complex p = a(hi-1,hi-1), q = a(hi-1,hi), r = a(hi,hi-1), s = a(hi,hi);
+            complex tr = 0.5*(p + s), disc = std::sqrt(0.25*(p - s)*(p - s) + q*r);
+            complex l1 = tr + disc, l2 = tr - disc;
+            mu = std::abs(l1 - s) < std::abs(l2 - s) ? l1 : l2;
+        }
+
+        for (int k = lo; k <= hi; k++) a(k,k) -= mu;
+        for (int k = lo; k < hi; k++) {
+            Givens(a(k,k), a(k+1,k), cs[k], sn[k]);
+            for (int j = k; j < n; j++) {
+                complex t1 = a(k,j), t2 = a(k+1,j);
+                a(k,j) = cs[k]*t1 + sn[k]*t2;
+                a(k+1,j) = -std::conj(sn[k])*t1 + cs[k]*t2;
+            }
+        }
+        for (int k = lo; k < hi; k++) {
+            int last = std::min(k+2, hi);
+            for (int i = 0; i <= last; i++) {
+                complex t1 = a(i,k), t2 = a(i,k+1);
+                a(i,k) = cs[k]*t1 + std::conj(sn[k])*t2;
+                a(i,k+1) = -sn[k]*t1 + cs[k]*t2;
+            }
+            for (int i = 0; i < n; i++) {
+                complex t1 = z(i,k), t2 = z(i,k+1);
+                z(i,k) = cs[k]*t1 + std::conj(sn[k])*t2;
+                z(i,k+1) = -sn[k]*t1 + cs[k]*t2;
+            }
+        }
+        for (int k = lo; k <= hi; k++) a(k,k) += mu;
+    }
+
+    // eigenvectors of the triangular T by back substitution, then back to the original basis
+    values.resize(n);
+    vectors.assign(n*n, 0.);
+    std::vector<complex> y(n);
+    double tnorm = 0.;
+    for (int j = 0; j < n; j++)
+        for (int i = 0; i <= j; i++)
+            tnorm = std::max(tnorm, std::abs(a(i,j)));
+    for (int k = 0; k < n; k++) {
+        complex lambda = values[k] = a(k,k);
+        std::fill(y.begin(), y.end(), complex(0.));
+        y[k] = 1.;
+        for (int i = k-1; i >= 0; i--) {
+            complex sum = 0.;
+            for (int j = i+1; j <= k; j++) sum += a(i,j)*y[j];
+            complex d = a(i,i) - lambda;
+            if (std::abs(d) < eps*tnorm) d = eps*tnorm;
+            y[i] = -sum/d;
+        }
+        double norm = 0.;
+        for (int i = 0; i < n; i++) {
+            complex sum = 0.;
+            for (int j = 0; j <= k; j++) sum += z(i,j)*y[j];
+            vectors[i + k*n] = sum;
+            norm += std::norm(sum);
+        }
+        norm = std::sqrt(norm);
+        for (int i = 0; i < n; i++) vectors[i + k*n] /= norm;
+    }
+    return true;
+}
+
+static std::vector<complex> Multiply(int n, const std::vector<complex>& A, const std::vector<complex>& B) {
+    std::vector<complex> C(n*n, 0.);
+    for (int j = 0; j < n; j++)
+        for (int k = 0; k < n; k++) {
+            complex b = B[k + j*n];
+            if (b == 0.) continue;
+            for (int i = 0; i < n; i++)
+                C[i + j*n] += A[i + k*n]*b;
+        }
+    return C;
+}
+
+std::vector<complex> Expm(int n, std::vector<complex> A) {
+    const int q = 8;                            // [8/8] is accurate to round off for |A| <= 1/2
+
+    double norm = 0.;
+    for (int j = 0; j < n; j++) {
+        double sum = 0.;
+        for (int i = 0; i < n; i++) sum += std::abs(A[i + j*n]);
+        norm = std::max(norm, sum);
+    }
+    int squarings = (norm > 0.5 ? int(std::ceil(std::log2(norm/0.5))) : 0);
+    for (auto& a : A) a /= std::pow(2., squarings);
+
+    std::vector<complex> X(n*n, 0.), N(n*n, 0.), D(n*n, 0.);
+    for (int i = 0; i < n; i++)
+        X[i + i*n] = N[i + i*n] = D[i + i*n] = 1.;
+    double c = 1.;
+    for (int k = 1; k <= q; k++) {
+        c *= double(q-k+1)/(k*(2*q-k+1));
+        X = Multiply(n, A, X);
+        for (int i = 0; i < n*n; i++) {
+            N[i] += c*X[i];
+            D[i] += (k % 2 ? -c : c)*X[i];
+        }
+    }
+    Solve(n, D, N, n);
+    for (int s = 0; s < squarings; s++)
+        N = Multiply(n, N, N);
+    return N;
+}
+
+}
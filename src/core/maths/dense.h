@@ -0,0 +1,21 @@
+#pragma once
+
+#include "maths/maths.h"
+
+// Small dense linear algebra used inside the Krylov solvers (matrices of
+// the size of a Krylov basis, not of the problem). All matrices are
+// column major: A(i,j) = A[i + j*rows].
+namespace Dense {
+    // solve A X = B in place (B becomes X) with partial pivoting. false if A is singular.
+    bool Solve(int n, std::vector<complex> A, std::vector<complex>& B, int nrhs);
+
+    // A = Q R by modified Gram-Schmidt. A is replaced by Q (rows x cols), R is cols x cols.
+    void QR(int rows, int cols, std::vector<complex>& A, std::vector<complex>& R);
+
+    // eigenvalues and (normalized) right eigenvectors of a general n x n matrix
+    // by reduction to Hessenberg form and the shifted QR algorithm.
+    bool Eigen(int n, std::vector<complex> A, std::vector<complex>& values, std::vector<complex>& vectors);
+
+    // exp(A) by scaling and squaring with a diagonal Pade approximant
+    std::vector<complex> Expm(int n, std::vector<complex> A);
+}
@@ -0,0 +1,351 @@
+#include "maths/gcrodr.h"
+#include "maths/dense.h"
+#include "utility/logger.h"
+#include "utility/memory_tracker.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+GCRODRSolver::GCRODRSolver(MathLib& lib, int restart_iter, int recycle, int max_iter) :
+    _MathLib(lib), _m(restart_iter), _k(std::max(0, std::min(recycle, restart_iter-1))),
+    _max_iter(max_iter), _tol(1.e-12), _iterations(0), _residual(0.), _converged(true) {
+}
+
+void GCRODRSolver::SetBlockedPC(int blocks) {
+    LOG_WARN("GCRO-DR: block Jacobi is not available, running without a preconditioner.");
+}
+void GCRODRSolver::SetPreconditionerMatrix(const Matrix P) {
+    // nothing to do, the preconditioner never looks at the operator
+}
+void GCRODRSolver::SetBlockDiagonalPC(const Matrix P, int blockSize, int bandwidth) {
+    // applied from the right so the recycled subspace survives changes of A
+    _pc = _MathLib.CreateBlockTridiagonalSolver(P, std::vector<Matrix>(), blockSize, bandwidth, true);
+    if (!_pc)
+        LOG_WARN("GCRO-DR: the preconditioner matrix is not block diagonal, running without a preconditioner.");
+}
+BlockTridiagonalSolver GCRODRSolver::BlockDiagonalPC() const {
+    return _pc;
+}
+int GCRODRSolver::Iterations() const {
+    return _iterations;
+}
+double GCRODRSolver::Residual() const {
+    return _residual;
+}
+int GCRODRSolver::ConvergedReason() const {
+    return (_converged ? 2 : -3);               // KSP_CONVERGED_RTOL, KSP_DIVERGED_ITS
+}
+void GCRODRSolver::SetTolerance(double rtol) {
+    _tol = rtol;
+}
+double GCRODRSolver::Tolerance() const {
+    return _tol;
+}
+
+// b may be a subvector of the active rows, the vectors take its layout
+void GCRODRSolver::Allocate(const Vector b) {
+    if (_r && _r->Length() == b->Length())
+        return;
+    _r = _MathLib.CreateVector(b);
+    _w = _MathLib.CreateVector(b);
+    _z = _MathLib.CreateVector(b);
+    _V.clear();
+    _U.clear();
+    _C.clear();
+    _spare.clear();
+    for (int i = 0; i <= _m; i++)
+        _V.push_back(_MathLib.CreateVector(b));
+    // the new U and C are built while the old ones are still needed
+    for (int i = 0; i < 4*_k; i++)
+        _spare.push_back(_MathLib.CreateVector(b));
+}
+
+void GCRODRSolver::ApplyOperator(const Matrix A, const Vector in, Vector out) {
+    if (_pc) {
+        _pc->Solve(in, _z);
+        _MathLib.Mult(A, _z, out);
+    } else
+        _MathLib.Mult(A, in, out);
+}
+
+void GCRODRSolver::AddCorrection(Vector x, const std::vector<Vector>& basis, const std::vector<complex>& y) {
+    _w->Zero();
+    for (int i = 0; i < y.size(); i++)
+        _MathLib.AXPY(_w, y[i], basis[i]);
+    if (_pc) {
+        _pc->Solve(_w, _z);
+        _MathLib.AXPY(x, 1., _z);
+    } else
+        _MathLib.AXPY(x, 1., _w);
+}
+
+double GCRODRSolver::Norm(const Vector v) {
+    complex value;
+    _MathLib.Dot(v, v, value);
+    return std::sqrt(value.real());
+}
+
+// A changed since U was built: C = A M^-1 U, orthonormalized together with U
+bool GCRODRSolver::RebuildRecycleSpace(const Matrix A) {
+    for (int c = 0; c < _U.size(); c++)
+        ApplyOperator(A, _U[c], _C[c]);
+
+    for (int c = 0; c < _C.size(); c++) {
+        double norm0 = Norm(_C[c]);
+        for (int i = 0; i < c; i++) {
+            complex h;
+            _MathLib.Dot(_C[c], _C[i], h);
+            _MathLib.AXPY(_C[c], -h, _C[i]);
+            _MathLib.AXPY(_U[c], -h, _U[i]);
+        }
+        double norm = Norm(_C[c]);
+        if (norm <= 1.e-12*norm0) {             // numerically dependent - drop it
+            _spare.push_back(_C[c]);
+            _spare.push_back(_U[c]);
+            _C.erase(_C.begin() + c);
+            _U.erase(_U.begin() + c);
+            c--;
+            continue;
+        }
+        _C[c]->Scale(1./norm);
+        _U[c]->Scale(1./norm);
+    }
+    return !_C.empty();
+}
+
+// remove the part of the residual in range(C): x += M^-1 U C^H r, r -= C C^H r
+void GCRODRSolver::Project(Vector x) {
+    std::vector<complex> t(_C.size());
+    for (int i = 0; i < _C.size(); i++)
+        _MathLib.Dot(_r, _C[i], t[i]);
+    for (int i = 0; i < _C.size(); i++)
+        _MathLib.AXPY(_r, -t[i], _C[i]);
+    if (!_C.empty())
+        AddCorrection(x, _U, t);
+}
+
+// New U, C from the harmonic Ritz vectors of the cycle that just finished.
+// With W = [C V_0..V_j] and Vh = [U V_0..V_j-1] the cycle satisfies
+// A M^-1 Vh = W G, G = [I B; 0 H]. The harmonic Ritz vectors solve
+// G^H G z = theta G^H W^H Vh z; the ones with the smallest |theta| are kept.
+// After a happy breakdown V_j was never built and the last row of G is 0, W stops at V_j-1.
+void GCRODRSolver::UpdateRecycleSpace(int j, bool breakdown, const std::vector<complex>& H, const std::vector<complex>& B) {
+    int k = _C.size(), n = k + j, rows = n + (breakdown ? 0 : 1), ldh = _m + 1;
+    int kt = std::min(_k, n);
+    if (kt == 0)
+        return;
+
+    std::vector<complex> G(rows*n, 0.), WV(rows*n, 0.);
+    for (int i = 0; i < k; i++)
+        G[i + i*rows] = 1.;
+    for (int c = 0; c < j; c++) {
+        for (int i = 0; i < k; i++)
+            G[i + (k+c)*rows] = B[i + c*k];
+        for (int i = 0; i <= c+1 && k+i < rows; i++)
+            G[k+i + (k+c)*rows] = H[i + c*ldh];
+        WV[k+c + (k+c)*rows] = 1.;
+    }
+    for (int c = 0; c < k; c++) {
+        for (int i = 0; i < k; i++)
+            _MathLib.Dot(_U[c], _C[i], WV[i + c*rows]);
+        for (int i = 0; k+i < rows; i++)
+            _MathLib.Dot(_U[c], _V[i], WV[k+i + c*rows]);
+    }
+
+    // (G^H G)^-1 G^H W^H Vh z = 1/theta z, keep the largest |1/theta|
+    std::vector<complex> GG(n*n, 0.), X(n*n, 0.);
+    for (int a = 0; a < n; a++)
+        for (int b = 0; b < n; b++)
+            for (int i = 0; i < rows; i++) {
+                GG[a + b*n] += std::conj(G[i + a*rows])*G[i + b*rows];
+                X[a + b*n] += std::conj(G[i + a*rows])*WV[i + b*rows];
+            }
+    std::vector<complex> values, vectors;
+    if (!Dense::Solve(n, GG, X, n) || !Dense::Eigen(n, X, values, vectors)) {
+        LOG_WARN("GCRO-DR: harmonic Ritz problem failed, keeping the old subspace.");
+        return;
+    }
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return std::abs(values[a]) > std::abs(values[b]); });
+
+    // G P = Q R, C = W Q, U = Vh P R^-1
+    std::vector<complex> P(n*kt), GP(rows*kt, 0.), R;
+    for (int c = 0; c < kt; c++)
+        std::copy_n(&vectors[order[c]*n], n, &P[c*n]);
+    for (int c = 0; c < kt; c++)
+        for (int b = 0; b < n; b++)
+            for (int i = 0; i < rows; i++)
+                GP[i + c*rows] += G[i + b*rows]*P[b + c*n];
+    Dense::QR(rows, kt, GP, R);
+    for (int c = 0; c < kt; c++) {
+        if (std::abs(R[c + c*kt]) <= 1.e-12*std::abs(R[0])) {
+            kt = c;                             // the rest is (numerically) dependent
+            break;
+        }
+        for (int i = 0; i < c; i++)
+            for (int b = 0; b < n; b++)
+                P[b + c*n] -= P[b + i*n]*R[i + c*kt];
+        for (int b = 0; b < n; b++)
+            P[b + c*n] /= R[c + c*kt];
+    }
+
+    std::vector<Vector> U(kt), C(kt);
+    for (int c = 0; c < kt; c++) {
+        U[c] = _spare.back();
+        _spare.pop_back();
+        C[c] = _spare.back();
+        _spare.pop_back();
+        U[c]->Zero();
+        C[c]->Zero();
+        for (int i = 0; i < rows; i++)
+            _MathLib.AXPY(C[c], GP[i + c*rows], i < k ? _C[i] : _V[i-k]);
+        for (int i = 0; i < n; i++)
+            _MathLib.AXPY(U[c], P[i + c*n], i < k ? _U[i] : _V[i-k]);
+    }
+    _spare.insert(_spare.end(), _U.begin(), _U.end());
+    _spare.insert(_spare.end(), _C.begin(), _C.end());
+    _U.swap(U);
+    _C.swap(C);
+}
+
+bool GCRODRSolver::Solve(const Matrix A, const Vector b, Vector x) {
+    MemoryOwner owner("GCRO-DR");
+    _iterations = 0;
+    Allocate(b);
+
+    double target = _tol*Norm(b);
+    _residual = 0.;
+    _converged = true;
+    if (target == 0.) {
+        x->Zero();
+        return true;
+    }
+
+    // r = b - A x, then deflate with the subspace kept from the last solve
+    _MathLib.Mult(A, x, _r);
+    _MathLib.AYPX(_r, -1., b);
+    if (!_U.empty() && RebuildRecycleSpace(A))
+        Project(x);
+
+    double rnorm = Norm(_r);
+    bool converged = (rnorm <= target), singular = false;
+    _residual = rnorm;
+    while (!converged && !singular && _iterations < _max_iter) {
+        int k = _C.size(), mk = std::max(1, _m - k), ldh = _m + 1;
+        std::vector<complex> H(ldh*mk, 0.), B(k*mk, 0.), R(ldh*mk, 0.), g(mk+1, 0.), sn(mk);
+        std::vector<double> cs(mk);
+
+        // Arnoldi with (I - C C^H) A M^-1, the residual norm from Givens rotations
+        _V[0]->Copy(_r);
+        _V[0]->Scale(1./rnorm);
+        g[0] = rnorm;
+
+        int j = 0;
+        bool breakdown = false;
+        while (j < mk && _iterations < _max_iter) {
+            ApplyOperator(A, _V[j], _w);
+            for (int i = 0; i < k; i++) {
+                _MathLib.Dot(_w, _C[i], B[i + j*k]);
+                _MathLib.AXPY(_w, -B[i + j*k], _C[i]);
+            }
+            for (int i = 0; i <= j; i++) {
+                _MathLib.Dot(_w, _V[i], H[i + j*ldh]);
+                _MathLib.AXPY(_w, -H[i + j*ldh], _V[i]);
+            }
+            double h = Norm(_w);
+            H[j+1 + j*ldh] = h;
+
+            for (int i = 0; i <= j+1; i++)
+                R[i + j*ldh] = H[i + j*ldh];
+            for (int i = 0; i < j; i++) {
+                complex t1 = R[i + j*ldh], t2 = R[i+1 + j*ldh];
+                R[i + j*ldh] = cs[i]*t1 + sn[i]*t2;
+                R[i+1 + j*ldh] = -std::conj(sn[i])*t1 + cs[i]*t2;
+            }
+            complex a = R[j + j*ldh];
+            if (h == 0. && std::abs(a) == 0.) {
+                singular = true;                // the operator is singular on the Krylov space, column j adds nothing
+                _iterations++;
+                break;
+            }
+            if (h == 0.) {
+                cs[j] = 1.;
+                sn[j] = 0.;
+            } else {
+                double norm = std::hypot(std::abs(a), h);
+                cs[j] = std::abs(a)/norm;
+                sn[j] = (std::abs(a) > 0. ? a/std::abs(a) : complex(1.))*h/norm;
+            }
+            R[j + j*ldh] = cs[j]*a + sn[j]*h;
+            g[j+1] = -std::conj(sn[j])*g[j];
+            g[j] = cs[j]*g[j];
+
+            _iterations++;
+            j++;
+            if (h == 0.) {
+                breakdown = true;               // happy breakdown
+                break;
+            }
+            _V[j]->Copy(_w);
+            _V[j]->Scale(1./h);
+            if (std::abs(g[j]) <= target)
+                break;
+        }
+
+        // y = R^-1 g, x += M^-1 (V y - U B y)
+        std::vector<complex> y(j), coeffs;
+        std::vector<Vector> basis;
+        for (int i = j-1; i >= 0; i--) {
+            complex sum = g[i];
+            for (int l = i+1; l < j; l++)
+                sum -= R[i + l*ldh]*y[l];
+            y[i] = sum/R[i + i*ldh];
+        }
+        for (int i = 0; i < j; i++) {
+            basis.push_back(_V[i]);
+            coeffs.push_back(y[i]);
+        }
+        for (int i = 0; i < k; i++) {
+            complex by = 0.;
+            for (int l = 0; l < j; l++)
+                by += B[i + l*k]*y[l];
+            basis.push_back(_U[i]);
+            coeffs.push_back(-by);
+        }
+        AddCorrection(x, basis, coeffs);
+        _residual = std::abs(g[j]);
+        converged = (_residual <= target);
+
+        // also after the last cycle: the next system starts from this subspace
+        UpdateRecycleSpace(j, breakdown, H, B);
+
+        if (!converged) {
+            _MathLib.Mult(A, x, _r);
+            _MathLib.AYPX(_r, -1., b);
+            Project(x);
+            rnorm = Norm(_r);
+            _residual = rnorm;
+            converged = (rnorm <= target);
+        }
+    }
+    _converged = converged;
+
+    if (!converged && singular)
+        LOG_WARN("GCRO-DR: singular operator after " + std::to_string(_iterations) + " iterations.");
+    else if (!converged)
+        LOG_WARN("GCRO-DR: no convergence after " + std::to_string(_iterations) + " iterations.");
+    return converged;
+}
+// One after the other: the systems share the operator, so each starts
+// with the subspace the previous one left.
+bool GCRODRSolver::Solve(const Matrix A, const std::vector<Vector>& b, std::vector<Vector>& x) {
+    int total = 0;
+    for (int k = 0; k < b.size(); k++) {
+        if (!Solve(A, b[k], x[k]))
+            return false;
+        total += _iterations;
+    }
+    _iterations = total/std::max<int>(1, b.size());
+    return true;
+}
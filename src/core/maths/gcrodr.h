@@ -0,0 +1,49 @@
+#pragma once
+
+#include "maths/maths.h"
+
+// GCRO-DR (Parks et al. 2006): restarted GMRES that keeps a small subspace
+// U of harmonic Ritz vectors (approximations to the eigenvectors with the
+// smallest eigenvalues) between restarts and between consecutive systems.
+// The slowly changing Crank-Nicolson matrices of neighbouring time steps
+// share this subspace, so the outliers that slow GMRES down are deflated
+// from the start of every solve.
+//
+// Written against MathLib only (vector operations, Mult and Dot); the
+// optional right preconditioner is the field free block LU.
+class GCRODRSolver : public IGMRESSolver {
+    MathLib& _MathLib;
+    int _m, _k, _max_iter;                      // vectors per cycle (incl. recycled), recycled, max iterations
+    double _tol;
+    int _iterations;
+    double _residual;                           // estimate at the end of the last solve
+    bool _converged;
+    BlockTridiagonalSolver _pc;
+
+    std::vector<Vector> _U, _C;                 // (A M^-1) U = C, C orthonormal
+    std::vector<Vector> _V;                     // Arnoldi basis of the current cycle
+    std::vector<Vector> _spare;                 // for the next U and C, allocated once with the rest
+    Vector _r, _w, _z;
+
+    void Allocate(const Vector b);
+    void ApplyOperator(const Matrix A, const Vector in, Vector out);                // out = A M^-1 in
+    void AddCorrection(Vector x, const std::vector<Vector>& basis, const std::vector<complex>& y);     // x += M^-1 basis*y
+    double Norm(const Vector v);
+    bool RebuildRecycleSpace(const Matrix A);
+    void Project(Vector x);
+    void UpdateRecycleSpace(int j, bool breakdown, const std::vector<complex>& H, const std::vector<complex>& B);
+public:
+    GCRODRSolver(MathLib& lib, int restart_iter, int recycle, int max_iter);
+
+    bool Solve(const Matrix A, const Vector b, Vector x);
+    bool Solve(const Matrix A, const std::vector<Vector>& b, std::vector<Vector>& x);
+    void SetBlockedPC(int blocks);
+    void SetPreconditionerMatrix(const Matrix P);
+    void SetBlockDiagonalPC(const Matrix P, int blockSize, int bandwidth);
+    BlockTridiagonalSolver BlockDiagonalPC() const;
+    int Iterations() const;
+    double Residual() const;
+    int ConvergedReason() const;
+    void SetTolerance(double rtol);
+    double Tolerance() const;
+};
@@ -13,6 +13,8 @@ class IMatrix;
 class IVector;
 class IHDF5;
 class IGMRESSolver;
+class IBlockTridiagonalSolver;
+class IBlockSpectralPropagator;
 class IASCII;
 
 typedef std::complex<double> complex;
@@ -22,6 +24,8 @@ typedef std::shared_ptr<IVector> Vector;
 typedef std::shared_ptr<IHDF5> HDF5;
 typedef std::shared_ptr<IASCII> ASCII;
 typedef std::shared_ptr<IGMRESSolver> GMRESSolver;
+typedef std::shared_ptr<IBlockTridiagonalSolver> BlockTridiagonalSolver;
+typedef std::shared_ptr<IBlockSpectralPropagator> BlockSpectralPropagator;
 
 const double c = 137.036;
 const double Pi = 3.14159265358979323846;
@@ -64,7 +68,9 @@ public:
     virtual void Transform(Vector& out, std::function<std::vector<complex>(const std::vector<complex>&)> f) = 0;
 
     virtual Vector GetSubVector(int start, int end) = 0;
+    virtual Vector GetSubVector(const std::vector<int>& rows) = 0;      // any sorted rows, restored the same way
     virtual void RestoreSubVector(Vector sub) = 0; 
+    virtual int LastIndexAbove(double threshold, int blockSize) = 0;    // largest i % blockSize with |v_i|^2 > threshold, -1 if none
     virtual void AssembleBegin() {};
     virtual void AssembleEnd() {};
 };
@@ -135,31 +141,86 @@ public:
     virtual void WriteVector(const std::string& obj_name, const Vector value) = 0;
     virtual void ReadVector(const std::string& obj_name, Vector value) = 0;
     virtual bool HasVector(const std::string& obj_name) const = 0;
+    virtual void WriteRecord(const std::string& obj_name, const std::vector<double>& values, int index) = 0;  // row index of a growing (chunked) dataset
+    virtual bool ReadRecords(const std::string& obj_name, std::vector<std::vector<double>>& rows) = 0;         // every row written by WriteRecord, on every rank
 };
 
 class IGMRESSolver {
 public:
     virtual bool Solve(const Matrix A, const Vector b, Vector x) = 0;
+    virtual bool Solve(const Matrix A, const std::vector<Vector>& b, std::vector<Vector>& x) = 0;     // several right hand sides, one (block) solve
     virtual void SetBlockedPC(int blocks) = 0;
+    virtual void SetPreconditionerMatrix(const Matrix P) = 0;     // build the preconditioner from P instead of A
+    virtual void SetBlockDiagonalPC(const Matrix P, int blockSize, int bandwidth) = 0;    // banded LU of P's diagonal blocks, factored once
+    virtual BlockTridiagonalSolver BlockDiagonalPC() const = 0;    // the solver of SetBlockDiagonalPC (nullptr without), e.g. to solve with P itself
+    virtual int Iterations() const = 0;                             // of the last solve (per right hand side for several)
+    virtual double Residual() const = 0;                            // norm at the end of the last solve
+    virtual int ConvergedReason() const = 0;                        // of the last solve, as PETSc's KSPConvergedReason (< 0 diverged)
+    virtual void SetTolerance(double rtol) = 0;
+    virtual double Tolerance() const = 0;                           // relative
+};
+
+// Direct solver for base + sum_k c_k*terms[k] when every matrix is block
+// tridiagonal with banded blocks. The blocks are cached on construction
+// and only combined and refactored when the coefficients change.
+class IBlockTridiagonalSolver {
+public:
+    virtual void SetCoefficients(const std::vector<complex>& coeffs) = 0;
+    virtual bool Solve(const Vector b, Vector x) = 0;
+    virtual bool Solve(const std::vector<Vector>& b, std::vector<Vector>& x) = 0;   // the factors are read once for all of b
+};
+
+// exp(-i S^-1 H t) for block diagonal H and S. Every diagonal block is
+// diagonalized once on construction; psi can then be moved to any time
+// at the cost of two dense products per block.
+class IBlockSpectralPropagator {
+public:
+    virtual void SetState(const Vector psi) = 0;                // expand psi in the eigenvectors
+    virtual void Evolve(double t, Vector psi) = 0;              // psi = the state of SetState, a time t later
 };
 
 
 
 class MathLib {
 public:
-    virtual bool Startup(int argc, char **args) = 0;
+    // groups > 1: the ranks are split into that many independent worlds (e.g. for the runs of a sweep),
+    // with weights (one per group) the ranks are shared out in proportion to them
+    virtual bool Startup(int argc, char **args, int groups = 1, const std::vector<double>& weights = {}) = 0;
     virtual void Shutdown() = 0;
+    virtual int Group() const = 0;              // of this rank
+    virtual int Groups() const = 0;
+    virtual int Size() const = 0;               // ranks in this rank's group
+    virtual bool JoinGroups() = 0;              // wait for all the groups, true on the first rank of them all
 
     virtual Vector CreateVector(int N) = 0;
+    virtual Vector CreateVector(const Matrix M) = 0;            // zero, laid out like the rows of M (e.g. of CreateSubMatrix)
+    virtual Vector CreateVector(const Vector layout) = 0;       // zero, laid out like layout
     virtual void DestroyVector(Vector& m) = 0;
 
     virtual Matrix CreateMatrix(int rows, int cols, int numBands) = 0;
     virtual void DestroyMatrix(Matrix& m) = 0;
 
+    // base + sum_k c_k*terms[k], applied as a sequence of products (never assembled)
+    virtual Matrix CreateCompositeMatrix(const Matrix base, const std::vector<Matrix>& terms) = 0;
+    virtual void SetCompositeCoefficients(Matrix composite, const std::vector<complex>& coeffs) = 0;
+    // read only copy of an assembled matrix with the values in single precision (half the memory traffic)
+    virtual Matrix CreateSinglePrecisionMatrix(const Matrix M) = 0;
+    // the rows and the same columns of M (sorted), laid out like IVector::GetSubVector(rows)
+    virtual Matrix CreateSubMatrix(const Matrix M, const std::vector<int>& rows) = 0;
+
     virtual GMRESSolver CreateGMRESSolver(int restart_iter = 500, int max_iter = 10000) = 0;
     virtual void DestroyGMRESSolver(GMRESSolver& m) = 0;
 
+    virtual GMRESSolver CreateGCRODRSolver(int restart_iter = 40, int recycle = 10, int max_iter = 10000) = 0;
+
+    // diagonalOnly: ignore the off-diagonal blocks (block Jacobi with exact blocks)
+    // nullptr if the matrices are not block tridiagonal with banded blocks
+    virtual BlockTridiagonalSolver CreateBlockTridiagonalSolver(const Matrix base, const std::vector<Matrix>& terms, int blockSize, int bandwidth, bool diagonalOnly = false) = 0;
+
+    virtual BlockSpectralPropagator CreateBlockSpectralPropagator(const Matrix H, const Matrix S, int blockSize) = 0;
+
     virtual void Mult(const Matrix M, const Vector in, Vector out) = 0;
+    virtual void Mult(const Matrix M, const std::vector<Vector>& in, std::vector<Vector>& out) = 0;  // M is read once for all of in
     virtual void Dot(const Vector a, const Vector b, complex& value) = 0;
     virtual void AYPX(Matrix Y, complex a, const Matrix X) = 0;
     virtual void AXPY(Matrix Y, complex a, const Matrix X) = 0;
@@ -1,5 +1,6 @@
 #include "tdse/observable.h"
 #include "tdse/tdse.h"
+#include "utility/logger.h"
 
 #include <iostream>
 
@@ -7,18 +8,35 @@ Observable::Observable(TDSE& tdse) : _tdse(tdse), _MathLib(tdse.MathLibrary()) {
     _compute_period_in_iterations = 1;
 }
 void Observable::DoObservable(int it, double t, double dt) {
-    if (it % _compute_period_in_iterations == 0) {
+    if (IsDue(it)) {
         Compute(it, t, dt);
     }
 }
+// The samples of the free evolution have their own numbering (1, 2, ...),
+// the period counts samples. Compute gets -sample, which is never an iteration.
+void Observable::DoSample(int sample, double t, double dt) {
+    if (IsDue(sample)) {
+        Compute(-sample, t, dt);
+    }
+}
+bool Observable::IsDue(int it) const {
+    return (it % _compute_period_in_iterations == 0);
+}
 
 void Observable::SetComputePeriod(int iterations) {
     _compute_period_in_iterations = iterations;
 }
 void Observable::SetFilename(const std::string& filename) {
+    _filename = filename;
     _output_filename = filename;
 }
-
-int Observable::MemoryAlloced() const {
-    return 0;
-}
\ No newline at end of file
+void Observable::SetDirectory(const std::string& directory) {
+    if (!_filename.empty())
+        _output_filename = (directory.empty() ? "" : directory + "/") + _filename;
+}
+// Only the observables that add up over the m-blocks know how to merge,
+// the rest stay in the directories of the groups.
+void Observable::Merge(const std::vector<std::string>& directories) {
+    if (!_filename.empty())
+        LOG_WARN(_filename + " is not merged, it stays in the directory of every group.");
+}
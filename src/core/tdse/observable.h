@@ -13,7 +13,8 @@ protected:
     MathLib& _MathLib;                  // - shortcut
 
     int _compute_period_in_iterations;
-    std::string _output_filename;
+    std::string _filename;              // as given in the input file
+    std::string _output_filename;       // in the output directory of the run
 public:
     typedef std::shared_ptr<Observable> Ptr_t;
 
@@ -24,10 +25,13 @@ public:
 
     void SetComputePeriod(int iterations);
     void DoObservable(int it, double t, double dt);
+    void DoSample(int sample, double t, double dt);     // of the free evolution, passed to Compute as it = -sample
+    bool IsDue(int it) const;
     void SetFilename(const std::string& filename);
+    void SetDirectory(const std::string& directory);      // for the runs of a sweep
     
     virtual void Flush() {};
-    virtual int MemoryAlloced() const;
+    virtual void Merge(const std::vector<std::string>& directories);  // the groups' outputs into one file (m split)
     virtual void Startup(int it) = 0;
     virtual void Shutdown() = 0;
     virtual void Compute(int it, double t, double dt) = 0;
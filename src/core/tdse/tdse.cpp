@@ -2,12 +2,14 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
 #include <algorithm>
 #include <cmath>
 #include <complex>
 #include "utility/index_manip.h"
 #include "utility/logger.h"
 #include "utility/profiler.h"
+#include "utility/memory_tracker.h"
 #include "utility/file_exists.h"
 
 #include "math_libs/petsc/petsc_lib.h"
@@ -15,7 +17,9 @@
 using namespace std::complex_literals;
 
 
-TDSE::TDSE(MathLib& lib) : _MathLib(lib), _do_propagate(true), _restarting(false), _cylindricalSymmetry(true), _checkpoints(0) {
+TDSE::TDSE(MathLib& lib) : _MathLib(lib), _do_propagate(true), _restarting(false), _cylindricalSymmetry(true),
+    _free_evolution_time(0.), _free_evolution_samples(1), _adaptive(false), _adaptive_tol(1e-8), _dt_min(0.), _dt_max(0.),
+    _checkpoints(0), _m_split(false), _telemetry_period(0) {
     _pol[X] = _pol[Y] = _pol[Z] = false;
     _ecs_r0 = 0;
     _ecs_theta = 0;
@@ -25,7 +29,8 @@ void TDSE::SetupBasis(double xmin, double xmax,
                     int lmax, int mmax, 
                     double ecs_r0, double ecs_theta,
                     Basis::BSpline::Sequence seq,
-                    double seq_parameter) {
+                    double seq_parameter,
+                    double quadrature_tolerance, bool quadrature_check) {
     _xmin = xmin; _xmax = xmax;
 
     _order = order;
@@ -33,6 +38,7 @@ void TDSE::SetupBasis(double xmin, double xmax,
     _lmax = lmax;
     _mmax = mmax;
 
+    _basis.setQuadrature(quadrature_tolerance, quadrature_check);
     _basis.Initialize(_order, _nodes, 
                       _xmin, _xmax, 
                       seq, 
@@ -45,7 +51,11 @@ void TDSE::SetupBasis(double xmin, double xmax,
     // first check the cylindrical symmetry is broken.
     // - we *could* rotate any one axis to the z-axis to preserve symmetry
     // - this assumes the potential is at least cylindrically symmetric also
-    for (const auto& p : _pulses) {
+    // every run of a sweep uses the same matrices, so all of their lasers count
+    std::vector<Pulse::Ptr_t> pulses = _pulses;
+    for (auto& config : _sweep)
+        pulses.insert(pulses.end(), config.pulses.begin(), config.pulses.end());
+    for (const auto& p : pulses) {
         if (p->polarization_vector.x || p->minor_polarization_vector.x) _pol[X] = true;
         if (p->polarization_vector.y || p->minor_polarization_vector.y) _pol[Y] = true;
         if (p->polarization_vector.z || p->minor_polarization_vector.z) _pol[Z] = true;
@@ -68,6 +78,19 @@ void TDSE::SetupBasis(double xmin, double xmax,
         std::sort(_Ms.begin(), _Ms.end());
         _Ms.erase( std::unique(_Ms.begin(), _Ms.end() ), _Ms.end() );
 
+        // every group of ranks only keeps its own m's, the k-th goes to group k % groups
+        int group = _MathLib.Group(), groups = _MathLib.Groups();
+        if (_m_split && groups > 1) {
+            std::vector<int> Ms;
+            _m_split_dirs.assign(groups, "m");
+            for (int k = 0; k < _Ms.size(); k++) {
+                _m_split_dirs[k % groups] += "_" + std::to_string(_Ms[k]);
+                if (k % groups == group)
+                    Ms.push_back(_Ms[k]);
+            }
+            _Ms = Ms;
+        }
+
         // still each m-block is independent so each row of propagator
         // has 6*order - 3 elements
         _maxBands = 6*_order - 3;
@@ -150,11 +173,21 @@ const std::vector<Pulse::Ptr_t>& TDSE::Pulses() const {
 void TDSE::AddPulse(Pulse::Ptr_t p) {
     _pulses.push_back(p);
 }
-void TDSE::AddInitialState(int n, int l, int m, double phase,  double amplitude) {
-    _initial_state.emplace_back(state_descriptor{n, l, m, phase, amplitude});
+void TDSE::AddSweepConfiguration(const std::string& directory, const std::vector<Pulse::Ptr_t>& pulses, double dt) {
+    _sweep.emplace_back(sweep_config{directory, pulses, dt});
+}
+void TDSE::AddInitialState(int n, int l, int m, double phase,  double amplitude, int member) {
+    _initial_state.emplace_back(state_descriptor{n, l, m, phase, amplitude, member});
 }
-void TDSE::AddObservable(Observable::Ptr_t obs) {
+int TDSE::BatchSize() const {
+    int size = 1;
+    for (auto& state : _initial_state)
+        size = std::max(size, state.member+1);
+    return size;
+}
+void TDSE::AddObservable(Observable::Ptr_t obs, int member) {
     _observables.push_back(obs);
+    _observable_member.push_back(member);
 }
 void TDSE::AddPotential(Potential::Ptr_t pot) {
     _potentials.push_back(pot);
@@ -180,6 +213,12 @@ int TDSE::GetInitialStateLmax() const {
 void TDSE::SetRestart(bool flag) {
     _restarting = flag;
 }
+void TDSE::SetTelemetry(int period) {
+    _telemetry_period = period;
+}
+void TDSE::SetMSplit(bool flag) {
+    _m_split = flag;
+}
 void TDSE::SetDoPropagate(bool flag) {
     _do_propagate = flag;
 }
@@ -193,29 +232,99 @@ void TDSE::SetTimestep(double dt) {
 void TDSE::SetCheckpoints(int checkpoint) {
     _checkpoints = checkpoint;
 }
+void TDSE::SetFreeEvolution(double time, int samples) {
+    _free_evolution_time = time;
+    _free_evolution_samples = samples;
+}
+void TDSE::SetAdaptive(double tol, double dt_min, double dt_max) {
+    _adaptive = true;
+    _adaptive_tol = tol;
+    _dt_min = dt_min;
+    _dt_max = dt_max;
+}
 const std::vector<Potential::Ptr_t>& TDSE::Potentials() const {
     return _potentials;
 }
 
 void TDSE::Propagate() {
-    double t = 0;
-    int start_iteration = 0;
+    // with the m's split over the groups every group writes into a directory of its own
+    if (!_m_split_dirs.empty()) {
+        _output_dir = _m_split_dirs[_MathLib.Group()];
+        make_directory(_output_dir);
+        for (auto& obs : _observables)
+            obs->SetDirectory(_output_dir);
+    }
+
+    if (_sweep.empty())
+        Run();
+    else
+        Sweep();
+
+    // finish up
+    Finish();
+    _batch.clear();
 
-    // find total length of simulation by finding the latest nonzero pulse.
+    // the m-blocks do not couple, so their observables add up
+    if (!_m_split_dirs.empty() && _MathLib.JoinGroups()) {
+        LOG_INFO("Merging the observables of " + std::to_string(_m_split_dirs.size()) + " groups...");
+        for (auto& obs : _observables)
+            obs->Merge(_m_split_dirs);
+    }
+}
+// The matrices built by Initialize are kept, only what depends on the
+// time step is rebuilt when it changes. With several groups of ranks
+// (see "sweep_groups") every group has its own copy of the matrices and
+// takes every groups-th configuration.
+void TDSE::Sweep() {
+    bool restarting = _restarting;
+    int group = _MathLib.Group(), groups = _MathLib.Groups();
+
+    for (int k = group; k < _sweep.size(); k += groups) {
+        auto& config = _sweep[k];
+        LOG_INFO("Sweep configuration " + std::to_string(k+1) + "/" + std::to_string(_sweep.size())
+                + ": " + config.directory);
+        make_directory(config.directory);
+
+        _pulses = config.pulses;
+        _output_dir = config.directory;
+        _restarting = restarting;
+        for (auto& obs : _observables)
+            obs->SetDirectory(_output_dir);
+        _dt = config.dt;
+        Reinitialize();
+        Run();
+    }
+}
+// the run lasts until the end of the latest pulse
+void TDSE::SetupTimesteps() {
     _tmin = _tmax = 0; 
     for (auto& p : _pulses)
         _tmin = std::min(_tmin, p->delay);
     for (auto& p : _pulses)
         _tmax = std::max(_tmax, p->delay + p->duration);
     _NT =  (_tmax - _tmin)/ _dt + 1;
+}
+void TDSE::Run() {
+    MemoryOwner owner("wavefunction");
+    double t = 0;
+    std::string tdse_filename = (_output_dir.empty() ? "" : _output_dir + "/") + "TDSE.h5";
+    int start_iteration = 0;
+
+    SetupTimesteps();
 
-    _psi = _MathLib.CreateVector(_dof);
+    // all members share the matrices, each has its own wavefunction
+    _batch.clear();
+    for (int k = 0; k < BatchSize(); k++)
+        _batch.push_back(_MathLib.CreateVector(_dof));
+    _psi = _batch[0];
+    if (_batch.size() > 1)
+        LOG_INFO("Propagating a batch of " + std::to_string(_batch.size()) + " initial states.");
 
     // are we restarting?
     if (_restarting)
-        _restarting = file_exists("TDSE.h5");
+        _restarting = file_exists(tdse_filename);
     
-    _tdse_out = _MathLib.OpenHDF5("TDSE.h5", (_restarting ? 'a' : 'w'));
+    _tdse_out = _MathLib.OpenHDF5(tdse_filename, (_restarting ? 'a' : 'w'));
 
     if (_restarting) {
         if (!CompareTDSEH5wInput())
@@ -229,6 +338,15 @@ void TDSE::Propagate() {
         WriteInitialState();
     }
 
+    // what Estimate needs to fit its cost model to the telemetry of this run
+    if (_telemetry_period > 0) {
+        auto r = Resources();
+        _tdse_out->WriteAttribute("telemetry_ranks", _MathLib.Size());
+        _tdse_out->WriteAttribute("telemetry_dof", _dof);
+        _tdse_out->WriteAttribute("telemetry_work", r.work);
+        _tdse_out->WriteAttribute("telemetry_bytes", r.bytes);
+    }
+
 
     LOG_INFO("Beginning propagation...");
 
@@ -238,8 +356,15 @@ void TDSE::Propagate() {
     ComputeFields();
 
     // allow observables to initialize
-    for (auto& obs : _observables)
-        obs->Startup(start_iteration);
+    {
+        MemoryOwner owner("observables");
+        for (int i = 0; i < _observables.size(); i++) {
+            _psi = _batch[_observable_member[i]];
+            _observables[i]->Startup(start_iteration);
+        }
+    }
+    _psi = _batch[0];
+    Memory::Report("the start of propagation");
 
     if (!_do_propagate) {
         _tdse_out = nullptr;
@@ -248,24 +373,55 @@ void TDSE::Propagate() {
         for (auto& obs : _observables)
             obs->Shutdown();
         _tdse_out = nullptr;
-
-        Finish();
         return;
     }
 
+    // spans without field (delays, between and after pulses) get the cheaper field free step
+    int field_free = 0, spans = 0;
+    for (int it = start_iteration; it < _NT; it++) {
+        if (FieldIsZero(it)) {
+            field_free++;
+            if (it == start_iteration || !FieldIsZero(it-1))
+                spans++;
+        }
+    }
+    if (field_free > 0)
+        LOG_INFO(std::to_string(field_free) + " field free timesteps in " + std::to_string(spans) + " span(s).");
+
     // begin
     LOG_INFO("Propagation for " + std::to_string(_NT) + " timesteps...");
     Profile::Push("Total time stepping");
     
     // do simulation
-    for (int it = start_iteration; it < _NT; it++) {
-        t = it*_dt + _tmin;
-        if (!DoStep(it, t, _dt)) break;
-        DoCheckpoint(it);
-        DoObservables(it, t, _dt);
+    int it;
+    if (_adaptive) {
+        it = PropagateAdaptive(start_iteration);
+    } else {
+        Timer timer;
+        for (it = start_iteration; it < _NT; it++) {
+            t = it*_dt + _tmin;
+            _step_info = step_info{0, 0., 0, 0., 0., 0., _dof};
+            timer.Reset();
+            if (_batch.size() > 1) {
+                if (!DoBatchStep(it, t, _dt)) break;
+            } else if (FieldIsZero(it)) {
+                if (!DoFieldFreeStep(it, t, _dt)) break;
+            } else {
+                if (!DoStep(it, t, _dt)) break;
+            }
+            double step_time = timer.Elapsed();
+            DoCheckpoint(it);
+            DoObservables(it, t, _dt);
+            DoTelemetry(it, t, _dt, step_time, timer.Elapsed());
+        }
     }
     
     Profile::Pop("Total time stepping");
+    if (_telemetry_period > 0)
+        _tdse_out->WriteAttribute("telemetry_peak_bytes", Memory::LargestPeak());
+
+    if (it == _NT && _free_evolution_time > 0.)
+        FreeEvolution(_tmin + _NT*_dt, _free_evolution_time, _free_evolution_samples);
 
     WriteFinalState();
 
@@ -274,9 +430,159 @@ void TDSE::Propagate() {
     // allow observables to complete
     for (auto& obs : _observables)
         obs->Shutdown();
+}
+bool TDSE::FieldIsZero(int it) const {
+    for (int xn = X; xn <= Z; xn++)
+        if (!_field[xn].empty() && _field[xn][it] != 0.)
+            return false;
+    return true;
+}
+bool TDSE::DoFieldFreeStep(int it, double t, double dt) {
+    return DoStep(it, t, dt);
+}
+// Propagators without products and solves for several vectors step the members one by one
+bool TDSE::DoBatchStep(int it, double t, double dt) {
+    bool success = true;
+    for (auto& psi : _batch) {
+        _psi = psi;
+        if (!(FieldIsZero(it) ? DoFieldFreeStep(it, t, dt) : DoStep(it, t, dt))) {
+            success = false;
+            break;
+        }
+    }
+    _psi = _batch[0];
+    return success;
+}
+bool TDSE::FreeEvolution(double t, double time, int samples) {
+    ProfilerPush();
+    MemoryOwner owner("wavefunction");
+
+    // exact exp(-i S^-1 H0 time) from the eigenpairs of every (l,m)-block
+    LOG_INFO("Diagonalizing the field free Hamiltonian...");
+    Matrix H0 = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+    Matrix S = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+    FillFieldFree(H0);
+    FillOverlap(S);
+    auto spectral = _MathLib.CreateBlockSpectralPropagator(H0, S, _N);
+    H0 = nullptr;
+    S = nullptr;
+
+    LOG_INFO("Free evolution for " + std::to_string(time) + " a.u. in " + std::to_string(samples) + " sample(s)...");
+    double dt = time/samples;
+    for (int member = 0; member < _batch.size(); member++) {
+        _psi = _batch[member];
+        spectral->SetState(_psi);
+        for (int k = 1; k <= samples; k++) {
+            spectral->Evolve(k*dt, _psi);
+            for (int i = 0; i < _observables.size(); i++)
+                if (_observable_member[i] == member)
+                    _observables[i]->DoSample(k, t + k*dt, dt);
+        }
+    }
+    _psi = _batch[0];
 
-    // finish up
-    Finish();
+    ProfilerPop();
+    return true;
+}
+void TDSE::Reinitialize() {
+    // nothing depends on the time step or on the last run
+}
+bool TDSE::DoStepAt(double t, double dt) {
+    LOG_CRITICAL("This propagator does not support adaptive time steps.");
+    return false;
+}
+int TDSE::StepOrder() const {
+    return 2;
+}
+// Step doubling: one step of h and two of h/2 from the same psi, the
+// difference is (2^p - 1) times the error of the two half steps (which
+// are kept). The steps always land on the iterations where an observable
+// or a checkpoint is due, or the last one. psi there is the state of the
+// fixed step loop, so the output and restarts are the same, only the
+// iterations without output are skipped.
+int TDSE::PropagateAdaptive(int start_iteration) {
+    MemoryOwner owner("wavefunction");
+    Vector psi0 = _MathLib.CreateVector(_dof);
+    Vector psi1 = _MathLib.CreateVector(_dof);
+    double dt_min = (_dt_min > 0. ? _dt_min : 1e-3*_dt);
+    double dt_max = (_dt_max > 0. ? _dt_max : _NT*_dt);
+    double h = std::min(std::max(_dt, dt_min), dt_max);
+    double smallest = dt_max, largest = 0.;
+    int p = StepOrder(), accepted = 0, rejected = 0, forced = 0;
+
+    auto output = [&](int it) {
+        if (it == _NT-1 || ((_checkpoints != 0) && (it % _checkpoints == 0)))
+            return true;
+        for (auto& obs : _observables)
+            if (obs->IsDue(it))
+                return true;
+        return false;
+    };
+
+    LOG_INFO("Adaptive time steps, tolerance " + std::to_string(_adaptive_tol) + " per step.");
+    Timer timer;
+    int it = start_iteration;
+    double t = _tmin + it*_dt;                              // psi is at the start of iteration it
+    while (it < _NT) {
+        int next = it;
+        while (!output(next))
+            next++;
+        double t_next = _tmin + (next+1)*_dt;              // psi at the end of iteration next
+
+        while (t_next - t > 1e-12*_dt) {
+            double step = std::min(h, t_next - t);
+            int attempt = accepted + rejected;
+            _step_info = step_info{0, 0., 0, 0., 0., 0., _dof};
+            timer.Reset();
+
+            psi0->Copy(_psi);
+            if (!DoStepAt(t, step))
+                return it;
+            psi1->Copy(_psi);
+            _psi->Copy(psi0);
+            if (!DoStepAt(t, 0.5*step) || !DoStepAt(t + 0.5*step, 0.5*step))
+                return it;
+
+            complex norm;
+            _MathLib.AXPY(psi1, -1., _psi);
+            _MathLib.Dot(psi1, psi1, norm);
+            double err = std::sqrt(norm.real())/(std::pow(2., p) - 1.);
+            double factor = (err > 0. ? 0.9*std::pow(_adaptive_tol/err, 1./(p+1)) : 2.);
+            factor = std::min(2., std::max(0.2, factor));
+            bool accept = (err <= _adaptive_tol || step <= dt_min);
+            DoTelemetry(attempt, t, step, timer.Elapsed(), err, accept);
+
+            if (accept) {
+                if (err > _adaptive_tol)
+                    forced++;
+                t += step;
+                accepted++;
+                smallest = std::min(smallest, step);
+                largest = std::max(largest, step);
+                // a step cut short to land on an output does not shrink the next one
+                double proposed = std::min(std::max(step*factor, dt_min), dt_max);
+                h = (step < h ? std::max(h, proposed) : proposed);
+            } else {
+                _psi->Copy(psi0);
+                rejected++;
+                h = std::max(step*factor, dt_min);
+            }
+        }
+        t = t_next;
+
+        if ((_checkpoints != 0) && (next % _checkpoints == 0))
+            LOG_INFO("Adaptive steps: " + std::to_string(accepted) + " accepted, " + std::to_string(rejected)
+                    + " rejected, current dt " + std::to_string(h));
+        DoCheckpoint(next);
+        DoObservables(next, _tmin + next*_dt, _dt);
+        it = next+1;
+    }
+
+    LOG_INFO("Adaptive steps: " + std::to_string(accepted) + " accepted, " + std::to_string(rejected)
+            + " rejected (3 propagator steps each), dt from " + std::to_string(smallest) + " to " + std::to_string(largest) + ".");
+    if (forced > 0)
+        LOG_WARN(std::to_string(forced) + " steps at the minimum dt did not reach the tolerance.");
+    return it;
 }
 void TDSE::DoCheckpoint(int it) {
     if ((_checkpoints != 0) && (it % _checkpoints == 0)) {
@@ -286,7 +592,8 @@ void TDSE::DoCheckpoint(int it) {
 
         // dump psi to file
         _tdse_out->PushGroup("checkpoints");
-        _tdse_out->WriteVector(std::to_string(it), _psi);
+        for (int k = 0; k < _batch.size(); k++)
+            _tdse_out->WriteVector(MemberName(std::to_string(it), k), _batch[k]);
         _tdse_out->PopGroup();
 
         // write last checkpoint iteration
@@ -296,46 +603,174 @@ void TDSE::DoCheckpoint(int it) {
     }
 }
 void TDSE::DoObservables(int it, double t, double dt) {
-    for (auto& obs : _observables)
-        obs->DoObservable(it, t, dt);
+    for (int i = 0; i < _observables.size(); i++) {
+        _psi = _batch[_observable_member[i]];
+        _observables[i]->DoObservable(it, t, dt);
+    }
+    _psi = _batch[0];
+}
+// One row of the "telemetry" dataset in TDSE.h5 every _telemetry_period steps:
+// t, dt, iterations, residual, converged reason, the wall time of the step,
+// of its matrix update, U- psi and solve, of the checkpoint and observables,
+// the field in x, y, z and the rows propagated (the active range). The rows are numbered by iteration, so a
+// restart overwrites what comes after its checkpoint.
+void TDSE::DoTelemetry(int it, double t, double dt, double step_time, double observables_time) {
+    if (_telemetry_period == 0 || it % _telemetry_period != 0)
+        return;
+
+    std::vector<double> row = {t, dt, double(_step_info.iterations), _step_info.residual, double(_step_info.reason),
+                               step_time, _step_info.update, _step_info.mult, _step_info.solve, observables_time};
+    for (int xn = X; xn <= Z; xn++)
+        row.push_back(_field[xn].empty() ? 0. : _field[xn][it]);
+    row.push_back(_step_info.rows);
+    _tdse_out->WriteRecord("telemetry", row, it/_telemetry_period);
+}
+// Every attempt of the adaptive steps (the step and its two halves) to
+// "telemetry_adaptive", numbered by attempt, with its error estimate and
+// whether it was accepted. The propagator's split is summed over the three.
+void TDSE::DoTelemetry(int attempt, double t, double dt, double step_time, double error, bool accepted) {
+    if (_telemetry_period == 0 || attempt % _telemetry_period != 0)
+        return;
+
+    Vec3 field = FieldAt(t);
+    std::vector<double> row = {t, dt, double(_step_info.iterations), _step_info.residual, double(_step_info.reason),
+                               step_time, _step_info.update, _step_info.mult, _step_info.solve, 0.,
+                               field.x, field.y, field.z, double(_step_info.rows), error, accepted ? 1. : 0.};
+    _tdse_out->WriteRecord("telemetry_adaptive", row, attempt/_telemetry_period);
+}
+
+TDSE::resources TDSE::Resources() const {
+    resources r{0., 0., 0.};
+    double interaction = 0.;                    // nonzeros per row
+    if (_pol[X]) interaction += 8*_order-4;
+    if (_pol[Y]) interaction += 8*_order-4;
+    if (_pol[Z]) interaction += 4*_order-2;
+
+    r.AddMatrix(2.*(2*_order-1)*_dof);          // H0 and S
+    r.AddMatrix(interaction*_dof);
+    r.AddVectors(BatchSize(), _dof);            // the wavefunctions
+    r.work = (2*_order-1 + interaction)*_dof;
+    return r;
+}
+
+// The cost model: a step takes a + b*w seconds, with w the nonzeros applied
+// per rank, work*(1 + iterations)/ranks. a and b are fitted to the telemetry
+// rows of earlier runs (written with "telemetry"), the memory is scaled by
+// the ratio of their measured peak to their estimate.
+void TDSE::Estimate(int ranks, const std::vector<std::string>& calibration) {
+    const double GB = 1024.*1024.*1024.;
+    SetupTimesteps();
+    resources r = Resources();
+
+    std::vector<double> work, step_time, other_time, iterations;
+    double memory_scale = 0.;
+    int memory_runs = 0;
+    for (auto& filename : calibration) {
+        if (!file_exists(filename)) {
+            LOG_WARN("Calibration file " + filename + " not found.");
+            continue;
+        }
+        auto file = _MathLib.OpenHDF5(filename, 'r');
+        if (!file->HasAttribute("telemetry_work")) {
+            LOG_WARN(filename + " has no telemetry, it is skipped.");
+            continue;
+        }
+        int run_ranks, run_dof;
+        double run_work, run_bytes, run_peak;
+        file->ReadAttribute("telemetry_ranks", &run_ranks);
+        file->ReadAttribute("telemetry_dof", &run_dof);
+        file->ReadAttribute("telemetry_work", &run_work);
+        file->ReadAttribute("telemetry_bytes", &run_bytes);
+        if (file->HasAttribute("telemetry_peak_bytes")) {
+            file->ReadAttribute("telemetry_peak_bytes", &run_peak);
+            memory_scale += run_peak*run_ranks/run_bytes;
+            memory_runs++;
+        }
+
+        std::vector<std::vector<double>> rows;
+        file->ReadRecords("telemetry", rows);
+        for (auto& row : rows) {
+            if (row.size() < 14) continue;
+            work.push_back(run_work*(row[13]/run_dof)*(1. + row[2])/run_ranks);
+            iterations.push_back(row[2]);
+            step_time.push_back(row[5]);
+            other_time.push_back(row[9]);
+        }
+        LOG_INFO("Calibration: " + filename + ", " + std::to_string(rows.size()) + " telemetry rows.");
+    }
+
+    std::stringstream ss;
+    ss << "Estimate for " << ranks << " rank(s): " << _dof << " degrees of freedom, " << _maxBands << " bands, "
+       << r.nnz << " matrix nonzeros, " << r.work << " applied per product.";
+    LOG_INFO(ss.str());
+
+    double memory = r.bytes/ranks*(memory_runs > 0 ? memory_scale/memory_runs : 1.);
+    ss.str("");
+    ss << "estimate ranks=" << ranks << " dof=" << _dof << " max_bands=" << _maxBands << " nnz=" << r.nnz
+       << " timesteps=" << _NT << " memory_per_rank_gb=" << memory/GB;
+
+    int n = work.size();
+    if (n > 0) {
+        double mean_work = 0., mean_time = 0., mean_other = 0., mean_iterations = 0.;
+        for (int k = 0; k < n; k++) {
+            mean_work += work[k]/n;
+            mean_time += step_time[k]/n;
+            mean_other += other_time[k]/n;
+            mean_iterations += iterations[k]/n;
+        }
+        double var = 0., cov = 0.;
+        for (int k = 0; k < n; k++) {
+            var += (work[k] - mean_work)*(work[k] - mean_work);
+            cov += (work[k] - mean_work)*(step_time[k] - mean_time);
+        }
+        // a single problem size only gives the slope through the origin
+        double a = 0., b = mean_time/mean_work;
+        if (var > 1.e-6*mean_work*mean_work*n && cov > 0.) {
+            b = cov/var;
+            a = mean_time - b*mean_work;
+        }
+        double step = a + b*r.work*(1. + mean_iterations)/ranks;
+        ss << " seconds_per_step=" << step << " walltime_seconds=" << _NT*(step + mean_other);
+        LOG_INFO("Cost model: " + std::to_string(a) + " s + " + std::to_string(b*1.e9) + " ns per applied nonzero per rank, "
+                + std::to_string(mean_iterations) + " iterations per step, all rows propagated.");
+    } else {
+        LOG_WARN("No telemetry to calibrate from, the run time is not estimated.");
+    }
+    _MathLib.ParallelPrintf(ss.str() + "\n");
 }
 
+Vec3 TDSE::FieldAt(double t) const {
+    Vec3 field{0., 0., 0.};
+    for (auto& p : _pulses)
+        field = field + p->A(t);
+    return field;
+}
 void TDSE::ComputeFields() {
-    for (auto& p : _pulses) {
-        if (p->polarization_vector.x != 0. || p->minor_polarization_vector.x != 0.)
-            _field[X].resize(_NT);
-        if (p->polarization_vector.y != 0. || p->minor_polarization_vector.y != 0.)
-            _field[Y].resize(_NT);
-        if (p->polarization_vector.z != 0. || p->minor_polarization_vector.z != 0.)
-            _field[Z].resize(_NT);
-    }
+    // every polarized direction gets a field, zero if the lasers of this run do not use it
+    for (int xn = X; xn <= Z; xn++)
+        _field[xn].assign(_pol[xn] ? _NT : 0, 0.);
 
     // if (_field[X].size() > 0 || _field[Y].size() > 0) {
     //     LOG_CRITICAL("DOING 3D calculation");
     //     exit(-1);
     // }
 
-    if (_field[X].size() > 0) {
-        for (int it = 0; it < _NT; it++) {
-            for (auto& p : _pulses)
-                _field[X][it] += (*p)(it*_dt).x;
-        }
-    }
-    if (_field[Y].size() > 0) {
-        for (int it = 0; it < _NT; it++)
-            for (auto& p : _pulses)
-                _field[Y][it] += (*p)(it*_dt).y;
-    }
-    if (_field[Z].size() > 0) {
-        for (int it = 0; it < _NT; it++)
-            for (auto& p : _pulses)
-                _field[Z][it] += (*p)(it*_dt).z;
+    // at the same absolute times as FieldAt between the steps, the run starts at _tmin
+    for (int it = 0; it < _NT; it++) {
+        Vec3 field = FieldAt(_tmin + it*_dt);
+        if (_field[X].size() > 0)
+            _field[X][it] = field.x;
+        if (_field[Y].size() > 0)
+            _field[Y][it] = field.y;
+        if (_field[Z].size() > 0)
+            _field[Z][it] = field.z;
     }
 }
 
 
 
 void TDSE::LoadInitialState() {
+    MemoryOwner owner("wavefunction");
     LOG_INFO("Loading initial state...");
     if (!file_exists(_initial_state_filename)) {
         LOG_CRITICAL("eigenstate file does not exists: " + _initial_state_filename);
@@ -344,35 +779,44 @@ void TDSE::LoadInitialState() {
 
     Vector temp = _MathLib.CreateVector(_N);        // vector from hdf5 file
     std::vector<Vector> vecs(_dof/_N);             // these will all be concatenated
-    for (auto& v : vecs) {
+    for (auto& v : vecs)
         v = _MathLib.CreateVector(_N); 
-        v->Zero();
-    }
     auto hdf5 = _MathLib.OpenHDF5(_initial_state_filename, 'r');
     hdf5->PushGroup("vectors");
 
-    // compute norm from amplitudes
-    double norm = 0;
-    for (auto& state : _initial_state)
-        norm += state.amplitude*state.amplitude;
-
-    // merge the initial eigenstates into 'vecs'
-    std::stringstream name_ss;
-    for (auto& state : _initial_state) {
-        name_ss.str("");                                         // clear string stream
-        name_ss << "(" << state.n << ", " << state.l << ")";     // name of state
-
-        int mBlock = RowFrom(state.m, _Ms, _mRows)/_N;
-        int lBlock = mBlock + (state.l-std::abs(state.m));
-        hdf5->ReadVector(name_ss.str().c_str(), temp);                  // read in the state
-        temp->Scale(state.amplitude*std::exp(1.i*state.phase));         // scale by amplitude and phase
-        _MathLib.AXPY(vecs[lBlock], 1., temp);                          // sum with other similar l's
+    // every member of the batch is its own superposition
+    for (int member = 0; member < _batch.size(); member++) {
+        for (auto& v : vecs)
+            v->Zero();
+
+        // compute norm from amplitudes (of every m, also those of the other groups)
+        double norm = 0;
+        for (auto& state : _initial_state)
+            if (state.member == member)
+                norm += state.amplitude*state.amplitude;
+
+        // merge the initial eigenstates into 'vecs'
+        std::stringstream name_ss;
+        for (auto& state : _initial_state) {
+            if (state.member != member)
+                continue;
+            if (std::find(_Ms.begin(), _Ms.end(), state.m) == _Ms.end())
+                continue;                                            // m of another group
+            name_ss.str("");                                         // clear string stream
+            name_ss << "(" << state.n << ", " << state.l << ")";     // name of state
+
+            int mBlock = RowFrom(state.m, _Ms, _mRows)/_N;
+            int lBlock = mBlock + (state.l-std::abs(state.m));
+            hdf5->ReadVector(name_ss.str().c_str(), temp);                  // read in the state
+            temp->Scale(state.amplitude*std::exp(1.i*state.phase));         // scale by amplitude and phase
+            _MathLib.AXPY(vecs[lBlock], 1., temp);                          // sum with other similar l's
+        }
+
+        // concatenate into the member's psi
+        _batch[member]->Concatenate(vecs);              // append all the initial vectors together
+        _batch[member]->Scale(1./sqrt(norm));           // and normalize
     }
     hdf5->PopGroup();
-
-    // concatenate into "_psi"
-    _psi->Concatenate(vecs);                        // append all the initial vectors together
-    _psi->Scale(1./sqrt(norm));                     // and normalize
 }
 bool TDSE::LoadLastCheckpoint(int& start_iteration) {
     int it;
@@ -389,20 +833,28 @@ bool TDSE::LoadLastCheckpoint(int& start_iteration) {
     start_iteration = it;
     // load that checkpoint
     _tdse_out->PushGroup("checkpoints");
-    _tdse_out->ReadVector(std::to_string(start_iteration), _psi);
+    for (int k = 0; k < _batch.size(); k++)
+        _tdse_out->ReadVector(MemberName(std::to_string(start_iteration), k), _batch[k]);
     _tdse_out->PopGroup();
 
     return true;
 }
+std::string TDSE::MemberName(const std::string& name, int member) const {
+    if (_batch.size() > 1)
+        return name + "_" + std::to_string(member);
+    return name;                                // a single state keeps the names of old files
+}
 
 void TDSE::WriteInitialState() const {
     _tdse_out->PushGroup("initial_state");
-    _tdse_out->WriteVector("wavefunction", _psi);
+    for (int k = 0; k < _batch.size(); k++)
+        _tdse_out->WriteVector(MemberName("wavefunction", k), _batch[k]);
     _tdse_out->PopGroup();
 }
 void TDSE::WriteFinalState() const {
     _tdse_out->PushGroup("final_state");
-    _tdse_out->WriteVector("wavefunction", _psi);
+    for (int k = 0; k < _batch.size(); k++)
+        _tdse_out->WriteVector(MemberName("wavefunction", k), _batch[k]);
     _tdse_out->PopGroup();
 }
 
@@ -12,6 +12,13 @@ protected:
     struct state_descriptor {
         int n, l, m;
         double phase, amplitude;
+        int member;                             // of the batch
+    };
+    // one run of a sweep: the lasers and time step that differ from the other runs
+    struct sweep_config {
+        std::string directory;                  // for TDSE.h5 and the observables
+        std::vector<Pulse::Ptr_t> pulses;
+        double dt;
     };
 
     // math library
@@ -36,6 +43,10 @@ protected:
     // the time domain
     double _dt, _tmin, _tmax;
     int _NT;
+    double _free_evolution_time;                // field free evolution after the last step
+    int _free_evolution_samples;
+    bool _adaptive;                             // variable steps between the iterations with output
+    double _adaptive_tol, _dt_min, _dt_max;
 
     // physical quantities
     bool _pol[DimIndex::NUM];                   // quick access if there is/is not polarization in x,y,z
@@ -43,7 +54,8 @@ protected:
     std::vector<Pulse::Ptr_t> _pulses;
     std::vector<Potential::Ptr_t> _potentials;
     std::vector<state_descriptor> _initial_state;
-    Vector _psi;
+    Vector _psi;                                // the state being stepped or observed, one of _batch
+    std::vector<Vector> _batch;                 // one wavefunction per initial state, propagated together
 
     // where to load initial state from
     std::string _initial_state_filename;
@@ -51,11 +63,50 @@ protected:
 
     // a list of observables specified in the input file.
     std::vector<Observable::Ptr_t> _observables;
+    std::vector<int> _observable_member;        // the batch member each observable looks at
     int _checkpoints;
 
+    // runs that share the basis, the potentials and the field free and interaction matrices
+    std::vector<sweep_config> _sweep;
+    std::string _output_dir;                    // of the current run, empty for the working directory
+
+    // independent m-blocks propagated by separate groups of ranks
+    bool _m_split;
+    std::vector<std::string> _m_split_dirs;     // output of each group, merged at the end
+
     // TDSE simulation output file
     bool _restarting, _do_propagate;
     HDF5 _tdse_out;
+
+    // what the propagator did in the last step, for the telemetry
+    struct step_info {
+        int iterations;                         // of the iterative solver, 0 for direct solves
+        double residual;
+        int reason;                             // KSPConvergedReason, 0 for direct solves
+        double update, mult, solve;             // wall time [s] of U+/- for the field, U- psi and the solve
+        int rows;                               // propagated (the active range), _dof when all are
+    };
+    step_info _step_info;
+    int _telemetry_period;                      // steps between the rows of "telemetry" in TDSE.h5, 0 for none
+
+    // what the matrices and vectors of a run take, from the options alone
+    struct resources {
+        double nnz;                             // stored in the matrices
+        double bytes;                           // of the matrices and the vectors
+        double work;                            // nonzeros applied in one product with the propagator
+
+        void AddMatrix(double nonzeros) {
+            nnz += nonzeros;
+            bytes += nonzeros*(sizeof(complex) + sizeof(int));
+        }
+        void AddVectors(double count, int length) {
+            bytes += count*length*sizeof(complex);
+        }
+    };
+
+    void Run();                                 // one propagation with _pulses and _dt
+    void SetupTimesteps();                      // _tmin, _tmax and _NT from the pulses
+    void Sweep();                               // Run for each configuration of this rank's group
 public:
     typedef std::shared_ptr<TDSE> Ptr_t;
 
@@ -65,14 +116,21 @@ public:
                     int lmax, int mmax, 
                     double ecs_r0, double ecs_theta,
                     Basis::BSpline::Sequence seq,
-                    double seq_parameter);
+                    double seq_parameter,
+                    double quadrature_tolerance, bool quadrature_check);
     void Propagate();
+    void Estimate(int ranks, const std::vector<std::string>& calibration);     // memory and run time, without allocating anything
     void AddPulse(Pulse::Ptr_t p);
+    void AddSweepConfiguration(const std::string& directory, const std::vector<Pulse::Ptr_t>& pulses, double dt);
     void AddPotential(Potential::Ptr_t pot);
-    void AddObservable(Observable::Ptr_t obs);
+    void AddObservable(Observable::Ptr_t obs, int member = 0);
     void SetTimestep(double dt);
     void SetCheckpoints(int checkpoint);
+    void SetTelemetry(int period);
+    void SetFreeEvolution(double time, int samples);
+    void SetAdaptive(double tol, double dt_min, double dt_max);       // dt_min/max <= 0: derived from the time step
     void SetRestart(bool flag);
+    void SetMSplit(bool flag);                  // one group of ranks per m (see MathLib::Startup)
     void SetDoPropagate(bool flag);
     void SetECS(double ecs_r0, double ecs_theta);
     void SetInitialStateFile(const std::string& filename);
@@ -82,7 +140,8 @@ public:
     int GetInitialStateNmax() const;
     int GetInitialStateLmax() const;
 
-    void AddInitialState(int n, int l, int m, double phase, double amplitude);
+    void AddInitialState(int n, int l, int m, double phase, double amplitude, int member = 0);
+    int BatchSize() const;
 
     const Vector Psi() const;
     MathLib& MathLibrary();
@@ -105,8 +164,13 @@ public:
     const std::vector<Pulse::Ptr_t>& Pulses() const;
 
 
+    bool FieldIsZero(int it) const;
+    Vec3 FieldAt(double t) const;               // between the time steps too, _field only holds the steps
     void DoCheckpoint(int it);
     void DoObservables(int it, double t, double dt);
+    void DoTelemetry(int it, double t, double dt, double step_time, double observables_time);
+    void DoTelemetry(int attempt, double t, double dt, double step_time, double error, bool accepted);     // of an adaptive step
+    int PropagateAdaptive(int start_iteration);
     void ComputeFields();
     bool CompareTDSEH5wInput() const;
     void WriteParametersToTDSE() const;
@@ -114,8 +178,23 @@ public:
     void WriteFinalState() const;
     void LoadInitialState();
     bool LoadLastCheckpoint(int &it);
+    std::string MemberName(const std::string& name, int member) const;     // name of the member's datasets in TDSE.h5
+
+    // matrices of the field free Hamiltonian, the overlap and the interaction (velocity gauge)
+    void FillFieldFree(Matrix& m);
+    void FillOverlap(Matrix& m);
+    void FillInteractionX(Matrix& m);
+    void FillInteractionY(Matrix& m);
+    void FillInteractionZ(Matrix& m);
 
     virtual void Initialize() = 0;
+    virtual resources Resources() const;                            // H0, S, the interaction and the wavefunctions
     virtual bool DoStep(int it, double t, double dt) = 0;
+    virtual bool DoFieldFreeStep(int it, double t, double dt);     // called instead of DoStep while the field is zero
+    virtual bool DoBatchStep(int it, double t, double dt);         // every member of the batch, called instead of the two above
+    virtual bool FreeEvolution(double t, double time, int samples); // from t to t+time without field, observables at the samples
+    virtual void Reinitialize();                                    // before each run of a sweep, rebuild what depends on the time step
+    virtual bool DoStepAt(double t, double dt);                     // a step of any length, the field from FieldAt
+    virtual int StepOrder() const;                                  // of DoStepAt, for the step size control
     virtual void Finish() = 0;
 };
\ No newline at end of file
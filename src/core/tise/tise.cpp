@@ -7,12 +7,14 @@ void TISE::SetupBasis(double xmin, double xmax,
                     int order, int nodes,
                     double ecs_r0, double ecs_theta,
                     Basis::BSpline::Sequence seq,
-                    double seq_parameter) {
+                    double seq_parameter,
+                    double quadrature_tolerance, bool quadrature_check) {
     _xmin = xmin; _xmax = xmax;
 
     _order = order;
     _nodes = nodes;
 
+    _basis.setQuadrature(quadrature_tolerance, quadrature_check);
     _basis.Initialize(_order, _nodes, 
                       _xmin, _xmax, 
                       seq, 
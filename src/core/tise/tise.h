@@ -30,7 +30,8 @@ public:
                     int order, int nodes,
                     double ecs_r0, double ecs_theta,
                     Basis::BSpline::Sequence seq,
-                    double seq_parameter);
+                    double seq_parameter,
+                    double quadrature_tolerance, bool quadrature_check);
     virtual void Solve() = 0;
 
     void AddPotential(Potential::Ptr_t pot);
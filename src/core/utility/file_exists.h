@@ -3,8 +3,15 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cerrno>
+#include <sys/stat.h>
 
 inline bool file_exists(const std::string& name) {
     std::ifstream f(name.c_str());
     return f.good();
 }
+
+// creates one level, an existing directory is fine
+inline bool make_directory(const std::string& name) {
+    return mkdir(name.c_str(), 0755) == 0 || errno == EEXIST;
+}
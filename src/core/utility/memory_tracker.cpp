@@ -0,0 +1,111 @@
+#include "utility/memory_tracker.h"
+#include "utility/logger.h"
+#include <map>
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+
+static MemoryTracker::Ptr_t s_tracker(new MemoryTracker());
+static std::unordered_map<int, MemoryTracker::Allocation> s_allocations;
+static std::vector<std::string> s_owners;
+static int s_next_id = 0;
+static double s_current = 0., s_peak = 0.;
+
+
+int MemoryTracker::Register(const std::string& kind, long rows, long preallocated, double bytes) {
+    std::string owner = (s_owners.empty() ? "other" : s_owners.back());
+    s_allocations[s_next_id] = Allocation{owner, kind, 1, rows, preallocated, preallocated, bytes};
+    s_current += bytes;
+    s_peak = std::max(s_peak, s_current);
+    return s_next_id++;
+}
+void MemoryTracker::Update(int id, long nnz, double bytes) {
+    auto a = s_allocations.find(id);
+    if (a == s_allocations.end()) return;
+
+    s_current += bytes - a->second.bytes;
+    s_peak = std::max(s_peak, s_current);
+    a->second.nnz = nnz;
+    a->second.bytes = bytes;
+}
+void MemoryTracker::Release(int id) {
+    auto a = s_allocations.find(id);
+    if (a == s_allocations.end()) return;
+
+    s_current -= a->second.bytes;
+    s_allocations.erase(a);
+}
+
+double MemoryTracker::Current() const {
+    return s_current;
+}
+double MemoryTracker::Peak() const {
+    return s_peak;
+}
+std::vector<MemoryTracker::Allocation> MemoryTracker::Breakdown() const {
+    std::map<std::pair<std::string, std::string>, Allocation> sums;
+    for (auto& a : s_allocations) {
+        auto key = std::make_pair(a.second.owner, a.second.kind);
+        auto sum = sums.find(key);
+        if (sum == sums.end()) {
+            sums[key] = a.second;
+        } else {
+            sum->second.count++;
+            sum->second.rows += a.second.rows;
+            sum->second.preallocated += a.second.preallocated;
+            sum->second.nnz += a.second.nnz;
+            sum->second.bytes += a.second.bytes;
+        }
+    }
+    std::vector<Allocation> breakdown;
+    for (auto& sum : sums)
+        breakdown.push_back(sum.second);
+    return breakdown;
+}
+
+void MemoryTracker::Report(const std::string& when) {
+    const double GB = 1024.*1024.*1024.;
+    std::ostringstream ss;
+    ss << "Memory at " << when << ": " << Current()/GB << " GB tracked, peak " << Peak()/GB << " GB" << std::endl;
+    ss      << std::left << std::setw(24) << "  owner" << std::setw(10) << "kind" << std::right
+            << std::setw(8) << "count" << std::setw(12) << "rows"
+            << std::setw(14) << "preallocated" << std::setw(14) << "nnz" << std::setw(12) << "GB" << std::endl;
+    for (auto& a : Breakdown())
+        ss  << std::left << std::setw(24) << "  " + a.owner << std::setw(10) << a.kind << std::right
+            << std::setw(8) << a.count << std::setw(12) << a.rows
+            << std::setw(14) << a.preallocated << std::setw(14) << a.nnz << std::setw(12) << a.bytes/GB << std::endl;
+    LOG_INFO(ss.str());
+}
+double MemoryTracker::LargestPeak() {
+    return Peak();
+}
+
+
+MemoryOwner::MemoryOwner(const std::string& owner) {
+    s_owners.push_back(owner);
+}
+MemoryOwner::~MemoryOwner() {
+    s_owners.pop_back();
+}
+
+
+int Memory::Register(const std::string& kind, long rows, long preallocated, double bytes) {
+    return s_tracker->Register(kind, rows, preallocated, bytes);
+}
+void Memory::Update(int id, long nnz, double bytes) {
+    s_tracker->Update(id, nnz, bytes);
+}
+void Memory::Release(int id) {
+    s_tracker->Release(id);
+}
+void Memory::Report(const std::string& when) {
+    s_tracker->Report(when);
+}
+double Memory::LargestPeak() {
+    return s_tracker->LargestPeak();
+}
+void Memory::SetTracker(MemoryTracker* tracker) {
+    s_tracker.reset(tracker);
+}
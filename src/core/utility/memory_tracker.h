@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+
+
+// Bookkeeping of the large allocations made through MathLib (vectors,
+// matrices, solvers) on this rank. Every allocation is tagged with the
+// innermost MemoryOwner alive when it was made.
+class MemoryTracker {
+public:
+    typedef std::shared_ptr<MemoryTracker> Ptr_t;
+
+    struct Allocation {
+        std::string owner, kind;
+        int count;                              // of allocations summed up in a breakdown
+        long rows;                              // local
+        long preallocated, nnz;                 // local nonzeros (after assembly), 0 for vectors
+        double bytes;
+    };
+
+    virtual ~MemoryTracker() {}
+
+    int Register(const std::string& kind, long rows, long preallocated, double bytes);  // the id of the allocation
+    void Update(int id, long nnz, double bytes);    // after assembly or setup
+    void Release(int id);
+
+    virtual void Report(const std::string& when);   // the breakdown to the log
+    virtual double LargestPeak();               // [bytes] the peak of the rank with the most
+
+protected:
+    double Current() const;                     // [bytes] tracked now
+    double Peak() const;                        // [bytes] most tracked at any time
+    std::vector<Allocation> Breakdown() const;  // the live allocations summed by owner and kind, sorted
+};
+
+// Tags the allocations made while it is alive (the innermost one wins)
+class MemoryOwner {
+public:
+    MemoryOwner(const std::string& owner);
+    ~MemoryOwner();
+};
+
+
+
+
+namespace Memory {
+    int Register(const std::string& kind, long rows, long preallocated, double bytes);
+    void Update(int id, long nnz, double bytes);
+    void Release(int id);
+    void Report(const std::string& when);
+    double LargestPeak();
+
+    void SetTracker(MemoryTracker* tracker);
+};
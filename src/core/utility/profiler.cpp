@@ -1,78 +1,207 @@
-
 #include "utility/profiler.h"
+#include "utility/logger.h"
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include <algorithm>
+#include <chrono>
+#include <functional>
 
 
-struct ProfileObject {
-    std::string name;
-    double cumulative_time;
+struct ProfileFrame {                           // an open scope
+    std::string name, path;
+    double start;                               // [us] since the epoch
+    double children;                            // [us] spent in the scopes nested in this one
+};
+struct ProfileNode {
     int calls;
-    Timer timer;
+    double time, self;                          // [s]
 };
 
 static Profiler::Ptr_t s_profiler(new Profiler());
-static std::unordered_map<std::string, ProfileObject> s_profiles = std::unordered_map<std::string, ProfileObject>();
+static std::vector<ProfileFrame> s_stack;
+static std::unordered_map<std::string, ProfileNode> s_nodes;
+static std::vector<std::string> s_order;        // paths in the order of their first Push
+static std::vector<Profiler::Event> s_events;
+static int s_dropped = 0;
+static const size_t s_max_events = 200000;      // a few MB of trace per process
+
+static double Now() {
+    auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(since_epoch).count();
+}
 
 
 void Profiler::Push(const std::string& name) {
-    auto& profile = s_profiles[name];
-    if (profile.name == "") {                   // set up first time
-        profile.name = name;
-        profile.cumulative_time = 0;
-        profile.calls = 0;
+    std::string path = (s_stack.empty() ? name : s_stack.back().path + "|" + name);
+    if (s_nodes.find(path) == s_nodes.end()) {  // set up first time
+        s_nodes[path] = ProfileNode{0, 0., 0.};
+        s_order.push_back(path);
     }
-    profile.calls++;
-    profile.timer.Reset();
+    s_stack.push_back(ProfileFrame{name, path, Now(), 0.});
 }
 void Profiler::Pop(const std::string& name) {
-    auto& profile = s_profiles[name];
-    profile.cumulative_time += profile.timer.Elapsed();
+    auto open = std::find_if(s_stack.rbegin(), s_stack.rend(), [&](const ProfileFrame& f) { return f.name == name; });
+    if (open == s_stack.rend())
+        return;                                 // never pushed
+
+    // close everything down to (and including) name
+    double now = Now();
+    size_t count = open - s_stack.rbegin() + 1;
+    for (size_t k = 0; k < count; k++) {
+        ProfileFrame frame = s_stack.back();
+        s_stack.pop_back();
+
+        double duration = now - frame.start;
+        auto& node = s_nodes[frame.path];
+        node.calls++;
+        node.time += duration*1e-6;
+        node.self += (duration - frame.children)*1e-6;
+        if (!s_stack.empty())
+            s_stack.back().children += duration;
+
+        if (s_events.size() < s_max_events)
+            s_events.push_back(Event{frame.name, frame.start, duration});
+        else
+            s_dropped++;
+    }
+}
+
+int Profiler::Depth() const {
+    return s_stack.size();
+}
+std::vector<Profiler::Record> Profiler::Records() const {
+    std::vector<Record> records;
+    records.reserve(s_order.size());
+    for (auto& path : s_order) {
+        auto& node = s_nodes.at(path);
+        records.push_back(Record{path, node.calls, node.time, node.self});
+    }
+    return records;
+}
+const std::vector<Profiler::Event>& Profiler::Events() const {
+    return s_events;
+}
+int Profiler::DroppedEvents() const {
+    return s_dropped;
+}
+
+// Paths in tree order: every scope right after its parent, siblings in the
+// order they were first seen.
+std::vector<Profiler::Summary> Profiler::Summarize(const std::vector<std::vector<Record>>& records) {
+    std::vector<std::string> order;
+    std::unordered_map<std::string, std::vector<const Record*>> by_path;
+    for (auto& process : records) {
+        for (auto& r : process) {
+            if (by_path.find(r.path) == by_path.end())
+                order.push_back(r.path);
+            by_path[r.path].push_back(&r);
+        }
+    }
+    std::map<std::string, std::vector<std::string>> children;
+    for (auto& path : order) {
+        size_t bar = path.rfind('|');
+        children[bar == std::string::npos ? "" : path.substr(0, bar)].push_back(path);
+    }
+
+    std::vector<Summary> summary;
+    std::function<void(const std::string&, int)> visit = [&](const std::string& parent, int depth) {
+        for (auto& path : children[parent]) {
+            auto& found = by_path[path];
+            Summary s{path, depth, 0, int(found.size()), found[0]->time, 0., found[0]->time, 0.};
+            for (auto r : found) {
+                s.calls = std::max(s.calls, r->calls);
+                s.min = std::min(s.min, r->time);
+                s.max = std::max(s.max, r->time);
+                s.avg += r->time/found.size();
+                s.self += r->self/found.size();
+            }
+            summary.push_back(s);
+            visit(path, depth+1);
+        }
+    };
+    visit("", 0);
+    return summary;
+}
+void Profiler::WriteSummary(std::ostream& out, const std::vector<Summary>& summary) {
+    out     << std::left << std::setw(40) << "Name" << std::right
+            << std::setw(10) << "Calls"
+            << std::setw(12) << "Min [s]"
+            << std::setw(12) << "Avg [s]"
+            << std::setw(12) << "Max [s]"
+            << std::setw(12) << "Self [s]"
+            << std::setw(8) << "Ranks" << std::endl;
+    out << std::string(106, '-') << std::endl;
+    for (auto& s : summary) {
+        size_t bar = s.path.rfind('|');
+        std::string name = std::string(2*s.depth, ' ') + (bar == std::string::npos ? s.path : s.path.substr(bar+1));
+        out     << std::left << std::setw(40) << name << std::right
+                << std::setw(10) << s.calls
+                << std::setw(12) << s.min
+                << std::setw(12) << s.avg
+                << std::setw(12) << s.max
+                << std::setw(12) << s.self
+                << std::setw(8) << s.processes << std::endl;
+    }
+}
+// One "complete" event per call, one trace process per rank. The times
+// start at the earliest event.
+void Profiler::WriteTrace(std::ostream& out, const std::vector<std::vector<Event>>& events) {
+    auto escape = [](const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            result += c;
+        }
+        return result;
+    };
+    double origin = -1.;
+    for (auto& process : events)
+        for (auto& e : process)
+            if (origin < 0. || e.start < origin)
+                origin = e.start;
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\": [" << std::endl;
+    bool first = true;
+    for (int p = 0; p < events.size(); p++) {
+        out << (first ? "" : ",\n") << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << p
+            << ", \"args\": {\"name\": \"rank " << p << "\"}}";
+        first = false;
+        for (auto& e : events[p])
+            out << ",\n{\"name\": \"" << escape(e.name) << "\", \"ph\": \"X\", \"ts\": " << e.start - origin
+                << ", \"dur\": " << e.duration << ", \"pid\": " << p << ", \"tid\": 0}";
+    }
+    out << "\n]}" << std::endl;
 }
 
 bool Profiler::PrintTo(const std::string& filename) {
-    std::vector<ProfileObject> profiles; profiles.reserve(s_profiles.size());
-
-    for (const auto& p : s_profiles)
-        profiles.push_back(p.second);
-    
-    std::sort(profiles.begin(), profiles.end(), [](const ProfileObject& a, const ProfileObject& b) {
-        return a.cumulative_time < b.cumulative_time;
-    });
-    
     std::ofstream file(filename, std::ios_base::app);
     if (!file.is_open()) return false;
 
-    file    << std::setw(20) << "Name" 
-            << std::setw(10) << "Time [s]" 
-            << std::setw(10) << "Calls" << std::endl;
-    file << "--------------------------------------------" << std::endl;
-    for (auto& p : profiles)
-        file    << std::setw(20) << p.name 
-                << std::setw(10) << p.cumulative_time 
-                << std::setw(10) << p.calls << std::endl;
-
+    WriteSummary(file, Summarize({Records()}));
     return true;
 }
 void Profiler::Print() {
-    std::vector<ProfileObject> profiles; profiles.reserve(s_profiles.size());
+    WriteSummary(std::cout, Summarize({Records()}));
+}
+bool Profiler::TraceTo(const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) return false;
+
+    WriteTrace(file, {Events()});
+    if (s_dropped > 0)
+        LOG_WARN("The profiler trace is incomplete, " + std::to_string(s_dropped) + " events were dropped.");
+    return true;
+}
 
-    for (const auto& p : s_profiles)
-        profiles.push_back(p.second);
-    
-    std::sort(profiles.begin(), profiles.end(), [](const ProfileObject& a, const ProfileObject& b) {
-        return a.cumulative_time < b.cumulative_time;
-    });
-    std::cout   << std::setw(20) << "Name" 
-                << std::setw(12) << "Time[s]" 
-                << std::setw(10) << "Calls" << std::endl;
-    std::cout << "--------------------------------------------" << std::endl;
-    for (auto& p : profiles)
-        std::cout   << std::setw(20) << p.name 
-                    << std::setw(12) << p.cumulative_time 
-                    << std::setw(10) << p.calls << std::endl;
+
+ProfileScope::ProfileScope(const std::string& name) : _name(name) {
+    Profile::Push(_name);
+}
+ProfileScope::~ProfileScope() {
+    Profile::Pop(_name);
 }
 
 
@@ -89,7 +218,9 @@ bool Profile::PrintTo(const std::string& filename) {
 void Profile::Print() {
     s_profiler->Print();
 }
+bool Profile::TraceTo(const std::string& filename) {
+    return s_profiler->TraceTo(filename);
+}
 void Profile::SetProfiler(Profiler* profiler) {
     s_profiler.reset(profiler);
 }
-
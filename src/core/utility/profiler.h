@@ -5,23 +5,65 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <ostream>
 #include "utility/timer.h"
 
 // For profiling time spent in a particular function
 #define ProfilerPush() Profile::Push(__FUNCTION__)
 #define ProfilerPop() Profile::Pop(__FUNCTION__)
+#define ProfilerScope() ProfileScope _profile_scope(__FUNCTION__)
 
 
 
+// Scopes nest: every Push opens a frame on a stack and is recorded under
+// the path of the frames open around it, so a function called from two
+// places (or from itself) is timed separately in each.
 class Profiler {
 public:
     typedef std::shared_ptr<Profiler> Ptr_t;
-    
+
+    struct Record {                             // one path of one process
+        std::string path;                       // names of the enclosing scopes and this one, '|' separated
+        int calls;
+        double time, self;                      // [s] inclusive and without the nested scopes
+    };
+    struct Event {                              // one call, for the trace
+        std::string name;
+        double start, duration;                 // [us], start since the epoch
+    };
+    struct Summary {                            // one path over the processes
+        std::string path;
+        int depth, calls, processes;
+        double min, avg, max, self;             // [s], self is the average
+    };
+
+    virtual ~Profiler() {}
+
     virtual void Push(const std::string& name);
-    virtual void Pop(const std::string& name);
+    virtual void Pop(const std::string& name);  // also closes the scopes opened after name and not yet closed
 
     virtual bool PrintTo(const std::string& filename);
     virtual void Print();
+    virtual bool TraceTo(const std::string& filename);          // Chrome trace-event JSON (chrome://tracing, Perfetto)
+
+protected:
+    int Depth() const;                          // of the open scopes
+    std::vector<Record> Records() const;
+    const std::vector<Event>& Events() const;
+    int DroppedEvents() const;                  // beyond the limit of the trace
+
+    // records of every process (in tree order) and the tables/trace written from them
+    static std::vector<Summary> Summarize(const std::vector<std::vector<Record>>& records);
+    static void WriteSummary(std::ostream& out, const std::vector<Summary>& summary);
+    static void WriteTrace(std::ostream& out, const std::vector<std::vector<Event>>& events);
+};
+
+// Push on construction, Pop on destruction (also on early returns)
+class ProfileScope {
+    std::string _name;
+public:
+    ProfileScope(const std::string& name);
+    ~ProfileScope();
 };
 
 
@@ -33,6 +75,7 @@ namespace Profile {
 
     bool PrintTo(const std::string& filename);
     void Print();
-    
+    bool TraceTo(const std::string& filename);
+
     void SetProfiler(Profiler* profiler);
 };
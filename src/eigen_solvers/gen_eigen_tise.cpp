@@ -2,6 +2,7 @@
 #include "eigen_solvers/gen_eigen_tise.h"
 #include "utility/logger.h"
 #include "utility/profiler.h"
+#include "utility/memory_tracker.h"
 #include "utility/file_exists.h"
 
 #include <string>
@@ -50,6 +51,7 @@ void GeneralizeEigenvalueTISE::Solve() {
     }
     */
     ProfilerPush();
+    MemoryOwner owner("TISE");
 
     double memory = 3.*(2*_order-1)*_N + 2.;
     memory = memory*16/1024./1024./1024.;
@@ -93,31 +95,30 @@ void GeneralizeEigenvalueTISE::Solve() {
     }
 
 
-    // OPTIMIZATION: these are banded
-    std::vector<complex> kinBlockStore(_N*_N);
-    std::vector<complex> r2BlockStore(_N*_N);
-
-    // laplacian part is always the same (only depends on i,j) so cache
-    for (int i = 0; i < _N; i++) {
-        for (int j = i; j < _N; j++) {
-            kinBlockStore[i + j*_N] = kinBlockStore[j + i*_N] = _basis.Integrate(i+1, j+1, 1,1) / 2.0;
-            r2BlockStore [i + j*_N] =  r2BlockStore[j + i*_N] = _basis.Integrate(i+1, j+1, [] (complex r) {
-                return 1./r/r;
-            });
-        }
-    }
+    // laplacian part is always the same (only depends on i,j) so cache, with the overlap in the same pass
+    auto radial = _basis.IntegrateOperators({
+        {nullptr, 1, 1},
+        Basis::BSpline::Power(-2),
+        {nullptr, 0, 0}
+    });
+    std::vector<complex>& kinBlockStore = radial[0];
+    std::vector<complex>& r2BlockStore = radial[1];
+    std::vector<complex>& overlapStore = radial[2];
+    for (auto& kin : kinBlockStore)
+        kin /= 2.0;
 
     // fill overlap matrix
     LOG_INFO("Building overlap matrix.");
-    S->FillBandedBlock(_order-1, _N, [=](int row, int col) {
+    S->FillBandedBlock(_order-1, _N, [=,&overlapStore](int row, int col) {
         int i, j, l1, l2, m1, m2;
         // ILMFrom(row, i, l1, m1);                // used for non-central potential
         // ILMFrom(col, j, l2, m2);                // used for non-central potential
         i = row;
         j = col;
         
-        return _basis.Integrate(i+1, j+1);
+        return overlapStore[i + j*_N];
     });
+    Memory::Report("initialization");
 
     _values.resize(_nmax);
     _vectors.resize(_nmax);
@@ -0,0 +1,55 @@
+#include "input_validation/validate.h"
+
+Pulse::Ptr_t BuildPulse(const nlohmann::json& pulse) {
+    double frequency;
+    double num_cycles = pulse["num_cycles"];
+    double cycles_up = 0.5*num_cycles;
+    double cycles_down = 0.5*num_cycles;
+    double cycles_delay = pulse["cycles_delay"];
+    double intensity = pulse["intensity"];
+    double cep = pulse["cep"];
+    double ellipticity = 0.;
+    Vec3 pol_vector, poy_vector;
+    double norm = 0;
+
+    pol_vector.x = pulse["polarization_vector"][0];
+    pol_vector.y = pulse["polarization_vector"][1];
+    pol_vector.z = pulse["polarization_vector"][2];
+    pol_vector = normal(pol_vector);
+    
+    poy_vector.x = pulse["poynting_vector"][0];
+    poy_vector.y = pulse["poynting_vector"][1];
+    poy_vector.z = pulse["poynting_vector"][2];
+    poy_vector = normal(poy_vector);
+
+    // specify wavelength (nm) or energy (au)
+    if (pulse.contains("ellipticity"))
+        ellipticity = pulse["ellipticity"].get<double>();
+    if (pulse.contains("wavelength"))
+        frequency = LnmToEnergy/pulse["wavelength"].get<double>();   // not sure why "get..." is needed here
+    if (pulse.contains("energy"))
+        frequency = pulse["energy"];
+    if (pulse.contains("cycles_up"))
+        cycles_up = pulse["cycles_up"].get<double>();
+    if (pulse.contains("cycles_down"))
+        cycles_down = pulse["cycles_down"].get<double>();
+
+
+    if (pulse["envelope"] == "sin2") {
+        return Pulse::Create(
+            Pulse::Sin2, 
+            cycles_delay, cep, intensity, 
+            frequency, num_cycles, cycles_up, cycles_down, 
+            ellipticity, 
+            pol_vector, poy_vector);
+    } else if (pulse["envelope"] == "trap" || 
+               pulse["envelope"] == "trapezoidal") {
+        return Pulse::Create(
+            Pulse::Trap, 
+            cycles_delay, cep, intensity, 
+            frequency, num_cycles, cycles_up, cycles_down,
+            ellipticity, 
+            pol_vector, poy_vector);
+    }
+    return nullptr;
+}
@@ -27,6 +27,7 @@ bool ValidateInitialState(const nlohmann::json& input);
 bool ValidateMathLibrary(const nlohmann::json& input);
 bool ValidateBasis(const nlohmann::json& input);
 bool ValidateObservables(const nlohmann::json& input);
+bool ValidateSweep(const nlohmann::json& input);
 
 bool ValidateTISEInputFile(int argc, char **args, const std::string& filename, MathLib*& matlib, TISE::Ptr_t& tise);
 bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, MathLib*& matlib, TDSE::Ptr_t& tdse);
@@ -34,3 +35,4 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
 
 Observable::Ptr_t BuildObservable(const std::string& key, const nlohmann::json& obs_item, TDSE::Ptr_t tdse);
 Potential::Ptr_t BuildPotential(const nlohmann::json& potential_item);
+Pulse::Ptr_t BuildPulse(const nlohmann::json& pulse);
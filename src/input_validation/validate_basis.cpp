@@ -60,6 +60,14 @@ bool ValidateBasis(const nlohmann::json& input) {
             Log::critical("mmax must be less than or equal to lmax.");
             return false;
         }
+        if (basis.contains("quadrature_tolerance") && !(basis["quadrature_tolerance"].is_number() && basis["quadrature_tolerance"] > 0 && basis["quadrature_tolerance"] < 1)) {
+            Log::critical("quadrature_tolerance must be a number between 0 and 1.");
+            return false;
+        }
+        if (basis.contains("quadrature_check") && !basis["quadrature_check"].is_boolean()) {
+            MustContain("quadrature_check", "boolean", "basis");
+            return false;
+        }
     }
     return true;
 }
\ No newline at end of file
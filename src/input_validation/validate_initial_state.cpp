@@ -6,27 +6,39 @@ bool ValidateInitialState(const nlohmann::json& input) {
         return false;
     }
 
+    // an array of states is one superposition, an array of such arrays a batch of them
     auto& initial_state = input["initial_state"];
-    for (auto& state : initial_state) {
-        if (!(state.contains("n") && state["n"].is_number())) {
-            MustContain("n", "number");
+    bool batch = (!initial_state.empty() && initial_state[0].is_array());
+    for (auto& member : initial_state) {
+        if (member.is_array() != batch) {
+            Log::critical("Entry \"initial_state\" must be an array of states or an array of arrays of states.");
             return false;
         }
-        if (!(state.contains("l") && state["l"].is_number())) {
-            MustContain("l", "number");
+        if (batch && member.empty()) {
+            Log::critical("Every member of the \"initial_state\" batch needs at least one state.");
             return false;
         }
-        if (!(state.contains("m") && state["m"].is_number())) {
-            MustContain("m", "number");
-            return false;
-        }
-        if (state.contains("phase") && !state["phase"].is_number()) {
-            Log::critical("Optional entry \"phase\" must be a number.");
-            return false;
-        }
-        if (state.contains("amplitude") && !state["amplitude"].is_number()) {
-            Log::critical("Optional entry \"amplitude\" must be a number.");
-            return false;
+        for (auto& state : (batch ? member : nlohmann::json::array({member}))) {
+            if (!(state.contains("n") && state["n"].is_number())) {
+                MustContain("n", "number");
+                return false;
+            }
+            if (!(state.contains("l") && state["l"].is_number())) {
+                MustContain("l", "number");
+                return false;
+            }
+            if (!(state.contains("m") && state["m"].is_number())) {
+                MustContain("m", "number");
+                return false;
+            }
+            if (state.contains("phase") && !state["phase"].is_number()) {
+                Log::critical("Optional entry \"phase\" must be a number.");
+                return false;
+            }
+            if (state.contains("amplitude") && !state["amplitude"].is_number()) {
+                Log::critical("Optional entry \"amplitude\" must be a number.");
+                return false;
+            }
         }
     }
     return true;
@@ -5,9 +5,153 @@ bool ValidatePropagator(const nlohmann::json& input) {
         MustContain("propagator", "string");
         return false;
     }
+    std::string propagator = ToLower(input["propagator"]);
+    if (propagator != "crank_nicolson" && propagator != "arnoldi" && propagator != "magnus") {
+        LOG_CRITICAL("unknown propagator: " + propagator);
+        return false;
+    }
     if (!(input.contains("time_step") && input["time_step"].is_number())) {
         MustContain("time_step", "number");
         return false;
     }
+    if (input.contains("matrix_free") && !input["matrix_free"].is_boolean()) {
+        MustContain("matrix_free", "boolean");
+        return false;
+    }
+    if (input.contains("mixed_precision") && !input["mixed_precision"].is_boolean()) {
+        MustContain("mixed_precision", "boolean");
+        return false;
+    }
+    if (input.contains("solver")) {
+        if (!input["solver"].is_string()) {
+            MustContain("solver", "string");
+            return false;
+        }
+        std::string solver = ToLower(input["solver"]);
+        if (solver != "gmres" && solver != "block_tridiagonal" && solver != "gcrodr") {
+            LOG_CRITICAL("unknown solver: " + solver);
+            return false;
+        }
+    }
+    if (input.contains("preconditioner")) {
+        if (!input["preconditioner"].is_string()) {
+            MustContain("preconditioner", "string");
+            return false;
+        }
+        std::string pc = ToLower(input["preconditioner"]);
+        if (pc != "block_jacobi" && pc != "field_free_lu") {
+            LOG_CRITICAL("unknown preconditioner: " + pc);
+            return false;
+        }
+    }
+    if (input.contains("adaptive_l")) {
+        auto& adaptive_l = input["adaptive_l"];
+        if (!(adaptive_l.is_object() && adaptive_l.contains("threshold") && adaptive_l["threshold"].is_number() && adaptive_l["threshold"] > 0)) {
+            MustContain("threshold", "positive number", "adaptive_l");
+            return false;
+        }
+        if (adaptive_l.contains("increment") && !(adaptive_l["increment"].is_number_integer() && adaptive_l["increment"] >= 1)) {
+            MustContain("increment", "positive integer", "adaptive_l");
+            return false;
+        }
+        if (adaptive_l.contains("initial_lmax") && !(adaptive_l["initial_lmax"].is_number_integer() && adaptive_l["initial_lmax"] >= 0)) {
+            MustContain("initial_lmax", "non-negative integer", "adaptive_l");
+            return false;
+        }
+        if (propagator != "crank_nicolson") {
+            LOG_CRITICAL("\"adaptive_l\" needs the crank_nicolson propagator.");
+            return false;
+        }
+    }
+    if (input.contains("radial_window")) {
+        auto& window = input["radial_window"];
+        if (!(window.is_object() && window.contains("threshold") && window["threshold"].is_number() && window["threshold"] > 0)) {
+            MustContain("threshold", "positive number", "radial_window");
+            return false;
+        }
+        if (window.contains("margin") && !(window["margin"].is_number_integer() && window["margin"] >= 2)) {
+            MustContain("margin", "integer >= 2", "radial_window");
+            return false;
+        }
+        if (window.contains("initial_size") && !(window["initial_size"].is_number_integer() && window["initial_size"] >= 1)) {
+            MustContain("initial_size", "positive integer", "radial_window");
+            return false;
+        }
+        if (propagator != "crank_nicolson") {
+            LOG_CRITICAL("\"radial_window\" needs the crank_nicolson propagator.");
+            return false;
+        }
+    }
+    if (input.contains("krylov_dimension") && !(input["krylov_dimension"].is_number_integer() && input["krylov_dimension"] > 1)) {
+        MustContain("krylov_dimension", "integer > 1");
+        return false;
+    }
+    if (input.contains("recycle") && !(input["recycle"].is_number_integer() && input["recycle"] >= 0)) {
+        MustContain("recycle", "non-negative integer");
+        return false;
+    }
+    if (input.contains("initial_guess")) {
+        if (!input["initial_guess"].is_string()) {
+            MustContain("initial_guess", "string");
+            return false;
+        }
+        std::string guess = ToLower(input["initial_guess"]);
+        if (guess != "previous" && guess != "extrapolate" && guess != "projection") {
+            LOG_CRITICAL("unknown initial guess: " + guess);
+            return false;
+        }
+    }
+    if (input.contains("guess_history") && !(input["guess_history"].is_number_integer() && input["guess_history"] >= 2)) {
+        MustContain("guess_history", "integer >= 2");
+        return false;
+    }
+    if (input.contains("krylov_tolerance") && !(input["krylov_tolerance"].is_number() && input["krylov_tolerance"] > 0)) {
+        MustContain("krylov_tolerance", "positive number");
+        return false;
+    }
+    if (input.contains("krylov_max_dimension") && !(input["krylov_max_dimension"].is_number_integer() && input["krylov_max_dimension"] >= 2)) {
+        MustContain("krylov_max_dimension", "integer >= 2");
+        return false;
+    }
+    if (input.contains("exponential")) {
+        if (!input["exponential"].is_string()) {
+            MustContain("exponential", "string");
+            return false;
+        }
+        std::string exponential = ToLower(input["exponential"]);
+        if (exponential != "pade" && exponential != "krylov") {
+            LOG_CRITICAL("unknown exponential: " + exponential);
+            return false;
+        }
+    }
+    if (input.contains("adaptive")) {
+        auto& adaptive = input["adaptive"];
+        if (!(adaptive.is_object() && adaptive.contains("tolerance") && adaptive["tolerance"].is_number() && adaptive["tolerance"] > 0)) {
+            MustContain("adaptive", "object with a positive \"tolerance\"");
+            return false;
+        }
+        for (auto key : {"dt_min", "dt_max"}) {
+            if (adaptive.contains(key) && !(adaptive[key].is_number() && adaptive[key] > 0)) {
+                MustContain(key, "positive number");
+                return false;
+            }
+        }
+        // the step must be of any length with the field at any time
+        if (!(propagator == "arnoldi" || (propagator == "magnus" && input.contains("exponential") && ToLower(input["exponential"]) == "krylov"))) {
+            LOG_CRITICAL("adaptive time steps need the \"arnoldi\" propagator or \"magnus\" with the \"krylov\" exponential.");
+            return false;
+        }
+    }
+    if (input.contains("free_evolution")) {
+        auto& free = input["free_evolution"];
+        if (!(free.is_object() && free.contains("time") && free["time"].is_number() && free["time"] >= 0)) {
+            MustContain("free_evolution", "object with a non-negative \"time\"");
+            return false;
+        }
+        if (free.contains("samples") && !(free["samples"].is_number_integer() && free["samples"] >= 1)) {
+            MustContain("samples", "positive integer");
+            return false;
+        }
+    }
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "input_validation/validate.h"
+
+bool ValidateSweep(const nlohmann::json& input) {
+    if (input.contains("sweep_groups") && !(input["sweep_groups"].is_number_integer() && input["sweep_groups"] >= 1)) {
+        MustContain("sweep_groups", "positive integer");
+        return false;
+    }
+    if (!input.contains("sweep")) {
+        if (input.value("sweep_groups", 1) > 1) {
+            Log::critical("\"sweep_groups\" > 1 needs a \"sweep\", otherwise every group runs the same problem into the same files.");
+            return false;
+        }
+        return true;
+    }
+
+    if (!(input["sweep"].is_array() && !input["sweep"].empty())) {
+        MustContain("sweep", "non-empty array");
+        return false;
+    }
+    std::vector<std::string> directories;
+    for (int k = 0; k < input["sweep"].size(); k++) {
+        auto& config = input["sweep"][k];
+        if (!config.is_object()) {
+            Log::critical("Every entry of \"sweep\" must be an object.");
+            return false;
+        }
+        // the lasers are checked like the main ones
+        if (config.contains("lasers")) {
+            if (!(config["lasers"].is_array() && ValidateLasers(config))) {
+                MustContain("lasers", "array", "sweep configuration " + std::to_string(k));
+                return false;
+            }
+        }
+        if (config.contains("time_step") && !(config["time_step"].is_number() && config["time_step"] > 0)) {
+            MustContain("time_step", "positive number", "sweep configuration " + std::to_string(k));
+            return false;
+        }
+        if (config.contains("directory") && !config["directory"].is_string()) {
+            MustContain("directory", "string", "sweep configuration " + std::to_string(k));
+            return false;
+        }
+        directories.push_back(config.value("directory", "sweep_" + std::to_string(k)));
+    }
+    std::sort(directories.begin(), directories.end());
+    if (std::adjacent_find(directories.begin(), directories.end()) != directories.end()) {
+        Log::critical("The configurations of a sweep need different directories.");
+        return false;
+    }
+    return true;
+}
@@ -2,12 +2,15 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 // math libraries
 #include "math_libs/petsc/petsc_lib.h"
 
 // propagators
 #include "tdse_propagators/cranknicolson.h"
+#include "tdse_propagators/arnoldi.h"
+#include "tdse_propagators/magnus.h"
 
 // observables
 #include "observables/norm_obs.h"
@@ -15,6 +18,21 @@
 
 // potentials
 
+// the distinct m's of the initial state (of every member of a batch), sorted
+static std::vector<int> InitialStateMs(const nlohmann::json& input) {
+    std::vector<int> Ms;
+    if (!(input.contains("initial_state") && input["initial_state"].is_array()))
+        return Ms;
+    for (auto& item : input["initial_state"]) {
+        for (auto& state : (item.is_array() ? item : nlohmann::json::array({item})))
+            if (state.is_object() && state.contains("m") && state["m"].is_number_integer())
+                Ms.push_back(state["m"]);
+    }
+    std::sort(Ms.begin(), Ms.end());
+    Ms.erase(std::unique(Ms.begin(), Ms.end()), Ms.end());
+    return Ms;
+}
+
 bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, MathLib*& matlib, TDSE::Ptr_t& tdse) {
     std::ifstream i(filename);
     nlohmann::json input;
@@ -33,11 +51,30 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
         matlib = &Petsc::get();
         Log::set_logger(new PetscLogger());
         Profile::SetProfiler(new PetscProfiler());
+        Memory::SetTracker(new PetscMemoryTracker());
     } else if (ToLower(input["math_library"]) == "thread_pool") {
         std::cout << "thread_pool is not yet supported" << std::endl;
         return false;
     }
-    matlib->Startup(argc, args);
+    // groups of ranks that run the configurations of a sweep side by side
+    int groups = 1;
+    if (input.contains("sweep_groups") && input["sweep_groups"].is_number_integer())
+        groups = std::max(1, input["sweep_groups"].get<int>());
+    // or one group per m of the initial state (see "m_split"), the ranks shared
+    // out in proportion to the size of each m-block, N*(lmax-|m|+1)
+    std::vector<double> weights;
+    if (input.contains("m_split") && input["m_split"].is_boolean() && input["m_split"]) {
+        std::vector<int> Ms = InitialStateMs(input);
+        int lmax = 0;
+        if (input.contains("basis") && input["basis"].contains("lmax") && input["basis"]["lmax"].is_number_integer())
+            lmax = input["basis"]["lmax"];
+        for (int m : Ms)
+            weights.push_back(std::max(1, lmax - std::abs(m) + 1));
+        groups = std::max(1, int(Ms.size()));
+    }
+    matlib->Startup(argc, args, groups, weights);
+    if (matlib->Groups() > 1 && input.contains("log_filename") && input["log_filename"].is_string())
+        Log::set_logger_file(input["log_filename"].get<std::string>() + "." + std::to_string(matlib->Group()));
 
 
     LOG_INFO("Validating TDSE input file.");
@@ -60,6 +97,10 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
         return false;
     LOG_INFO("...");
 
+    if (!ValidateSweep(input))
+        return false;
+    LOG_INFO("...");
+
     if (!ValidateObservables(input))
         return false;
     LOG_INFO("...");
@@ -94,6 +135,32 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
         MustContain("checkpoint", "number");
         return false;
     }
+    if (input.contains("telemetry") && !(input["telemetry"].is_number_integer() && input["telemetry"] >= 0)) {
+        MustContain("telemetry", "non-negative integer");
+        return false;
+    }
+    if (input.contains("adaptive") && input["initial_state"].size() > 1 && input["initial_state"][0].is_array()) {
+        Log::critical("Adaptive time steps are chosen for a single state, they do not work with a batch of initial states.");
+        return false;
+    }
+    if (input.contains("m_split")) {
+        if (!input["m_split"].is_boolean()) {
+            MustContain("m_split", "boolean");
+            return false;
+        }
+        if (input["m_split"] && (input.contains("sweep") || input.value("sweep_groups", 1) > 1)) {
+            Log::critical("\"m_split\" and \"sweep\" both split the ranks into groups, choose one.");
+            return false;
+        }
+        // the m-blocks only stay independent for lasers along z
+        for (auto& pulse : input["lasers"]) {
+            if (input["m_split"] && (pulse["polarization_vector"][0] != 0 || pulse["polarization_vector"][1] != 0 ||
+                                     pulse.value("ellipticity", 0.) != 0.)) {
+                Log::critical("\"m_split\" needs linearly polarized lasers along z.");
+                return false;
+            }
+        }
+    }
     LOG_INFO("...");
 
     LOG_INFO("Input file validated. Initializing TDSE.");
@@ -102,11 +169,59 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
     // take advatage of symmetry
     
 
-    if (ToLower(input["propagator"]) == "crank_nicolson")
-        tdse = TDSE::Ptr_t(new CrankNicolsonTDSE(*matlib));
+    if (ToLower(input["propagator"]) == "crank_nicolson") {
+        auto cn = new CrankNicolsonTDSE(*matlib);
+        if (input.contains("matrix_free"))
+            cn->SetMatrixFree(input["matrix_free"]);
+        if (input.contains("solver") && ToLower(input["solver"]) == "block_tridiagonal")
+            cn->SetSolver(CrankNicolsonTDSE::BlockTridiagonal);
+        if (input.contains("solver") && ToLower(input["solver"]) == "gcrodr")
+            cn->SetSolver(CrankNicolsonTDSE::GCRODR);
+        if (input.contains("krylov_dimension") || input.contains("recycle"))
+            cn->SetRecycling(input.value("krylov_dimension", 40), input.value("recycle", 10));
+        if (input.contains("initial_guess")) {
+            std::string guess = ToLower(input["initial_guess"]);
+            if (guess == "extrapolate")
+                cn->SetInitialGuess(CrankNicolsonTDSE::Extrapolate, input.value("guess_history", 4));
+            else if (guess == "projection")
+                cn->SetInitialGuess(CrankNicolsonTDSE::Projection, input.value("guess_history", 4));
+        }
+        if (input.contains("preconditioner") && ToLower(input["preconditioner"]) == "field_free_lu")
+            cn->SetPreconditioner(CrankNicolsonTDSE::FieldFreeLU);
+        if (input.contains("mixed_precision"))
+            cn->SetMixedPrecision(input["mixed_precision"]);
+        if (input.contains("adaptive_l"))
+            cn->SetAdaptiveL(input["adaptive_l"]["threshold"], input["adaptive_l"].value("increment", 2),
+                             input["adaptive_l"].value("initial_lmax", -1));
+        if (input.contains("radial_window"))
+            cn->SetRadialWindow(input["radial_window"]["threshold"], input["radial_window"].value("margin", 40),
+                                input["radial_window"].value("initial_size", 0));
+        tdse = TDSE::Ptr_t(cn);
+    } else if (ToLower(input["propagator"]) == "arnoldi") {
+        auto arnoldi = new ArnoldiTDSE(*matlib);
+        if (input.contains("krylov_tolerance"))
+            arnoldi->SetTolerance(input["krylov_tolerance"]);
+        if (input.contains("krylov_max_dimension"))
+            arnoldi->SetMaxDimension(input["krylov_max_dimension"]);
+        tdse = TDSE::Ptr_t(arnoldi);
+    } else if (ToLower(input["propagator"]) == "magnus") {
+        auto magnus = new MagnusTDSE(*matlib);
+        if (input.contains("exponential") && ToLower(input["exponential"]) == "krylov")
+            magnus->SetExponential(MagnusTDSE::Krylov);
+        if (input.contains("krylov_tolerance"))
+            magnus->SetTolerance(input["krylov_tolerance"]);
+        if (input.contains("krylov_max_dimension"))
+            magnus->SetMaxDimension(input["krylov_max_dimension"]);
+        tdse = TDSE::Ptr_t(magnus);
+    }
     tdse->SetTimestep(input["time_step"]);
     tdse->SetCheckpoints(input["checkpoint"]);
 
+    if (input.contains("m_split"))
+        tdse->SetMSplit(input["m_split"]);
+    if (input.contains("telemetry"))
+        tdse->SetTelemetry(input["telemetry"]);
+
     if (input.contains("restart") && input["restart"].is_boolean())
         tdse->SetRestart(input["restart"]);
 
@@ -114,64 +229,38 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
         tdse->SetDoPropagate(input["do_propagate"]);
         
     tdse->SetCheckpoints(input["checkpoint"]);
+    if (input.contains("free_evolution"))
+        tdse->SetFreeEvolution(input["free_evolution"]["time"], input["free_evolution"].value("samples", 1));
+    if (input.contains("adaptive"))
+        tdse->SetAdaptive(input["adaptive"]["tolerance"], input["adaptive"].value("dt_min", 0.), input["adaptive"].value("dt_max", 0.));
 
     // set up lasers
     Log::info("Setting up lasers.");
 
     auto& lasers = input["lasers"];
     for (auto& pulse : lasers) {
-        double frequency;
-        double num_cycles = pulse["num_cycles"];
-        double cycles_up = 0.5*num_cycles;
-        double cycles_down = 0.5*num_cycles;
-        double cycles_delay = pulse["cycles_delay"];
-        double intensity = pulse["intensity"];
-        double cep = pulse["cep"];
-        double ellipticity = 0.;
-        Vec3 pol_vector, poy_vector;
-        double norm = 0;
-
-        pol_vector.x = pulse["polarization_vector"][0];
-        pol_vector.y = pulse["polarization_vector"][1];
-        pol_vector.z = pulse["polarization_vector"][2];
-        pol_vector = normal(pol_vector);
-        
-        poy_vector.x = pulse["poynting_vector"][0];
-        poy_vector.y = pulse["poynting_vector"][1];
-        poy_vector.z = pulse["poynting_vector"][2];
-        poy_vector = normal(poy_vector);
-
-        // specify wavelength (nm) or energy (au)
-        if (pulse.contains("ellipticity"))
-            ellipticity = pulse["ellipticity"].get<double>();
-        if (pulse.contains("wavelength"))
-            frequency = LnmToEnergy/pulse["wavelength"].get<double>();   // not sure why "get..." is needed here
-        if (pulse.contains("energy"))
-            frequency = pulse["energy"];
-        if (pulse.contains("cycles_up"))
-            cycles_up = pulse["cycles_up"].get<double>();
-        if (pulse.contains("cycles_down"))
-            cycles_down = pulse["cycles_down"].get<double>();
-
-
-        if (pulse["envelope"] == "sin2") {
-            tdse->AddPulse(Pulse::Create(
-                Pulse::Sin2, 
-                cycles_delay, cep, intensity, 
-                frequency, num_cycles, cycles_up, cycles_down, 
-                ellipticity, 
-                pol_vector, poy_vector));
-        } else if (pulse["envelope"] == "trap" || 
-                   pulse["envelope"] == "trapezoidal") {
-            auto p = Pulse::Create(
-                Pulse::Trap, 
-                cycles_delay, cep, intensity, 
-                frequency, num_cycles, cycles_up, cycles_down,
-                ellipticity, 
-                pol_vector, poy_vector);
-            
-            tdse->AddPulse(p);
+        Pulse::Ptr_t pulse_ptr;
+        if ((pulse_ptr = BuildPulse(pulse)) != nullptr)
+            tdse->AddPulse(pulse_ptr);
+    }
+
+    // runs with other lasers or time steps that share everything else
+    if (input.contains("sweep")) {
+        auto& sweep = input["sweep"];
+        for (int k = 0; k < sweep.size(); k++) {
+            auto& config = sweep[k];
+            std::vector<Pulse::Ptr_t> pulses;
+            for (auto& pulse : (config.contains("lasers") ? config["lasers"] : lasers)) {
+                Pulse::Ptr_t pulse_ptr;
+                if ((pulse_ptr = BuildPulse(pulse)) != nullptr)
+                    pulses.push_back(pulse_ptr);
+            }
+            tdse->AddSweepConfiguration(config.value("directory", "sweep_" + std::to_string(k)),
+                                        pulses, config.value("time_step", input["time_step"].get<double>()));
         }
+        // the propagator is built once for the time step of this group's first run
+        if (matlib->Group() < sweep.size())
+            tdse->SetTimestep(sweep[matlib->Group()].value("time_step", input["time_step"].get<double>()));
     }
     
     // setup initial state
@@ -184,18 +273,22 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
     if (input["eigen_state"].contains("lmax"))
         tdse->SetEigenStateLmax(input["eigen_state"]["lmax"].get<int>());
 
+    // an array of arrays is a batch, every member is propagated with the same matrices
     auto& initial_state = input["initial_state"];
-    for (auto& state : initial_state) {
-        int n = state["n"];
-        int l = state["l"];
-        int m = state["m"];
-        double phase = 0.;
-        double amplitude = 1.;
-
-        if (state.contains("phase")) phase = state["phase"];
-        if (state.contains("amplitude")) amplitude = state["amplitude"];
-        
-        tdse->AddInitialState(n, l, m, phase, amplitude);
+    bool batch = (!initial_state.empty() && initial_state[0].is_array());
+    for (int member = 0; member < (batch ? initial_state.size() : 1); member++) {
+        for (auto& state : (batch ? initial_state[member] : initial_state)) {
+            int n = state["n"];
+            int l = state["l"];
+            int m = state["m"];
+            double phase = 0.;
+            double amplitude = 1.;
+
+            if (state.contains("phase")) phase = state["phase"];
+            if (state.contains("amplitude")) amplitude = state["amplitude"];
+            
+            tdse->AddInitialState(n, l, m, phase, amplitude, member);
+        }
     }
 
 
@@ -213,10 +306,14 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
     double ecs_theta = Pi/4.;
     double seq_parameter = 0.;              // does nothing for Linear
     Basis::BSpline::Sequence seq = Basis::BSpline::Linear;
+    double quadrature_tolerance = Basis::QUADRATURE_TOLERANCE;
+    bool quadrature_check = false;
 
 
     if (basis.contains("ecs_r0")) ecs_r0 = basis["ecs_r0"];           // optional - ecs parameters
     if (basis.contains("ecs_theta")) ecs_theta = basis["ecs_theta"];
+    if (basis.contains("quadrature_tolerance")) quadrature_tolerance = basis["quadrature_tolerance"];
+    if (basis.contains("quadrature_check")) quadrature_check = basis["quadrature_check"];
     
     if (ToLower(basis["node_sequence"]) == "linear")
         seq = Basis::BSpline::Linear;
@@ -237,17 +334,34 @@ bool ValidateTDSEInputFile(int argc, char **args, const std::string& filename, M
                     order, num_nodes, 
                     lmax, mmax,
                     ecs_r0, ecs_theta,
-                    seq, seq_parameter);
+                    seq, seq_parameter,
+                    quadrature_tolerance, quadrature_check);
     
     // setup observables
     LOG_INFO("Building observables.");
 
+    // observables of the wavefunction are repeated for every member of a batch, name.ext -> name_k.ext
     auto& observables_json = input["observables"];
+    int members = tdse->BatchSize();
     for (auto& obs_pair : observables_json.items()) {
-        Observable::Ptr_t obs_ptr;
-        if ((obs_ptr = BuildObservable(obs_pair.key(), obs_pair.value(), tdse)) == nullptr)
-            return false;                                       // should never happen because we validated
-        tdse->AddObservable(obs_ptr);
+        const std::string& key = obs_pair.key();
+        bool per_member = (members > 1) &&
+            (key == "norm" || key == "dipole_acc" || key == "populations" || key == "wavefunction");
+
+        for (int k = 0; k < (per_member ? members : 1); k++) {
+            Observable::Ptr_t obs_ptr;
+            nlohmann::json item = obs_pair.value();
+            if (per_member && item.contains("filename")) {
+                std::string filename = item["filename"];
+                size_t dot = filename.find_last_of('.');
+                if (dot == std::string::npos)
+                    dot = filename.length();
+                item["filename"] = filename.substr(0, dot) + "_" + std::to_string(k) + filename.substr(dot);
+            }
+            if ((obs_ptr = BuildObservable(key, item, tdse)) == nullptr)
+                return false;                                       // should never happen because we validated
+            tdse->AddObservable(obs_ptr, k);
+        }
     }
 
     // setup potentials
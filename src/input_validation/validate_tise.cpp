@@ -25,6 +25,7 @@ bool ValidateTISEInputFile(int argc, char **args, const std::string& filename, M
             matlib = &Petsc::get();
             Log::set_logger(new PetscLogger());
             Profile::SetProfiler(new PetscProfiler());
+            Memory::SetTracker(new PetscMemoryTracker());
         } else { //if (ToLower(eigen_state["solver"]) == "??") {
             Log::critical("only SLEPC is supported");
             return false;
@@ -73,10 +74,14 @@ bool ValidateTISEInputFile(int argc, char **args, const std::string& filename, M
     double ecs_theta = 0.0;             // default to NO ecs
     double seq_parameter = 0.;              // does nothing for Linear
     Basis::BSpline::Sequence seq = Basis::BSpline::Linear;  // default to linear
+    double quadrature_tolerance = Basis::QUADRATURE_TOLERANCE;
+    bool quadrature_check = false;
 
     // optional - ecs parameters
     // if (basis.contains("ecs_r0")) ecs_r0 = basis["ecs_r0"];
     // if (basis.contains("ecs_theta")) ecs_theta = basis["ecs_theta"];
+    if (basis.contains("quadrature_tolerance")) quadrature_tolerance = basis["quadrature_tolerance"];
+    if (basis.contains("quadrature_check")) quadrature_check = basis["quadrature_check"];
     
     if (ToLower(basis["node_sequence"]) == "linear")
         seq = Basis::BSpline::Linear;
@@ -97,7 +102,8 @@ bool ValidateTISEInputFile(int argc, char **args, const std::string& filename, M
                     order, num_nodes, 
                     ecs_r0, ecs_theta,
                     seq,
-                    seq_parameter);
+                    seq_parameter,
+                    quadrature_tolerance, quadrature_check);
     
     // setup potentials
     Log::info("Building potentials.");
@@ -12,10 +12,14 @@
 
 
 #include "core/utility/profiler.h"
+#include "core/utility/memory_tracker.h"
 
 int main(int argc, char **args) {
     MathLib* matLib;
     bool do_tise = false;
+    bool do_estimate = false;
+    int estimate_ranks = 0;                     // 0: the ranks of this run
+    std::vector<std::string> calibration;       // TDSE.h5 of earlier runs
     TDSE::Ptr_t tdse;
     TISE::Ptr_t tise;
 
@@ -26,6 +30,20 @@ int main(int argc, char **args) {
             ToLower(std::string(args[i])) == "--tise")
             do_tise = true;
     }
+    // dry run: --estimate [ranks] [TDSE.h5 of earlier runs ...]
+    for (int i = 0; i < argc; i++) {
+        if (ToLower(std::string(args[i])) == "-estimate" ||
+            ToLower(std::string(args[i])) == "--estimate") {
+            do_estimate = true;
+            for (int j = i+1; j < argc && args[j][0] != '-'; j++) {
+                std::string arg = args[j];
+                if (std::all_of(arg.begin(), arg.end(), ::isdigit))
+                    estimate_ranks = std::stoi(arg);
+                else
+                    calibration.push_back(arg);
+            }
+        }
+    }
 
     if (do_tise) {
         Profile::Push("Total TISE time");
@@ -40,14 +58,23 @@ int main(int argc, char **args) {
         Profile::Push("Total TDSE time");
         if (!ValidateTDSEInputFile(argc, args, "input.json", matLib, tdse))
             return -1;
+
+        // nothing is allocated and no output of earlier runs (profile.json) is touched
+        if (do_estimate) {
+            tdse->Estimate(estimate_ranks > 0 ? estimate_ranks : matLib->Size(), calibration);
+            matLib->Shutdown();
+            return 0;
+        }
         
         LOG_INFO("Starting up TDSE");
         tdse->Initialize();
         tdse->Propagate();
         Profile::Pop("Total TDSE time");
     }
+    Memory::Report("shutdown");
     LOG_INFO("Shutting down.\n------------------------------------------------\n\n");
     Profile::PrintTo("profile.txt");
+    Profile::TraceTo("profile.json");
     
     matLib->Shutdown();
 
@@ -0,0 +1,158 @@
+#include "math_libs/petsc/petsc_lib.h"
+#include <petscblaslapack.h>
+#include <cmath>
+
+using namespace std::complex_literals;
+
+PetscBlockSpectralPropagator::PetscBlockSpectralPropagator(const Matrix H, const Matrix S, int blockSize) :
+    _blockSize(blockSize), _scatter(0), _local(0) {
+    PetscErrorCode ierr;
+    PetscMPIInt rank, size;
+    Mat Hmat = std::dynamic_pointer_cast<PetscMatrix>(H)->_petsc_mat;
+    Mat Smat = std::dynamic_pointer_cast<PetscMatrix>(S)->_petsc_mat;
+    Mat *subH, *subS;
+    std::vector<IS> rows;
+    std::vector<PetscInt> indices;
+    IS is;
+    Vec global;
+
+    ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
+    ierr = MPI_Comm_size(PETSC_COMM_WORLD, &size);PETSCASSERT(ierr);
+
+    // the (l,m)-blocks are independent, so they are handed out to the ranks in turn
+    int numBlocks = H->Rows()/blockSize;
+    for (int b = rank; b < numBlocks; b += size) {
+        Block block;
+        block.offset = indices.size();
+        _blocks.push_back(block);
+        for (int i = 0; i < blockSize; i++)
+            indices.push_back(b*blockSize + i);
+
+        ierr = ISCreateStride(PETSC_COMM_SELF, blockSize, b*blockSize, 1, &is);PETSCASSERT(ierr);
+        rows.push_back(is);
+    }
+
+    // every rank gets a sequential copy of its diagonal blocks
+    ierr = MatCreateSubMatrices(Hmat, rows.size(), rows.data(), rows.data(), MAT_INITIAL_MATRIX, &subH);PETSCASSERT(ierr);
+    ierr = MatCreateSubMatrices(Smat, rows.size(), rows.data(), rows.data(), MAT_INITIAL_MATRIX, &subS);PETSCASSERT(ierr);
+    int failed = 0;
+    for (int b = 0; b < _blocks.size(); b++)
+        if (!Diagonalize(subH[b], subS[b], _blocks[b]))
+            failed++;
+    ierr = MatDestroySubMatrices(rows.size(), &subH);PETSCASSERT(ierr);
+    ierr = MatDestroySubMatrices(rows.size(), &subS);PETSCASSERT(ierr);
+    for (auto& r : rows) {
+        ierr = ISDestroy(&r);PETSCASSERT(ierr);
+    }
+    if (failed > 0)
+        LOG_CRITICAL("Spectral propagator: " + std::to_string(failed) + " block(s) could not be diagonalized.");
+
+    // growing eigenvalues can only come from round off, but they blow up long jumps
+    double growth = 0.;
+    for (auto& b : _blocks)
+        for (auto& e : b.energies)
+            growth = std::max(growth, e.imag());
+    ierr = MPI_Allreduce(MPI_IN_PLACE, &growth, 1, MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    if (growth > 1e-8)
+        LOG_WARN("Spectral propagator: eigenvalues with Im(E) up to " + std::to_string(growth) + " - the norm grows with time.");
+
+    size_t bytes = _blocks.size()*size_t(3*blockSize + 2*blockSize*blockSize)*sizeof(complex);
+    LOG_INFO("Spectral propagator: " + std::to_string(numBlocks) + " block(s), "
+            + std::to_string(bytes/1024./1024./1024.) + " GB on rank 0.");
+
+    ierr = ISCreateGeneral(PETSC_COMM_SELF, indices.size(), indices.data(), PETSC_COPY_VALUES, &is);PETSCASSERT(ierr);
+    ierr = VecCreateSeq(PETSC_COMM_SELF, indices.size(), &_local);PETSCASSERT(ierr);
+    ierr = MatCreateVecs(Hmat, &global, NULL);PETSCASSERT(ierr);
+    ierr = VecScatterCreate(global, is, _local, NULL, &_scatter);PETSCASSERT(ierr);
+    ierr = ISDestroy(&is);PETSCASSERT(ierr);
+    ierr = VecDestroy(&global);PETSCASSERT(ierr);
+}
+PetscBlockSpectralPropagator::~PetscBlockSpectralPropagator() {
+    VecScatterDestroy(&_scatter);
+    VecDestroy(&_local);
+}
+
+// S^-1 H = V diag(E) V^-1 with LAPACK
+bool PetscBlockSpectralPropagator::Diagonalize(Mat H, Mat S, Block& block) {
+    PetscErrorCode ierr;
+    PetscInt ncols;
+    const PetscInt* cols;
+    const PetscScalar* vals;
+    PetscBLASInt n, lwork, info;
+    int N = _blockSize;
+
+    std::vector<complex> h(N*N, 0.), s(N*N, 0.);
+    for (int r = 0; r < N; r++) {
+        ierr = MatGetRow(H, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+        for (int k = 0; k < ncols; k++)
+            h[r + cols[k]*N] = vals[k];
+        ierr = MatRestoreRow(H, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+        ierr = MatGetRow(S, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+        for (int k = 0; k < ncols; k++)
+            s[r + cols[k]*N] = vals[k];
+        ierr = MatRestoreRow(S, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+    }
+
+    ierr = PetscBLASIntCast(N, &n);PETSCASSERT(ierr);
+    lwork = 4*n;
+    std::vector<PetscBLASInt> pivots(N);
+    std::vector<complex> work(lwork);
+    std::vector<PetscReal> rwork(2*N);
+
+    // h = S^-1 H
+    LAPACKgesv_(&n, &n, s.data(), &n, pivots.data(), h.data(), &n, &info);
+    if (info != 0) return false;
+
+    block.energies.resize(N);
+    block.vectors.resize(N*N);
+    LAPACKgeev_("N", "V", &n, h.data(), &n, block.energies.data(), NULL, &n, block.vectors.data(), &n, work.data(), &lwork, rwork.data(), &info);
+    if (info != 0) return false;
+
+    // V^-1 (s is free again)
+    block.inverse.assign(N*N, 0.);
+    for (int i = 0; i < N; i++)
+        block.inverse[i + i*N] = 1.;
+    s = block.vectors;
+    LAPACKgesv_(&n, &n, s.data(), &n, pivots.data(), block.inverse.data(), &n, &info);
+
+    block.coeffs.assign(N, 0.);
+    return info == 0;
+}
+
+void PetscBlockSpectralPropagator::SetState(const Vector psi) {
+    PetscErrorCode ierr;
+    PetscScalar* ptr;
+    PetscBLASInt n, one = 1;
+    PetscScalar alpha = 1., beta = 0.;
+    Vec x = std::dynamic_pointer_cast<PetscVector>(psi)->_petsc_vec;
+
+    ierr = PetscBLASIntCast(_blockSize, &n);PETSCASSERT(ierr);
+    ierr = VecScatterBegin(_scatter, x, _local, INSERT_VALUES, SCATTER_FORWARD);PETSCASSERT(ierr);
+    ierr = VecScatterEnd(_scatter, x, _local, INSERT_VALUES, SCATTER_FORWARD);PETSCASSERT(ierr);
+
+    ierr = VecGetArray(_local, &ptr);PETSCASSERT(ierr);
+    for (auto& b : _blocks)
+        BLASgemv_("N", &n, &n, &alpha, b.inverse.data(), &n, ptr + b.offset, &one, &beta, b.coeffs.data(), &one);
+    ierr = VecRestoreArray(_local, &ptr);PETSCASSERT(ierr);
+}
+
+void PetscBlockSpectralPropagator::Evolve(double t, Vector psi) {
+    PetscErrorCode ierr;
+    PetscScalar* ptr;
+    PetscBLASInt n, one = 1;
+    PetscScalar alpha = 1., beta = 0.;
+    Vec x = std::dynamic_pointer_cast<PetscVector>(psi)->_petsc_vec;
+    std::vector<complex> z(_blockSize);
+
+    ierr = PetscBLASIntCast(_blockSize, &n);PETSCASSERT(ierr);
+    ierr = VecGetArray(_local, &ptr);PETSCASSERT(ierr);
+    for (auto& b : _blocks) {
+        for (int i = 0; i < _blockSize; i++)
+            z[i] = std::exp(-1.i*b.energies[i]*t)*b.coeffs[i];
+        BLASgemv_("N", &n, &n, &alpha, b.vectors.data(), &n, z.data(), &one, &beta, ptr + b.offset, &one);
+    }
+    ierr = VecRestoreArray(_local, &ptr);PETSCASSERT(ierr);
+
+    ierr = VecScatterBegin(_scatter, _local, x, INSERT_VALUES, SCATTER_REVERSE);PETSCASSERT(ierr);
+    ierr = VecScatterEnd(_scatter, _local, x, INSERT_VALUES, SCATTER_REVERSE);PETSCASSERT(ierr);
+}
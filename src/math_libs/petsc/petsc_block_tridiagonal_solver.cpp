@@ -0,0 +1,547 @@
+#include "math_libs/petsc/petsc_lib.h"
+#include <algorithm>
+#include <cmath>
+
+
+PetscBlockTridiagonalSolver::PetscBlockTridiagonalSolver(const Matrix base, const std::vector<Matrix>& terms, int blockSize, int bandwidth, bool diagonalOnly) :
+    _blockSize(blockSize), _bandwidth(bandwidth), _numBlocks(base->Rows()/blockSize),
+    _factored(false), _diagonal_only(diagonalOnly), _valid(false), _memory_id(-1),
+    _straddling(false), _local_size(0), _scatter(0), _local(0), _reduced_rows(0), _reduced_elements(0) {
+    PetscErrorCode ierr;
+    PetscMPIInt rank, size;
+    const PetscInt* ranges;
+    IS is;
+    Vec global;
+
+    ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
+    ierr = MPI_Comm_size(PETSC_COMM_WORLD, &size);PETSCASSERT(ierr);
+
+    std::vector<Mat> mats = {std::dynamic_pointer_cast<PetscMatrix>(base)->_petsc_mat};
+    for (auto& term : terms)
+        mats.push_back(std::dynamic_pointer_cast<PetscMatrix>(term)->_petsc_mat);
+    ierr = MatGetOwnershipRanges(mats[0], &ranges);PETSCASSERT(ierr);
+    int row_start = ranges[rank], row_end = ranges[rank+1];
+
+    // our rows of the (lower, diagonal, upper) blocks, of every matrix one after the other
+    int width = 3*(2*_bandwidth+1), stride = width*mats.size();
+    std::vector<complex> rows(size_t(row_end - row_start)*stride, 0.);
+    int outside = 0;
+    _coupled.assign(_numBlocks, 0);
+    for (int k = 0; k < mats.size(); k++)
+        outside += ReadRows(mats[k], row_start, row_end, rows.data() + k*width, stride);
+    ierr = MPI_Allreduce(MPI_IN_PLACE, &outside, 1, MPI_INT, MPI_SUM, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    if (outside > 0) {
+        LOG_CRITICAL("Block tridiagonal solver: " + std::to_string(outside) + " elements outside of the block structure, the matrix is not block tridiagonal.");
+        return;
+    }
+    ierr = MPI_Allreduce(MPI_IN_PLACE, _coupled.data(), _numBlocks, MPI_INT, MPI_MAX, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+
+    // Split into chains of coupled blocks (one per m for z-polarization).
+    // A chain is solved by the rank that owns most of its rows, the others
+    // send it the few rows they own. A long chain over several ranks is
+    // instead split by radial index among them: the parts only couple
+    // through kd rows at their ends, where a split over blocks (l) would
+    // couple whole blocks. The cost of the separators, parts*kd rows of
+    // bandwidth 2kd, stays below that of a part (n/parts rows of bandwidth
+    // kd) for up to sqrt(n/kd) parts.
+    struct Layout {
+        int first, last, kd;
+        std::vector<int> ranks;                 // of the parts, by radial index
+        std::vector<int> start;                 // radial index of each part, and the end
+    };
+    std::vector<Layout> layouts;
+    std::vector<int> layout_of(_numBlocks);
+    for (int first = 0; first < _numBlocks;) {
+        Layout l;
+        l.first = first;
+        l.last = first;
+        while (l.last+1 < _numBlocks && IsCoupled(l.last))
+            l.last++;
+        std::fill(layout_of.begin() + first, layout_of.begin() + l.last+1, layouts.size());
+
+        int nb = l.last - first + 1, n = nb*_blockSize;
+        int row0 = first*_blockSize, row1 = (l.last+1)*_blockSize;
+        l.kd = _bandwidth*nb + (nb > 1 ? 1 : 0);
+
+        std::vector<std::pair<int, int>> owners;        // (rows, rank), most rows first
+        for (int p = 0; p < size; p++) {
+            int count = std::min<int>(row1, ranges[p+1]) - std::max<int>(row0, ranges[p]);
+            if (count > 0)
+                owners.push_back({-count, p});
+        }
+        std::sort(owners.begin(), owners.end());
+        int min_part = (2*l.kd + nb-1)/nb;              // radial indices, a part must hold a separator and couple to one
+        int parts = (l.kd == 0 ? 1 : std::min<int>({(int)owners.size(), (int)std::sqrt(double(n)/l.kd), _blockSize/min_part}));
+        if (parts < 2) {
+            l.ranks = {owners[0].second};
+            l.start = {0, _blockSize};
+        } else {
+            for (int q = 0; q < parts; q++)
+                l.ranks.push_back(owners[q].second);
+            std::sort(l.ranks.begin(), l.ranks.end());
+            for (int q = 0; q <= parts; q++)
+                l.start.push_back(q*_blockSize/parts);
+        }
+        layouts.push_back(l);
+        first = l.last+1;
+    }
+
+    std::vector<PetscInt> indices;
+    int offset = 0, split = 0;
+    size_t cached = 0;
+    _straddling = false;
+    _reduced_rows = 0;
+    _reduced_elements = 0;
+    for (auto& l : layouts) {
+        int nb = l.last - l.first + 1, parts = l.ranks.size();
+        int row0 = l.first*_blockSize, row1 = (l.last+1)*_blockSize;
+        int part = std::find(l.ranks.begin(), l.ranks.end(), rank) - l.ranks.begin();
+        bool in_place = (parts == 1 && row0 >= ranges[l.ranks[0]] && row1 <= ranges[l.ranks[0]+1]);
+        _straddling = _straddling || !in_place;
+
+        if (part < parts) {
+            Chain c;
+            c.first_block = l.first;
+            c.num_blocks = nb;
+            c.kd = l.kd;
+            c.part = part;
+            c.parts = parts;
+            c.i0 = l.start[part];
+            c.i1 = l.start[part+1];
+            c.cache_i0 = (part > 0 ? c.i0 - (l.kd + nb-1)/nb : c.i0);
+            c.cache_offset = cached;
+            c.offset = offset;
+            cached += size_t(nb)*3*(c.i1 - c.cache_i0)*(2*_bandwidth+1);
+
+            // Ordered by radial index first and block second the chain is a
+            // single band matrix: row p = i*num_blocks + b.
+            int n = nb*(c.i1 - c.i0);
+            c.interior = n - (part < parts-1 ? l.kd : 0);
+            c.lu.Resize(c.interior, l.kd, l.kd);
+            if (parts > 1) {
+                c.reduced_offset = _reduced_rows;
+                c.reduced_elements = _reduced_elements;
+                c.reduced.Resize((parts-1)*l.kd, 2*l.kd-1, 2*l.kd-1);
+            }
+
+            // our own rows are read and written in place, the others through the scatter
+            c.in_place = in_place;
+            c.rows = (in_place ? row0 - row_start : indices.size());
+            if (!in_place)
+                for (int b = 0; b < nb; b++)
+                    for (int i = c.i0; i < c.i1; i++)
+                        indices.push_back((l.first + b)*_blockSize + i);
+
+            offset += n;
+            _chains.push_back(std::move(c));
+        }
+        if (parts > 1) {
+            split++;
+            _reduced_rows += (parts-1)*l.kd;
+            _reduced_elements += size_t(parts-1)*l.kd*(4*l.kd-1);
+        }
+    }
+    _local_size = offset;
+
+    // the rows of other ranks' chains, in order of the row: to the part
+    // that holds it, and to the next part if that couples to it
+    std::vector<std::vector<complex>> outgoing(size);
+    for (int r = row_start; r < row_end; r++) {
+        const Layout& l = layouts[layout_of[r / _blockSize]];
+        int nb = l.last - l.first + 1, i = r % _blockSize;
+        int q = std::upper_bound(l.start.begin(), l.start.end(), i) - l.start.begin() - 1;
+        std::vector<int> dest = {l.ranks[q]};
+        if (q+1 < l.ranks.size() && i >= l.start[q+1] - (l.kd + nb-1)/nb)
+            dest.push_back(l.ranks[q+1]);
+        for (int p : dest)
+            if (p != rank)
+                outgoing[p].insert(outgoing[p].end(), rows.begin() + size_t(r - row_start)*stride, rows.begin() + size_t(r - row_start + 1)*stride);
+    }
+    std::vector<int> send_counts(size), send_offsets(size), recv_counts(size), recv_offsets(size);
+    std::vector<complex> send, recv;
+    for (int p = 0; p < size; p++) {
+        send_counts[p] = outgoing[p].size();
+        send_offsets[p] = send.size();
+        send.insert(send.end(), outgoing[p].begin(), outgoing[p].end());
+    }
+    ierr = MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    for (int p = 0, n = 0; p < size; n += recv_counts[p], p++)
+        recv_offsets[p] = n;
+    recv.resize(recv_offsets[size-1] + recv_counts[size-1]);
+    ierr = MPI_Alltoallv(send.data(), send_counts.data(), send_offsets.data(), MPIU_SCALAR,
+                         recv.data(), recv_counts.data(), recv_offsets.data(), MPIU_SCALAR, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+
+    // cache the blocks of our chains, from our rows or the ones received
+    int W = 2*_bandwidth+1;
+    std::vector<int> received(size, 0);
+    _blocks.assign(mats.size(), std::vector<complex>(cached, 0.));
+    for (auto& c : _chains) {
+        for (int b = 0; b < c.num_blocks; b++) {
+            for (int i = c.cache_i0; i < c.i1; i++) {
+                int r = (c.first_block + b)*_blockSize + i;
+                const complex* row;
+                if (r >= row_start && r < row_end) {
+                    row = rows.data() + size_t(r - row_start)*stride;
+                } else {
+                    int p = std::upper_bound(ranges, ranges + size + 1, r) - ranges - 1;
+                    row = recv.data() + recv_offsets[p] + size_t(received[p]++)*stride;
+                }
+                for (int k = 0; k < mats.size(); k++)
+                    for (int offset = -1; offset <= 1; offset++)
+                        std::copy(row + k*width + (offset+1)*W, row + k*width + (offset+2)*W, &Cached(_blocks[k], c, b, offset, i, i-_bandwidth));
+            }
+        }
+    }
+
+    size_t bytes = 0;
+    for (auto& c : _chains)
+        bytes += c.lu.Bytes() + c.reduced.Bytes();
+    for (auto& b : _blocks)
+        bytes += b.size()*sizeof(complex);
+    LOG_INFO("Block tridiagonal solver: " + std::to_string(layouts.size()) + " chain(s), " + std::to_string(split) + " split over ranks, "
+            + std::to_string(bytes/1024./1024./1024.) + " GB on rank 0.");
+    _memory_id = Memory::Register("block LU", offset, 0, bytes + (offset + indices.size())*sizeof(PetscScalar));
+    _coeffs.resize(terms.size(), 0.);
+    _valid = true;
+
+    // gathers/scatters the rows of the chains that straddle ranks (empty on most)
+    ierr = ISCreateGeneral(PETSC_COMM_SELF, indices.size(), indices.data(), PETSC_COPY_VALUES, &is);PETSCASSERT(ierr);
+    ierr = VecCreateSeq(PETSC_COMM_SELF, indices.size(), &_local);PETSCASSERT(ierr);
+    ierr = MatCreateVecs(mats[0], &global, NULL);PETSCASSERT(ierr);
+    ierr = VecScatterCreate(global, is, _local, NULL, &_scatter);PETSCASSERT(ierr);
+    ierr = ISDestroy(&is);PETSCASSERT(ierr);
+    ierr = VecDestroy(&global);PETSCASSERT(ierr);
+}
+PetscBlockTridiagonalSolver::~PetscBlockTridiagonalSolver() {
+    VecScatterDestroy(&_scatter);
+    VecDestroy(&_local);
+    Memory::Release(_memory_id);
+}
+bool PetscBlockTridiagonalSolver::Valid() const {
+    return _valid;
+}
+
+complex& PetscBlockTridiagonalSolver::Cached(std::vector<complex>& blocks, const Chain& c, int b, int offset, int i, int j) {
+    // block b of the chain, offset = -1, 0, 1 for the block left of, on and right of the diagonal
+    size_t n = c.i1 - c.cache_i0;
+    return blocks[c.cache_offset + ((b*3 + offset+1)*n + i - c.cache_i0)*(2*_bandwidth+1) + (j-i+_bandwidth)];
+}
+
+// rows[(r-row_start)*stride + (offset+1)*(2*bandwidth+1) + j-i+bandwidth] for the
+// rows of this rank. Returns the number of nonzeros that do not fit in there.
+int PetscBlockTridiagonalSolver::ReadRows(Mat A, int row_start, int row_end, complex* rows, int stride) {
+    PetscErrorCode ierr;
+    PetscInt ncols;
+    const PetscInt* cols;
+    const PetscScalar* vals;
+    int outside = 0, W = 2*_bandwidth+1;
+
+    for (int r = row_start; r < row_end; r++) {
+        int block = r / _blockSize, i = r % _blockSize;
+        complex* row = rows + size_t(r - row_start)*stride;
+
+        ierr = MatGetRow(A, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+        for (int n = 0; n < ncols; n++) {
+            int offset = cols[n] / _blockSize - block, j = cols[n] % _blockSize;
+
+            if (std::abs(offset) <= 1 && std::abs(j-i) <= _bandwidth) {
+                row[(offset+1)*W + j-i+_bandwidth] = vals[n];
+                if (offset != 0 && vals[n] != 0.)
+                    _coupled[std::min(block, block+offset)] = 1;
+            } else if (vals[n] != 0.) {
+                outside++;
+            }
+        }
+        ierr = MatRestoreRow(A, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+    }
+    return outside;
+}
+
+bool PetscBlockTridiagonalSolver::IsCoupled(int block) {
+    return !_diagonal_only && _coupled[block];
+}
+
+void PetscBlockTridiagonalSolver::SetCoefficients(const std::vector<complex>& coeffs) {
+    if (_factored && coeffs == _coeffs)
+        return;                                 // e.g. the field is off - keep the factors
+    _coeffs = coeffs;
+    _factored = false;
+}
+
+bool PetscBlockTridiagonalSolver::Factor() {
+    PetscErrorCode ierr;
+    int success = 1;
+    std::vector<complex> reduced(_reduced_elements, 0.);     // the Schur complements, banded
+
+    for (auto& c : _chains) {
+        int nb = c.num_blocks, kd = c.kd;
+
+        // f(column, value) for row p of the chain (band order), rebuilt
+        // from the cached blocks: base + sum_k c_k*term_k
+        auto row = [&](int p, auto f) {
+            int i = p / nb, b = p % nb;
+            int jmin = std::max(0, i-_bandwidth), jmax = std::min(_blockSize-1, i+_bandwidth);
+            for (int offset = -1; offset <= 1; offset++) {
+                if (b+offset < 0 || b+offset >= nb) continue;
+
+                for (int j = jmin; j <= jmax; j++) {
+                    complex value = Cached(_blocks[0], c, b, offset, i, j);
+                    for (int k = 0; k < _coeffs.size(); k++)
+                        value += _coeffs[k]*Cached(_blocks[k+1], c, b, offset, i, j);
+                    f(j*nb + b+offset, value);
+                }
+            }
+        };
+
+        // the chain, or the interior I of our part
+        int a = c.i0*nb, e = a + c.interior;
+        c.lu.Zero();
+        for (int p = a; p < e; p++)
+            row(p, [&](int q, complex value) {
+                if (q >= a && q < e)
+                    c.lu(p-a, q-a) = value;
+            });
+        if (!c.lu.Factor()) {
+            success = 0;
+            continue;
+        }
+        if (c.parts == 1)
+            continue;
+
+        // the couplings of I to the separators above and below it
+        bool above = (c.part > 0), below = (c.part < c.parts-1);
+        auto dense = [&](int row0, int col0, std::vector<complex>& M) {
+            M.assign(size_t(kd)*kd, 0.);
+            for (int r = 0; r < kd; r++)
+                row(row0 + r, [&](int q, complex value) {
+                    if (q >= col0 && q < col0 + kd)
+                        M[size_t(r)*kd + q-col0] = value;
+                });
+        };
+        if (above) {
+            dense(a, a-kd, c.above_in);
+            dense(a-kd, a, c.above_sep);
+        }
+        if (below) {
+            dense(e-kd, e, c.below_in);
+            dense(e, e-kd, c.below_sep);
+        }
+
+        // Our share of the Schur complement A(S,S) - A(S,I) A(I,I)^-1 A(I,S)
+        // on the separators S above and below I. A(I,S) only has kd nonzero
+        // rows at either end, and only those rows of the solution are needed:
+        // it is solved a few columns at a time.
+        complex* schur = reduced.data() + c.reduced_elements;
+        int m = c.interior, width = 4*kd-1, s_above = (c.part-1)*kd, s_below = c.part*kd;
+        auto add = [&](int row, int col, complex value) {
+            schur[size_t(row)*width + col-row + 2*kd-1] += value;
+        };
+        int ncols = (above ? kd : 0) + (below ? kd : 0), chunk = 16;
+        std::vector<complex> X;
+        for (int col0 = 0; col0 < ncols; col0 += chunk) {
+            int nc = std::min(chunk, ncols - col0);
+            X.assign(size_t(m)*nc, 0.);
+            for (int t = 0; t < nc; t++) {
+                int col = col0 + t;
+                if (above && col < kd)
+                    for (int r = 0; r < kd; r++)
+                        X[size_t(r)*nc + t] = c.above_in[size_t(r)*kd + col];
+                else
+                    for (int r = 0; r < kd; r++)
+                        X[size_t(m-kd+r)*nc + t] = c.below_in[size_t(r)*kd + col - (above ? kd : 0)];
+            }
+            c.lu.Solve(X.data(), nc);
+
+            for (int t = 0; t < nc; t++) {
+                int col = col0 + t, s = (above && col < kd ? s_above + col : s_below + col - (above ? kd : 0));
+                for (int r = 0; r < kd; r++) {
+                    complex sum = 0.;
+                    if (above) {
+                        for (int u = 0; u < kd; u++)
+                            sum += c.above_sep[size_t(r)*kd + u]*X[size_t(u)*nc + t];
+                        add(s_above + r, s, -sum);
+                    }
+                    if (below) {
+                        sum = 0.;
+                        for (int u = 0; u < kd; u++)
+                            sum += c.below_sep[size_t(r)*kd + u]*X[size_t(m-kd+u)*nc + t];
+                        add(s_below + r, s, -sum);
+                    }
+                }
+            }
+        }
+        if (below)
+            for (int r = 0; r < kd; r++)
+                row(e + r, [&](int q, complex value) {
+                    if (q >= e && q < e + kd)
+                        add(s_below + r, s_below + q-e, value);
+                });
+    }
+
+    // every part adds its share, then all of them factor the whole complement
+    if (_reduced_elements > 0) {
+        ierr = MPI_Allreduce(MPI_IN_PLACE, reduced.data(), 2*reduced.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+        for (auto& c : _chains) {
+            if (c.parts == 1) continue;
+
+            int kd = c.kd, n = c.reduced.Size(), width = 4*kd-1;
+            const complex* schur = reduced.data() + c.reduced_elements;
+            c.reduced.Zero();
+            for (int r = 0; r < n; r++)
+                for (int col = std::max(0, r-2*kd+1); col <= std::min(n-1, r+2*kd-1); col++)
+                    c.reduced(r, col) = schur[size_t(r)*width + col-r + 2*kd-1];
+            if (!c.reduced.Factor())
+                success = 0;
+        }
+    }
+    // all ranks must agree before the (collective) scatter in Solve
+    ierr = MPI_Allreduce(MPI_IN_PLACE, &success, 1, MPI_INT, MPI_MIN, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    _factored = (success == 1);
+
+    // nothing to recombine without terms, the factors are all that is needed
+    if (_factored && _coeffs.empty() && !_blocks[0].empty()) {
+        size_t bytes = _local_size*sizeof(PetscScalar);
+        for (auto& c : _chains)
+            bytes += c.lu.Bytes() + c.reduced.Bytes()
+                   + (c.above_in.size() + c.above_sep.size() + c.below_in.size() + c.below_sep.size())*sizeof(complex);
+        std::vector<std::vector<complex>>(_blocks.size()).swap(_blocks);
+        Memory::Update(_memory_id, 0, bytes);
+    }
+    return _factored;
+}
+
+bool PetscBlockTridiagonalSolver::Solve(const Vector b, Vector x) {
+    auto petscb = std::dynamic_pointer_cast<PetscVector>(b);
+    auto petscx = std::dynamic_pointer_cast<PetscVector>(x);
+
+    return Solve(std::vector<Vec>{petscb->_petsc_vec}, std::vector<Vec>{petscx->_petsc_vec});
+}
+bool PetscBlockTridiagonalSolver::Solve(Vec b, Vec x) {
+    return Solve(std::vector<Vec>{b}, std::vector<Vec>{x});
+}
+bool PetscBlockTridiagonalSolver::Solve(const std::vector<Vector>& b, std::vector<Vector>& x) {
+    std::vector<Vec> petscb, petscx;
+    for (int k = 0; k < b.size(); k++) {
+        petscb.push_back(std::dynamic_pointer_cast<PetscVector>(b[k])->_petsc_vec);
+        petscx.push_back(std::dynamic_pointer_cast<PetscVector>(x[k])->_petsc_vec);
+    }
+    return Solve(petscb, petscx);
+}
+
+// The right hand sides are interleaved so every element of the factors is
+// used for all of them while it is in cache. Only the chains that straddle
+// ranks go through the scatter (split or not), the rest is read and written in place
+// (b and x may be the same vector).
+bool PetscBlockTridiagonalSolver::Solve(const std::vector<Vec>& b, const std::vector<Vec>& x) {
+    PetscErrorCode ierr;
+    const PetscScalar* in;
+    PetscScalar *ptr, *local;
+    int nrhs = b.size();
+
+    if (!_factored && !Factor()) {
+        LOG_CRITICAL("Block tridiagonal solver: singular matrix.");
+        return false;
+    }
+
+    // row p of (our part of) a chain in band order is row (p % num_blocks)*ni + p/num_blocks
+    // of it, for ni radial indices
+    auto copy = [&](PetscScalar* vec, PetscScalar* local, int k, bool into_rhs) {
+        for (auto& c : _chains) {
+            PetscScalar* rows = (c.in_place ? vec : local) + c.rows;
+            complex* rhs = _rhs.data() + size_t(c.offset)*nrhs + k;
+            int nb = c.num_blocks, ni = c.i1 - c.i0, n = nb*ni;
+            for (int p = 0; p < n; p++) {
+                PetscScalar& row = rows[(p % nb)*ni + p / nb];
+                if (into_rhs)
+                    rhs[size_t(p)*nrhs] = row;
+                else
+                    row = rhs[size_t(p)*nrhs];
+            }
+        }
+    };
+
+    _rhs.resize(size_t(_local_size)*nrhs);
+    for (int k = 0; k < nrhs; k++) {
+        if (_straddling) {
+            ierr = VecScatterBegin(_scatter, b[k], _local, INSERT_VALUES, SCATTER_FORWARD);PETSCASSERT(ierr);
+            ierr = VecScatterEnd(_scatter, b[k], _local, INSERT_VALUES, SCATTER_FORWARD);PETSCASSERT(ierr);
+        }
+        ierr = VecGetArrayRead(b[k], &in);PETSCASSERT(ierr);          // b is locked read only in a PC apply
+        ierr = VecGetArray(_local, &local);PETSCASSERT(ierr);
+        copy(const_cast<PetscScalar*>(in), local, k, true);
+        ierr = VecRestoreArray(_local, &local);PETSCASSERT(ierr);
+        ierr = VecRestoreArrayRead(b[k], &in);PETSCASSERT(ierr);
+    }
+
+    // the chains, and the separators of the split ones: f(S) - A(S,I) A(I,I)^-1 f(I)
+    std::vector<complex> y;
+    _reduced_rhs.assign(size_t(_reduced_rows)*nrhs, 0.);
+    for (auto& c : _chains) {
+        complex* f = _rhs.data() + size_t(c.offset)*nrhs;
+        if (c.parts == 1) {
+            c.lu.Solve(f, nrhs);
+            continue;
+        }
+
+        int kd = c.kd, m = c.interior;
+        complex* g = _reduced_rhs.data() + size_t(c.reduced_offset)*nrhs;
+        y.assign(f, f + size_t(m)*nrhs);
+        c.lu.Solve(y.data(), nrhs);
+        for (int r = 0; r < kd; r++) {
+            for (int k = 0; k < nrhs; k++) {
+                if (c.part > 0) {
+                    complex sum = 0.;
+                    for (int u = 0; u < kd; u++)
+                        sum += c.above_sep[size_t(r)*kd + u]*y[size_t(u)*nrhs + k];
+                    g[size_t((c.part-1)*kd + r)*nrhs + k] -= sum;
+                }
+                if (c.part < c.parts-1) {
+                    complex sum = f[size_t(m+r)*nrhs + k];
+                    for (int u = 0; u < kd; u++)
+                        sum -= c.below_sep[size_t(r)*kd + u]*y[size_t(m-kd+u)*nrhs + k];
+                    g[size_t(c.part*kd + r)*nrhs + k] += sum;
+                }
+            }
+        }
+    }
+
+    // the separators, then the interiors with them known
+    if (_reduced_rows > 0) {
+        ierr = MPI_Allreduce(MPI_IN_PLACE, _reduced_rhs.data(), 2*_reduced_rhs.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+        for (auto& c : _chains) {
+            if (c.parts == 1) continue;
+
+            int kd = c.kd, m = c.interior, above = (c.part-1)*kd, below = c.part*kd;
+            complex* f = _rhs.data() + size_t(c.offset)*nrhs;
+            complex* g = _reduced_rhs.data() + size_t(c.reduced_offset)*nrhs;
+            y.assign(g, g + size_t(c.reduced.Size())*nrhs);
+            c.reduced.Solve(y.data(), nrhs);
+            for (int r = 0; r < kd; r++) {
+                for (int k = 0; k < nrhs; k++) {
+                    if (c.part > 0)
+                        for (int u = 0; u < kd; u++)
+                            f[size_t(r)*nrhs + k] -= c.above_in[size_t(r)*kd + u]*y[size_t(above + u)*nrhs + k];
+                    if (c.part < c.parts-1) {
+                        for (int u = 0; u < kd; u++)
+                            f[size_t(m-kd+r)*nrhs + k] -= c.below_in[size_t(r)*kd + u]*y[size_t(below + u)*nrhs + k];
+                        f[size_t(m+r)*nrhs + k] = y[size_t(below + r)*nrhs + k];
+                    }
+                }
+            }
+            c.lu.Solve(f, nrhs);
+        }
+    }
+
+    for (int k = 0; k < nrhs; k++) {
+        ierr = VecGetArray(x[k], &ptr);PETSCASSERT(ierr);
+        ierr = VecGetArray(_local, &local);PETSCASSERT(ierr);
+        copy(ptr, local, k, false);
+        ierr = VecRestoreArray(_local, &local);PETSCASSERT(ierr);
+        ierr = VecRestoreArray(x[k], &ptr);PETSCASSERT(ierr);
+        if (_straddling) {
+            ierr = VecScatterBegin(_scatter, _local, x[k], INSERT_VALUES, SCATTER_REVERSE);PETSCASSERT(ierr);
+            ierr = VecScatterEnd(_scatter, _local, x[k], INSERT_VALUES, SCATTER_REVERSE);PETSCASSERT(ierr);
+        }
+    }
+    return true;
+}
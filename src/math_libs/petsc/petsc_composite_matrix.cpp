@@ -0,0 +1,57 @@
+#include "math_libs/petsc/petsc_lib.h"
+
+
+PetscCompositeMatrix::PetscCompositeMatrix(const Matrix base, const std::vector<Matrix>& terms) : _base(base), _terms(terms) {
+    PetscErrorCode ierr;
+    PetscInt local_rows, local_cols;
+    auto petsc_base = std::dynamic_pointer_cast<PetscMatrix>(base);
+
+    _coeffs.resize(_terms.size(), 0.);
+
+    // same parallel layout as the base matrix so vectors can be shared
+    ierr = MatGetLocalSize(petsc_base->_petsc_mat, &local_rows, &local_cols);PETSCASSERT(ierr);
+    ierr = MatCreateShell(PETSC_COMM_WORLD, local_rows, local_cols, base->Rows(), base->Cols(), this, &_petsc_mat);PETSCASSERT(ierr);
+    ierr = MatShellSetOperation(_petsc_mat, MATOP_MULT, (void(*)(void))ShellMult);PETSCASSERT(ierr);
+    ierr = MatCreateVecs(petsc_base->_petsc_mat, NULL, &_work);PETSCASSERT(ierr);
+    ierr = MatGetOwnershipRange(_petsc_mat,&_row_start,&_row_end); PETSCASSERT(ierr);
+    _rows = base->Rows(); _cols = base->Cols();
+}
+PetscCompositeMatrix::~PetscCompositeMatrix() {
+    VecDestroy(&_work);
+}
+
+void PetscCompositeMatrix::SetCoefficients(const std::vector<complex>& coeffs) {
+    for (int k = 0; k < _coeffs.size() && k < coeffs.size(); k++)
+        _coeffs[k] = coeffs[k];
+}
+
+// y = base*x + sum_k c_k*(term_k*x)
+PetscErrorCode PetscCompositeMatrix::ShellMult(Mat A, Vec x, Vec y) {
+    PetscErrorCode ierr;
+    PetscCompositeMatrix* self;
+
+    ierr = MatShellGetContext(A, &self);CHKERRQ(ierr);
+    ierr = MatMult(std::dynamic_pointer_cast<PetscMatrix>(self->_base)->_petsc_mat, x, y);CHKERRQ(ierr);
+    for (int k = 0; k < self->_terms.size(); k++) {
+        if (self->_coeffs[k] == 0.)
+            continue;               // field is off, nothing to add
+        ierr = MatMult(std::dynamic_pointer_cast<PetscMatrix>(self->_terms[k])->_petsc_mat, x, self->_work);CHKERRQ(ierr);
+        ierr = VecAXPY(y, self->_coeffs[k], self->_work);CHKERRQ(ierr);
+    }
+    return 0;
+}
+
+// Y = base*X + sum_k c_k*(term_k*X) for all the columns of X at once
+void PetscCompositeMatrix::MultDense(Mat X, Mat* Y) {
+    PetscErrorCode ierr;
+    Mat work;
+
+    ierr = MatMatMult(std::dynamic_pointer_cast<PetscMatrix>(_base)->_petsc_mat, X, MAT_INITIAL_MATRIX, PETSC_DEFAULT, Y);PETSCASSERT(ierr);
+    for (int k = 0; k < _terms.size(); k++) {
+        if (_coeffs[k] == 0.)
+            continue;
+        ierr = MatMatMult(std::dynamic_pointer_cast<PetscMatrix>(_terms[k])->_petsc_mat, X, MAT_INITIAL_MATRIX, PETSC_DEFAULT, &work);PETSCASSERT(ierr);
+        ierr = MatAXPY(*Y, _coeffs[k], work, SAME_NONZERO_PATTERN);PETSCASSERT(ierr);
+        ierr = MatDestroy(&work);PETSCASSERT(ierr);
+    }
+}
@@ -41,6 +41,8 @@ void Petsc::Eigen(  const Matrix A, const Matrix S,
 
         MatCreateVecs(petscS->_petsc_mat, &temp->_petsc_vec, NULL);
         temp->_len = petscS->Rows();
+        temp->_memory_id = Memory::Register("vector", petscS->RowEnd() - petscS->RowStart(), 0,
+                double(petscS->RowEnd() - petscS->RowStart())*sizeof(PetscScalar));
         
         // get the eigen-pair
         EPSGetEigenpair(petsc_eps, j, &values[j], NULL, temp->_petsc_vec, NULL);
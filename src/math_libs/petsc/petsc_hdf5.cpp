@@ -1,6 +1,7 @@
 #include "math_libs/petsc/petsc_lib.h"
 
 #include <petscviewerhdf5.h>
+#include <algorithm>
 
 PetscHDF5::PetscHDF5() : _viewer(0) {}
 PetscHDF5::PetscHDF5(const std::string& filename, char mode) : _viewer(0) {
@@ -101,6 +102,73 @@ void PetscHDF5::ReadVector(const std::string& obj_name, Vector value) {
     PetscObjectSetName((PetscObject)petscVec->_petsc_vec, obj_name.c_str());
     VecLoad(petscVec->_petsc_vec, _viewer);
 }
+// Timestepped vectors go to datasets that are chunked and extended along
+// the first dimension. The values live on the first rank.
+void PetscHDF5::WriteRecord(const std::string& obj_name, const std::vector<double>& values, int index) {
+    PetscErrorCode ierr;
+    PetscMPIInt rank;
+    PetscScalar* array;
+    Vec record;
+
+    ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
+    ierr = VecCreateMPI(PETSC_COMM_WORLD, (rank == 0 ? values.size() : 0), values.size(), &record);PETSCASSERT(ierr);
+    ierr = VecGetArray(record, &array);PETSCASSERT(ierr);
+    if (rank == 0)
+        std::copy(values.begin(), values.end(), array);
+    ierr = VecRestoreArray(record, &array);PETSCASSERT(ierr);
+
+    PetscObjectSetName((PetscObject)record, obj_name.c_str());
+    ierr = PetscViewerHDF5PushTimestepping(_viewer);PETSCASSERT(ierr);
+    ierr = PetscViewerHDF5SetTimestep(_viewer, index);PETSCASSERT(ierr);
+    ierr = VecView(record, _viewer);PETSCASSERT(ierr);
+    ierr = PetscViewerHDF5PopTimestepping(_viewer);PETSCASSERT(ierr);
+
+    // the rows that belong to this run (a restart writes over the later ones)
+    PetscInt records = index+1;
+    ierr = PetscViewerHDF5WriteObjectAttribute(_viewer, (PetscObject)record, "records", PETSC_INT, &records);PETSCASSERT(ierr);
+    ierr = VecDestroy(&record);PETSCASSERT(ierr);
+}
+bool PetscHDF5::ReadRecords(const std::string& obj_name, std::vector<std::vector<double>>& rows) {
+    PetscErrorCode ierr;
+    PetscInt records = 0;
+    const PetscScalar* array;
+    Vec record, all = 0;
+    VecScatter scatter = 0;
+
+    rows.clear();
+    if (!HasVector(obj_name))
+        return false;
+
+    ierr = VecCreate(PETSC_COMM_WORLD, &record);PETSCASSERT(ierr);
+    ierr = PetscObjectSetName((PetscObject)record, obj_name.c_str());PETSCASSERT(ierr);
+    ierr = PetscViewerHDF5ReadObjectAttribute(_viewer, (PetscObject)record, "records", PETSC_INT, &records, &records);PETSCASSERT(ierr);
+
+    ierr = PetscViewerHDF5PushTimestepping(_viewer);PETSCASSERT(ierr);
+    for (PetscInt k = 0; k < records; k++) {
+        ierr = PetscViewerHDF5SetTimestep(_viewer, k);PETSCASSERT(ierr);
+        ierr = VecLoad(record, _viewer);PETSCASSERT(ierr);
+        if (!scatter) {
+            ierr = VecScatterCreateToAll(record, &scatter, &all);PETSCASSERT(ierr);
+        }
+        ierr = VecScatterBegin(scatter, record, all, INSERT_VALUES, SCATTER_FORWARD);PETSCASSERT(ierr);
+        ierr = VecScatterEnd(scatter, record, all, INSERT_VALUES, SCATTER_FORWARD);PETSCASSERT(ierr);
+
+        PetscInt length;
+        ierr = VecGetSize(all, &length);PETSCASSERT(ierr);
+        ierr = VecGetArrayRead(all, &array);PETSCASSERT(ierr);
+        std::vector<double> row(length);
+        for (PetscInt i = 0; i < length; i++)
+            row[i] = PetscRealPart(array[i]);
+        ierr = VecRestoreArrayRead(all, &array);PETSCASSERT(ierr);
+        rows.push_back(row);
+    }
+    ierr = PetscViewerHDF5PopTimestepping(_viewer);PETSCASSERT(ierr);
+
+    ierr = VecScatterDestroy(&scatter);PETSCASSERT(ierr);
+    ierr = VecDestroy(&all);PETSCASSERT(ierr);
+    ierr = VecDestroy(&record);PETSCASSERT(ierr);
+    return true;
+}
 bool PetscHDF5::HasVector(const std::string& obj_name) const {
     PetscBool has;
     PetscErrorCode ierr;
@@ -1,8 +1,53 @@
 #include "math_libs/petsc/petsc_lib.h"
 #include "utility/logger.h"
+#include <algorithm>
 
-bool Petsc::Startup(int argc, char **args) {
+bool Petsc::Startup(int argc, char **args, int groups, const std::vector<double>& weights) {
     PetscErrorCode ierr;
+
+    // Each group of consecutive ranks becomes PETSC_COMM_WORLD of its own,
+    // so everything built on it (matrices, solvers, output) stays in the group.
+    _group = 0;
+    _groups = 1;
+    if (groups > 1) {
+        PetscMPIInt world_rank, world_size;
+        MPI_Init(&argc, &args);
+        MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+        _groups = std::min(groups, int(world_size));
+        _group = world_rank*_groups/world_size;
+
+        // every group keeps one rank, the others go to the heaviest groups
+        // (largest remainder of its share of the weight). With fewer ranks
+        // than groups the k-th weight belongs to group k % groups.
+        if (!weights.empty()) {
+            std::vector<double> weight(_groups, 0.);
+            double total = 0;
+            for (int k = 0; k < weights.size(); k++) {
+                weight[k % _groups] += weights[k];
+                total += weights[k];
+            }
+            std::vector<int> ranks(_groups, 1);
+            std::vector<double> remainder(_groups);
+            int spare = world_size - _groups, given = 0;
+            for (int g = 0; g < _groups; g++) {
+                double share = spare*weight[g]/total;
+                ranks[g] += int(share);
+                given += int(share);
+                remainder[g] = share - int(share);
+            }
+            for (; given < spare; given++) {
+                int g = std::max_element(remainder.begin(), remainder.end()) - remainder.begin();
+                ranks[g]++;
+                remainder[g] = -1.;
+            }
+            for (int g = 0, first = 0; g < _groups; first += ranks[g], g++)
+                if (world_rank >= first && world_rank < first + ranks[g])
+                    _group = g;
+        }
+        MPI_Comm_split(MPI_COMM_WORLD, _group, world_rank, &PETSC_COMM_WORLD);
+    }
+
     ierr = PetscInitialize(&argc,&args,NULL,"Func Test\n"); 
     Log::info("Initializing PETsc.");
     if (ierr) {
@@ -24,29 +69,135 @@ void Petsc::Shutdown() {
     PetscErrorCode ierr;
     ierr = SlepcFinalize();
     ierr = PetscFinalize();
+    if (_groups > 1) {
+        MPI_Comm_free(&PETSC_COMM_WORLD);
+        MPI_Finalize();                         // MPI was started here, not by PETSc
+    }
+}
+int Petsc::Group() const {
+    return _group;
+}
+int Petsc::Groups() const {
+    return _groups;
+}
+int Petsc::Size() const {
+    return _size;
+}
+bool Petsc::JoinGroups() {
+    if (_groups == 1)
+        return _rank == 0;
+
+    PetscMPIInt world_rank;
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    return world_rank == 0;
 }
 
 
 
+// Everything made here is registered with the memory tracker (under the
+// current MemoryOwner) and released when the object is destroyed.
 Vector Petsc::CreateVector(int N) {
-    return Vector(new PetscVector(N));
+    PetscInt local;
+    PetscVector* v = new PetscVector(N);
+    PetscErrorCode ierr = VecGetLocalSize(v->_petsc_vec, &local);PETSCASSERT(ierr);
+    v->_memory_id = Memory::Register("vector", local, 0, double(local)*sizeof(PetscScalar));
+    return Vector(v);
+}
+// CreateVector(N) splits the rows evenly, a submatrix (and GetSubVector) keeps
+// the rows every rank owns, so vectors for it must take its layout
+Vector Petsc::CreateVector(const Matrix M) {
+    PetscInt local;
+    PetscErrorCode ierr;
+    PetscVector* v = new PetscVector();
+    ierr = MatCreateVecs(std::dynamic_pointer_cast<PetscMatrix>(M)->_petsc_mat, NULL, &v->_petsc_vec);PETSCASSERT(ierr);
+    ierr = VecSet(v->_petsc_vec, 0.0);PETSCASSERT(ierr);
+    ierr = VecGetLocalSize(v->_petsc_vec, &local);PETSCASSERT(ierr);
+    v->_len = M->Rows();
+    v->_memory_id = Memory::Register("vector", local, 0, double(local)*sizeof(PetscScalar));
+    return Vector(v);
+}
+Vector Petsc::CreateVector(const Vector layout) {
+    PetscInt local;
+    PetscErrorCode ierr;
+    PetscVector* v = new PetscVector();
+    ierr = VecDuplicate(std::dynamic_pointer_cast<PetscVector>(layout)->_petsc_vec, &v->_petsc_vec);PETSCASSERT(ierr);
+    ierr = VecSet(v->_petsc_vec, 0.0);PETSCASSERT(ierr);
+    ierr = VecGetLocalSize(v->_petsc_vec, &local);PETSCASSERT(ierr);
+    v->_len = layout->Length();
+    v->_memory_id = Memory::Register("vector", local, 0, double(local)*sizeof(PetscScalar));
+    return Vector(v);
 }
 void Petsc::DestroyVector(Vector& v) {
     v = nullptr;                // If there are other references to v, the object is not destroyed
 }
 
 Matrix Petsc::CreateMatrix(int rows, int cols, int numBands) {
-    return Matrix(new PetscMatrix(rows, cols, numBands));
+    PetscMatrix* m = new PetscMatrix(rows, cols, numBands);
+    long local = m->_row_end - m->_row_start;
+    long preallocated = 2*numBands*local;       // diagonal and off-diagonal part
+    m->_memory_id = Memory::Register("matrix", local, preallocated,
+            preallocated*double(sizeof(PetscScalar) + sizeof(PetscInt)) + 2.*local*sizeof(PetscInt));
+    return Matrix(m);
 }
 void Petsc::DestroyMatrix(Matrix& m) {
     m = nullptr;                // If there are other references to m, the object is not destroyed
 }
+Matrix Petsc::CreateCompositeMatrix(const Matrix base, const std::vector<Matrix>& terms) {
+    return Matrix(new PetscCompositeMatrix(base, terms));
+}
+void Petsc::SetCompositeCoefficients(Matrix composite, const std::vector<complex>& coeffs) {
+    auto m = std::dynamic_pointer_cast<PetscCompositeMatrix>(composite);
+    m->SetCoefficients(coeffs);
+}
+Matrix Petsc::CreateSinglePrecisionMatrix(const Matrix M) {
+    PetscInt gathered;
+    PetscSinglePrecisionMatrix* m = new PetscSinglePrecisionMatrix(M);
+    PetscErrorCode ierr = VecGetLocalSize(m->_x, &gathered);PETSCASSERT(ierr);
+    long nnz = m->_values.size();
+    double bytes = nnz*double(sizeof(std::complex<float>) + sizeof(int)) + m->_row_ptr.size()*sizeof(int)
+            + double(gathered)*sizeof(PetscScalar);
+    m->_memory_id = Memory::Register("matrix", m->_row_ptr.size()-1, nnz, bytes);
+    return Matrix(m);
+}
+Matrix Petsc::CreateSubMatrix(const Matrix M, const std::vector<int>& rows) {
+    PetscErrorCode ierr;
+    IS is;
+    auto from = std::dynamic_pointer_cast<PetscMatrix>(M);
+    PetscMatrix* result = new PetscMatrix();
+
+    // every rank keeps the rows it owns, so the vectors of GetSubVector fit
+    std::vector<PetscInt> local;
+    for (int row : rows)
+        if (row >= from->_row_start && row < from->_row_end)
+            local.push_back(row);
+    ierr = ISCreateGeneral(PETSC_COMM_WORLD, local.size(), local.data(), PETSC_COPY_VALUES, &is);PETSCASSERT(ierr);
+    ierr = MatCreateSubMatrix(from->_petsc_mat, is, is, MAT_INITIAL_MATRIX, &result->_petsc_mat);PETSCASSERT(ierr);
+    ierr = ISDestroy(&is);PETSCASSERT(ierr);
+    ierr = MatGetOwnershipRange(result->_petsc_mat, &result->_row_start, &result->_row_end);PETSCASSERT(ierr);
+    result->_rows = result->_cols = rows.size();
+    result->_memory_id = Memory::Register("matrix", local.size(), 0, 0.);
+    result->UpdateMemory();
+    return Matrix(result);
+}
 GMRESSolver Petsc::CreateGMRESSolver(int restart_iter, int max_iter) {
-    return GMRESSolver(new PetscSolver(restart_iter, max_iter));
+    PetscSolver* solver = new PetscSolver(restart_iter, max_iter);
+    solver->_memory_id = Memory::Register("solver", 0, 0, 0.);
+    return GMRESSolver(solver);
 }
 void Petsc::DestroyGMRESSolver(GMRESSolver& m) {
     m = nullptr;
 }
+GMRESSolver Petsc::CreateGCRODRSolver(int restart_iter, int recycle, int max_iter) {
+    return GMRESSolver(new GCRODRSolver(*this, restart_iter, recycle, max_iter));
+}
+BlockTridiagonalSolver Petsc::CreateBlockTridiagonalSolver(const Matrix base, const std::vector<Matrix>& terms, int blockSize, int bandwidth, bool diagonalOnly) {
+    auto solver = std::make_shared<PetscBlockTridiagonalSolver>(base, terms, blockSize, bandwidth, diagonalOnly);
+    return (solver->Valid() ? solver : nullptr);
+}
+BlockSpectralPropagator Petsc::CreateBlockSpectralPropagator(const Matrix H, const Matrix S, int blockSize) {
+    return BlockSpectralPropagator(new PetscBlockSpectralPropagator(H, S, blockSize));
+}
 
 HDF5 Petsc::OpenHDF5(const std::string& filename, char mode) {
     return HDF5(new PetscHDF5(filename, mode));
@@ -75,6 +226,32 @@ void Petsc::Mult(const Matrix M, const Vector in, Vector out) {
     auto b = std::dynamic_pointer_cast<PetscVector>(out);
     MatMult(m->_petsc_mat, a->_petsc_vec, b->_petsc_vec);
 }
+// One sparse times dense product instead of a product per vector: the
+// values and indices of M are streamed once for all the columns.
+void Petsc::Mult(const Matrix M, const std::vector<Vector>& in, std::vector<Vector>& out) {
+    PetscErrorCode ierr;
+    PetscBool shell;
+    Mat X, Y;
+    auto m = std::dynamic_pointer_cast<PetscMatrix>(M);
+    auto composite = std::dynamic_pointer_cast<PetscCompositeMatrix>(M);
+
+    ierr = PetscObjectTypeCompare((PetscObject)m->_petsc_mat, MATSHELL, &shell);PETSCASSERT(ierr);
+    if (shell && !composite) {
+        for (int k = 0; k < in.size(); k++)
+            Mult(M, in[k], out[k]);             // other shells only know products with vectors
+        return;
+    }
+
+    X = CreateDenseFromVectors(in);
+    if (composite) {
+        composite->MultDense(X, &Y);
+    } else {
+        ierr = MatMatMult(m->_petsc_mat, X, MAT_INITIAL_MATRIX, PETSC_DEFAULT, &Y);PETSCASSERT(ierr);
+    }
+    CopyDenseToVectors(Y, out);
+    ierr = MatDestroy(&X);PETSCASSERT(ierr);
+    ierr = MatDestroy(&Y);PETSCASSERT(ierr);
+}
 void Petsc::Dot(const Vector a, const Vector b, complex& value) {
     auto aa = std::dynamic_pointer_cast<PetscVector>(a);
     auto bb = std::dynamic_pointer_cast<PetscVector>(b);
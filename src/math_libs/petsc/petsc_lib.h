@@ -1,8 +1,11 @@
 #pragma once
 
 #include "maths/maths.h"
+#include "maths/banded_lu.h"
+#include "maths/gcrodr.h"
 #include "utility/logger.h"
 #include "utility/profiler.h"
+#include "utility/memory_tracker.h"
 
 #include <cassert>
 #include <petsc.h>
@@ -13,6 +16,7 @@
 class Petsc;
 class PetscVector;
 class PetscMatrix;
+class PetscBlockTridiagonalSolver;
 class EPSSolver;
 class KSPSolver;
 
@@ -25,6 +29,7 @@ class PetscVector : public IVector {
 
     bool _dirty;
     std::vector<complex> _local_copy;
+    int _memory_id;                             // in the memory tracker, -1 if not tracked
 public:
     typedef std::shared_ptr<PetscVector> Ptr_t;
 
@@ -51,7 +56,9 @@ public:
     void CopyTo(std::vector<complex>& values); 
     void Transform(Vector& out, std::function<std::vector<complex>(const std::vector<complex>&)> f);
     Vector GetSubVector(int start, int end);
+    Vector GetSubVector(const std::vector<int>& rows);
     void RestoreSubVector(Vector sub);
+    int LastIndexAbove(double threshold, int blockSize);
 
     void CreateScatter();
     void Scatter();
@@ -59,6 +66,10 @@ public:
     void ScatterRestoreArray(complex** ptr);
 };
 
+// the vectors as the columns of a dense matrix with their row layout, and back
+Mat CreateDenseFromVectors(const std::vector<Vector>& vecs);
+void CopyDenseToVectors(Mat dense, std::vector<Vector>& vecs);
+
 class PetscMatrix : public IMatrix {
     friend Petsc;
     friend EPSSolver;
@@ -66,6 +77,8 @@ class PetscMatrix : public IMatrix {
     friend void MatMult(const Matrix& M, const Vector& in, Vector& out);
     friend void MatAXPY(Matrix& X, complex a, const Matrix& Y);
 
+    int _memory_id;                             // in the memory tracker, -1 if not tracked
+    void UpdateMemory();                        // the allocated and used nonzeros, once assembled
 public:
     typedef std::shared_ptr<PetscMatrix> Ptr_t;
 
@@ -110,6 +123,42 @@ public:
         
 };
 
+class PetscCompositeMatrix : public PetscMatrix {
+    friend Petsc;
+
+    Matrix _base;
+    std::vector<Matrix> _terms;
+    std::vector<complex> _coeffs;
+    Vec _work;
+
+    static PetscErrorCode ShellMult(Mat A, Vec x, Vec y);
+public:
+    typedef std::shared_ptr<PetscCompositeMatrix> Ptr_t;
+
+    PetscCompositeMatrix(const Matrix base, const std::vector<Matrix>& terms);
+    ~PetscCompositeMatrix();
+
+    void SetCoefficients(const std::vector<complex>& coeffs);
+    void MultDense(Mat X, Mat* Y);              // Y = this*X for dense X, one product per matrix
+};
+
+// Single precision copy of the local rows of an assembled matrix (CSR).
+// The part of x the rows need is gathered in double and the products are
+// summed in double, only the stored values are rounded.
+class PetscSinglePrecisionMatrix : public PetscMatrix {
+    friend Petsc;
+
+    std::vector<int> _row_ptr, _col;            // _col indexes the gathered x
+    std::vector<std::complex<float>> _values;
+    VecScatter _scatter;
+    Vec _x;
+
+    static PetscErrorCode ShellMult(Mat A, Vec x, Vec y);
+public:
+    PetscSinglePrecisionMatrix(const Matrix M);
+    ~PetscSinglePrecisionMatrix();
+};
+
 class PetscASCII : public IASCII {
     
 public:
@@ -151,11 +200,23 @@ public:
     void WriteVector(const std::string& obj_name, const Vector value);
     void ReadVector(const std::string& obj_name, Vector value);
     bool HasVector(const std::string& obj_name) const;
+    void WriteRecord(const std::string& obj_name, const std::vector<double>& values, int index);
+    bool ReadRecords(const std::string& obj_name, std::vector<std::vector<double>>& rows);
 };
 
 class PetscSolver : public IGMRESSolver {
+    friend Petsc;
+
     KSPConvergedReason _reason;
     const char *_strreason;
+    int _memory_id;                             // sized on the first solve, when the Krylov basis is allocated
+    bool _memory_sized;
+    Matrix _pc_matrix;
+    std::shared_ptr<PetscBlockTridiagonalSolver> _pc_blocks;
+    PetscInt _iterations;
+
+    static PetscErrorCode ApplyBlockDiagonalPC(PC pc, Vec x, Vec y);
+    void UpdateMemory(Mat A);
 public:
     KSP _petsc_ksp;          /* linear solver context */
     PC _petsc_pc;            /* preconditioner context */
@@ -164,7 +225,98 @@ public:
     ~PetscSolver();
 
     void SetBlockedPC(int blocks);
+    void SetPreconditionerMatrix(const Matrix P);
+    void SetBlockDiagonalPC(const Matrix P, int blockSize, int bandwidth);
+    BlockTridiagonalSolver BlockDiagonalPC() const;
     bool Solve(const Matrix A, const Vector b, Vector x);
+    bool Solve(const Matrix A, const std::vector<Vector>& b, std::vector<Vector>& x);
+    int Iterations() const;
+    double Residual() const;
+    int ConvergedReason() const;
+    void SetTolerance(double rtol);
+    double Tolerance() const;
+};
+
+class PetscBlockTridiagonalSolver : public IBlockTridiagonalSolver {
+    // A run of coupled blocks, solved as one band matrix (ordered by radial
+    // index first and block second). A long run over several ranks is split
+    // by radial index into parts, one per rank, that are coupled only through
+    // their last kd rows (the separators, every part but the last has one).
+    struct Chain {
+        int first_block, num_blocks;
+        int kd;                                 // half bandwidth of the band
+        int part, parts;                        // 0 and 1 if it is not split
+        int i0, i1;                             // radial indices of our part
+        int cache_i0;                           // first cached radial index (from the part above, to couple to it)
+        size_t cache_offset;                    // of its blocks in _blocks
+        int offset;                             // of its first row in _rhs (band order)
+        bool in_place;                          // all its rows are ours
+        int rows;                               // of its first row in our part of the vector (in place) or in _local
+        BandedLU lu;                            // of the chain or of the interior (all but the separator) of our part
+        // split chains only
+        int interior;                           // rows of our part before its separator
+        int reduced_offset;                     // of its separators in _reduced_rhs
+        size_t reduced_elements;                // of their matrix in the buffer of Factor
+        BandedLU reduced;                       // the Schur complement on the separators of all parts
+        std::vector<complex> above_in, above_sep;   // (interior, separator above) and (separator above, interior), kd x kd
+        std::vector<complex> below_in, below_sep;   // the same for our own separator
+    };
+
+    int _blockSize, _bandwidth, _numBlocks;
+    std::vector<std::vector<complex>> _blocks;  // banded (lower, diagonal, upper) blocks of base and each term, of our parts of chains only
+    std::vector<int> _coupled;                  // block b to b+1, in any of the matrices (known on every rank)
+    std::vector<complex> _coeffs;
+    std::vector<Chain> _chains;                 // only the chains (or parts) this rank solves
+    bool _factored;
+    bool _diagonal_only;                        // ignore the off-diagonal blocks (block Jacobi)
+    bool _valid;                                // every element inside of the block structure
+    int _memory_id;
+
+    bool _straddling;                           // some chain (of any rank) has rows on several ranks
+    int _local_size;                            // rows of our chains
+    VecScatter _scatter;                        // the rows of our chains that straddle ranks to _local
+    Vec _local;
+    std::vector<complex> _rhs;                  // the right hand sides of our chains in band order, interleaved
+    int _reduced_rows;                          // separators of all split chains (known on every rank)
+    size_t _reduced_elements;                   // of their matrices
+    std::vector<complex> _reduced_rhs;
+
+    int ReadRows(Mat A, int row_start, int row_end, complex* rows, int stride);
+    complex& Cached(std::vector<complex>& blocks, const Chain& c, int b, int offset, int i, int j);
+    bool IsCoupled(int block);
+    bool Factor();
+    bool Solve(const std::vector<Vec>& b, const std::vector<Vec>& x);
+public:
+    PetscBlockTridiagonalSolver(const Matrix base, const std::vector<Matrix>& terms, int blockSize, int bandwidth, bool diagonalOnly = false);
+    ~PetscBlockTridiagonalSolver();
+
+    bool Valid() const;                         // false if the matrices do not have the block structure, nothing is set up then
+    void SetCoefficients(const std::vector<complex>& coeffs);
+    bool Solve(const Vector b, Vector x);
+    bool Solve(Vec b, Vec x);
+    bool Solve(const std::vector<Vector>& b, std::vector<Vector>& x);
+};
+
+class PetscBlockSpectralPropagator : public IBlockSpectralPropagator {
+    struct Block {
+        int offset;                             // into the local (scattered) vector
+        std::vector<complex> energies;
+        std::vector<complex> vectors, inverse;  // column major, eigenvectors and their inverse
+        std::vector<complex> coeffs;            // of the state in the eigenvectors
+    };
+
+    int _blockSize;
+    std::vector<Block> _blocks;                 // only the blocks this rank owns
+    VecScatter _scatter;
+    Vec _local;
+
+    bool Diagonalize(Mat H, Mat S, Block& block);
+public:
+    PetscBlockSpectralPropagator(const Matrix H, const Matrix S, int blockSize);
+    ~PetscBlockSpectralPropagator();
+
+    void SetState(const Vector psi);
+    void Evolve(double t, Vector psi);
 };
 
 class PetscLogger : public Logger {
@@ -177,30 +329,60 @@ public:
     void flush();
 };
 
+// Records on every rank and gathers to rank 0 of MPI_COMM_WORLD for output.
+// Each scope is also a PETSc log stage, so -log_view breaks down by them.
 class PetscProfiler : public Profiler {
+    std::map<std::string, PetscLogStage> _stage_ids;
+    std::vector<bool> _stages;                  // per open scope, whether a stage was pushed for it
 public:
     void Push(const std::string& name);
     void Pop(const std::string& name);
     void Print();
     bool PrintTo(const std::string& log_file);
+    bool TraceTo(const std::string& filename);
+};
+
+// The breakdown over the ranks of the group: rows, nonzeros and bytes
+// summed, and the largest share of any rank
+class PetscMemoryTracker : public MemoryTracker {
+public:
+    void Report(const std::string& when);
+    double LargestPeak();
 };
 
 class Petsc : public MathLib {
     // ksp
     PetscMPIInt _size, _rank;
+    int _group, _groups;
 public:
-    bool Startup(int argc, char **args);
+    bool Startup(int argc, char **args, int groups = 1, const std::vector<double>& weights = {});
     void Shutdown();
+    int Group() const;
+    int Groups() const;
+    int Size() const;
+    bool JoinGroups();
     
     Vector CreateVector(int N);
+    Vector CreateVector(const Matrix M);
+    Vector CreateVector(const Vector layout);
     void DestroyVector(Vector& m);
 
     Matrix CreateMatrix(int rows, int cols, int numBands);
     void DestroyMatrix(Matrix& m);
 
+    Matrix CreateCompositeMatrix(const Matrix base, const std::vector<Matrix>& terms);
+    void SetCompositeCoefficients(Matrix composite, const std::vector<complex>& coeffs);
+    Matrix CreateSinglePrecisionMatrix(const Matrix M);
+    Matrix CreateSubMatrix(const Matrix M, const std::vector<int>& rows);
+
     GMRESSolver CreateGMRESSolver(int restart_iter = 500, int max_iter = 10000);
     void DestroyGMRESSolver(GMRESSolver& m);
 
+    GMRESSolver CreateGCRODRSolver(int restart_iter = 40, int recycle = 10, int max_iter = 10000);
+
+    BlockTridiagonalSolver CreateBlockTridiagonalSolver(const Matrix base, const std::vector<Matrix>& terms, int blockSize, int bandwidth, bool diagonalOnly = false);
+    BlockSpectralPropagator CreateBlockSpectralPropagator(const Matrix H, const Matrix S, int blockSize);
+
     HDF5 OpenHDF5(const std::string& filename, char mode);
     void CloseHDF5(HDF5& file);
     
@@ -208,6 +390,7 @@ public:
     void CloseASCII(ASCII& file);
 
     void Mult(const Matrix M, const Vector in, Vector out);
+    void Mult(const Matrix M, const std::vector<Vector>& in, std::vector<Vector>& out);
     void Dot(const Vector a, const Vector b, complex& value);
     void AYPX(Matrix Y, complex a, const Matrix X);
     void AXPY(Matrix Y, complex a, const Matrix X);
@@ -2,12 +2,14 @@
 
 
 PetscMatrix::PetscMatrix() {
+    _memory_id = -1;
     _rows = 0; _cols = 0;
     _row_start = 0; _row_end = 0;
     _petsc_mat = 0;
 }
 PetscMatrix::PetscMatrix(int rows, int cols, int numbands) {
     PetscErrorCode ierr;
+    _memory_id = -1;
     ierr = MatCreate(PETSC_COMM_WORLD,&_petsc_mat);PETSCASSERT(ierr);
     ierr = MatSetSizes(_petsc_mat,PETSC_DECIDE,PETSC_DECIDE,rows,cols);PETSCASSERT(ierr);
     ierr = MatMPIAIJSetPreallocation(_petsc_mat, numbands, NULL, numbands, NULL);PETSCASSERT(ierr);
@@ -23,6 +25,8 @@ PetscMatrix::PetscMatrix(int rows, int cols, int numbands) {
 PetscMatrix::~PetscMatrix() {
     MatDestroy(&_petsc_mat);
     _petsc_mat = 0;
+    if (_memory_id >= 0)
+        Memory::Release(_memory_id);
 }
 
 void PetscMatrix::AssembleBegin() {
@@ -30,6 +34,17 @@ void PetscMatrix::AssembleBegin() {
 }
 void PetscMatrix::AssembleEnd() {
     PetscErrorCode ierr = MatAssemblyEnd(_petsc_mat,MAT_FINAL_ASSEMBLY);PETSCASSERT(ierr);
+    UpdateMemory();
+}
+// Assembly squeezes out the unused preallocation but keeps it allocated,
+// so the bytes follow the allocated nonzeros.
+void PetscMatrix::UpdateMemory() {
+    if (_memory_id < 0) return;
+
+    MatInfo info;
+    PetscErrorCode ierr = MatGetInfo(_petsc_mat, MAT_LOCAL, &info);PETSCASSERT(ierr);
+    double bytes = info.nz_allocated*(sizeof(PetscScalar) + sizeof(PetscInt)) + 2.*(_row_end - _row_start)*sizeof(PetscInt);
+    Memory::Update(_memory_id, info.nz_used, bytes);
 }
 
 
@@ -61,6 +76,7 @@ void PetscMatrix::Duplicate(const Matrix o) {
     ierr = MatDuplicate(from->_petsc_mat, MAT_COPY_VALUES, &_petsc_mat); PETSCASSERT(ierr);
     ierr = MatGetOwnershipRange(_petsc_mat,&_row_start,&_row_end); PETSCASSERT(ierr);
     _rows = from->_rows; _cols = from->_cols;
+    UpdateMemory();
 }
 void PetscMatrix::Zero() {
     MatZeroEntries(_petsc_mat);
@@ -0,0 +1,68 @@
+#include "math_libs/petsc/petsc_lib.h"
+#include <sstream>
+#include <iomanip>
+
+// Every rank of the group makes the same (collective) allocations, so the
+// breakdowns line up entry by entry. If they do not, only rank 0's is shown.
+void PetscMemoryTracker::Report(const std::string& when) {
+    const double GB = 1024.*1024.*1024.;
+    PetscErrorCode ierr;
+    PetscMPIInt size;
+    PetscLogDouble resident;
+    ierr = MPI_Comm_size(PETSC_COMM_WORLD, &size);PETSCASSERT(ierr);
+    ierr = PetscMemoryGetCurrentUsage(&resident);PETSCASSERT(ierr);
+
+    auto breakdown = Breakdown();
+    int entries[2] = {int(breakdown.size()), -int(breakdown.size())};
+    ierr = MPI_Allreduce(MPI_IN_PLACE, entries, 2, MPI_INT, MPI_MIN, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    bool aligned = (entries[0] == -entries[1]);
+
+    // per rank: current, peak, resident and the bytes of every entry
+    std::vector<double> local = {Current(), Peak(), resident};
+    for (auto& a : breakdown)
+        local.push_back(a.bytes);
+    std::vector<double> largest(local.size()), total(local.size());
+    if (aligned) {
+        ierr = MPI_Allreduce(local.data(), largest.data(), local.size(), MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+        ierr = MPI_Allreduce(local.data(), total.data(), local.size(), MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+
+        std::vector<long> counts, sums(3*breakdown.size());
+        for (auto& a : breakdown) {
+            counts.push_back(a.rows);
+            counts.push_back(a.preallocated);
+            counts.push_back(a.nnz);
+        }
+        ierr = MPI_Allreduce(counts.data(), sums.data(), counts.size(), MPI_LONG, MPI_SUM, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+        for (int k = 0; k < breakdown.size(); k++) {
+            breakdown[k].rows = sums[3*k];
+            breakdown[k].preallocated = sums[3*k+1];
+            breakdown[k].nnz = sums[3*k+2];
+        }
+    } else {
+        LOG_WARN("The allocations differ between the ranks, the memory breakdown is rank 0's only.");
+        largest = total = local;
+        size = 1;
+    }
+
+    std::ostringstream ss;
+    ss      << "Memory at " << when << " (" << size << " ranks): "
+            << largest[0]/GB << " GB tracked on the largest rank (" << total[0]/GB << " GB in total), peak "
+            << largest[1]/GB << " GB per rank, resident " << largest[2]/GB << " GB per rank" << std::endl;
+    ss      << std::left << std::setw(24) << "  owner" << std::setw(10) << "kind" << std::right
+            << std::setw(8) << "count" << std::setw(12) << "rows"
+            << std::setw(14) << "preallocated" << std::setw(14) << "nnz"
+            << std::setw(14) << "GB (max rank)" << std::setw(12) << "GB (total)" << std::endl;
+    for (int k = 0; k < breakdown.size(); k++) {
+        auto& a = breakdown[k];
+        ss  << std::left << std::setw(24) << "  " + a.owner << std::setw(10) << a.kind << std::right
+            << std::setw(8) << a.count << std::setw(12) << a.rows
+            << std::setw(14) << a.preallocated << std::setw(14) << a.nnz
+            << std::setw(14) << largest[3+k]/GB << std::setw(12) << total[3+k]/GB << std::endl;
+    }
+    LOG_INFO(ss.str());
+}
+double PetscMemoryTracker::LargestPeak() {
+    double peak = Peak(), largest;
+    PetscErrorCode ierr = MPI_Allreduce(&peak, &largest, 1, MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    return largest;
+}
@@ -1,27 +1,121 @@
 #include "math_libs/petsc/petsc_lib.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
 
-void PetscProfiler::Push(const std::string& name) {
-    PetscMPIInt rank;
-    PetscErrorCode ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
+// Collects one string per rank on rank 0 of MPI_COMM_WORLD (every rank
+// of every group takes part)
+static std::vector<std::string> GatherStrings(const std::string& local) {
+    PetscMPIInt rank, size;
+    PetscErrorCode ierr = MPI_Comm_rank(MPI_COMM_WORLD, &rank);PETSCASSERT(ierr);
+    ierr = MPI_Comm_size(MPI_COMM_WORLD, &size);PETSCASSERT(ierr);
+
+    int length = local.size();
+    std::vector<int> lengths(size), offsets(size, 0);
+    ierr = MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);PETSCASSERT(ierr);
+    for (int p = 1; p < size; p++)
+        offsets[p] = offsets[p-1] + lengths[p-1];
+
+    std::vector<char> all(rank == 0 ? offsets[size-1] + lengths[size-1] + 1 : 1);
+    ierr = MPI_Gatherv(local.data(), length, MPI_CHAR, all.data(), lengths.data(), offsets.data(), MPI_CHAR, 0, MPI_COMM_WORLD);PETSCASSERT(ierr);
+
+    std::vector<std::string> result;
     if (rank == 0)
-        Profiler::Push(name);
+        for (int p = 0; p < size; p++)
+            result.push_back(std::string(all.data() + offsets[p], lengths[p]));
+    return result;
+}
+
+static std::vector<std::vector<Profiler::Record>> GatherRecords(const std::vector<Profiler::Record>& records) {
+    std::ostringstream local;
+    local.precision(17);
+    for (auto& r : records)
+        local << r.path << '\t' << r.calls << '\t' << r.time << '\t' << r.self << '\n';
+
+    std::vector<std::vector<Profiler::Record>> result;
+    for (auto& text : GatherStrings(local.str())) {
+        std::istringstream in(text);
+        std::vector<Profiler::Record> process;
+        Profiler::Record r;
+        while (std::getline(in, r.path, '\t') && in >> r.calls >> r.time >> r.self && in.ignore())
+            process.push_back(r);
+        result.push_back(process);
+    }
+    return result;
+}
+
+
+void PetscProfiler::Push(const std::string& name) {
+    Profiler::Push(name);
+
+    PetscBool initialized;
+    PetscErrorCode ierr = PetscInitialized(&initialized);PETSCASSERT(ierr);
+    _stages.resize(Depth() - 1, false);         // scopes closed implicitly by an outer Pop
+    _stages.push_back(initialized);
+    if (!initialized) return;
+
+    auto stage = _stage_ids.find(name);
+    if (stage == _stage_ids.end()) {
+        PetscLogStage id;
+        ierr = PetscLogStageRegister(name.c_str(), &id);PETSCASSERT(ierr);
+        stage = _stage_ids.insert({name, id}).first;
+    }
+    ierr = PetscLogStagePush(stage->second);PETSCASSERT(ierr);
 }
 void PetscProfiler::Pop(const std::string& name) {
-    PetscMPIInt rank;
-    PetscErrorCode ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
-    if (rank == 0)
-        Profiler::Pop(name);
+    Profiler::Pop(name);
+
+    PetscErrorCode ierr;
+    while (_stages.size() > Depth()) {
+        if (_stages.back()) {
+            ierr = PetscLogStagePop();PETSCASSERT(ierr);
+        }
+        _stages.pop_back();
+    }
 }
 void PetscProfiler::Print() {
-    PetscMPIInt rank;
-    PetscErrorCode ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
-    if (rank == 0)
-        Profiler::Print();
+    auto records = GatherRecords(Records());
+    if (!records.empty())
+        WriteSummary(std::cout, Summarize(records));
 }
 bool PetscProfiler::PrintTo(const std::string& filename) {
-    PetscMPIInt rank;
-    PetscErrorCode ierr = MPI_Comm_rank(PETSC_COMM_WORLD, &rank);PETSCASSERT(ierr);
-    if (rank == 0)
-        return Profiler::PrintTo(filename);
-    return false;
-}
\ No newline at end of file
+    auto records = GatherRecords(Records());
+    if (records.empty())
+        return false;
+
+    std::ofstream file(filename, std::ios_base::app);
+    if (!file.is_open()) return false;
+
+    WriteSummary(file, Summarize(records));
+    return true;
+}
+bool PetscProfiler::TraceTo(const std::string& filename) {
+    std::ostringstream local;
+    local.precision(17);
+    for (auto& e : Events())
+        local << e.name << '\t' << e.start << '\t' << e.duration << '\n';
+
+    auto texts = GatherStrings(local.str());
+    int dropped = DroppedEvents(), total;
+    PetscErrorCode ierr = MPI_Reduce(&dropped, &total, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);PETSCASSERT(ierr);
+    if (texts.empty())
+        return false;
+
+    std::vector<std::vector<Event>> events;
+    for (auto& text : texts) {
+        std::istringstream in(text);
+        std::vector<Event> process;
+        Event e;
+        while (std::getline(in, e.name, '\t') && in >> e.start >> e.duration && in.ignore())
+            process.push_back(e);
+        events.push_back(process);
+    }
+
+    std::ofstream file(filename);
+    if (!file.is_open()) return false;
+
+    WriteTrace(file, events);
+    if (total > 0)
+        LOG_WARN("The profiler trace is incomplete, " + std::to_string(total) + " events were dropped.");
+    return true;
+}
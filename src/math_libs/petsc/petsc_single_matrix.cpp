@@ -0,0 +1,83 @@
+#include "math_libs/petsc/petsc_lib.h"
+#include <algorithm>
+
+
+PetscSinglePrecisionMatrix::PetscSinglePrecisionMatrix(const Matrix M) : _scatter(0), _x(0) {
+    PetscErrorCode ierr;
+    PetscInt local_rows, local_cols, ncols;
+    const PetscInt* cols;
+    const PetscScalar* vals;
+    IS is;
+    Vec global;
+    Mat A = std::dynamic_pointer_cast<PetscMatrix>(M)->_petsc_mat;
+
+    ierr = MatGetLocalSize(A, &local_rows, &local_cols);PETSCASSERT(ierr);
+    ierr = MatGetOwnershipRange(A, &_row_start, &_row_end);PETSCASSERT(ierr);
+    _rows = M->Rows(); _cols = M->Cols();
+
+    // every column the local rows use, numbered in the gathered copy of x.
+    // Explicit zeros (e.g. the structure of U0+ outside the diagonal blocks) are dropped.
+    std::vector<PetscInt> columns;
+    for (int r = _row_start; r < _row_end; r++) {
+        ierr = MatGetRow(A, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+        for (int n = 0; n < ncols; n++)
+            if (vals[n] != 0.)
+                columns.push_back(cols[n]);
+        ierr = MatRestoreRow(A, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+    }
+    std::sort(columns.begin(), columns.end());
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+    _row_ptr.push_back(0);
+    for (int r = _row_start; r < _row_end; r++) {
+        ierr = MatGetRow(A, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+        for (int n = 0; n < ncols; n++) {
+            if (vals[n] == 0.)
+                continue;
+            _col.push_back(std::lower_bound(columns.begin(), columns.end(), cols[n]) - columns.begin());
+            _values.push_back(std::complex<float>(vals[n]));
+        }
+        _row_ptr.push_back(_col.size());
+        ierr = MatRestoreRow(A, r, &ncols, &cols, &vals);PETSCASSERT(ierr);
+    }
+
+    ierr = ISCreateGeneral(PETSC_COMM_SELF, columns.size(), columns.data(), PETSC_COPY_VALUES, &is);PETSCASSERT(ierr);
+    ierr = VecCreateSeq(PETSC_COMM_SELF, columns.size(), &_x);PETSCASSERT(ierr);
+    ierr = MatCreateVecs(A, &global, NULL);PETSCASSERT(ierr);
+    ierr = VecScatterCreate(global, is, _x, NULL, &_scatter);PETSCASSERT(ierr);
+    ierr = ISDestroy(&is);PETSCASSERT(ierr);
+    ierr = VecDestroy(&global);PETSCASSERT(ierr);
+
+    // same parallel layout as M so vectors can be shared
+    ierr = MatCreateShell(PETSC_COMM_WORLD, local_rows, local_cols, _rows, _cols, this, &_petsc_mat);PETSCASSERT(ierr);
+    ierr = MatShellSetOperation(_petsc_mat, MATOP_MULT, (void(*)(void))ShellMult);PETSCASSERT(ierr);
+}
+PetscSinglePrecisionMatrix::~PetscSinglePrecisionMatrix() {
+    VecScatterDestroy(&_scatter);
+    VecDestroy(&_x);
+}
+
+// y = M*x with the values read in single precision and summed in double
+PetscErrorCode PetscSinglePrecisionMatrix::ShellMult(Mat A, Vec x, Vec y) {
+    PetscErrorCode ierr;
+    PetscSinglePrecisionMatrix* self;
+    const PetscScalar* xs;
+    PetscScalar* ys;
+
+    ierr = MatShellGetContext(A, &self);CHKERRQ(ierr);
+    ierr = VecScatterBegin(self->_scatter, x, self->_x, INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+    ierr = VecScatterEnd(self->_scatter, x, self->_x, INSERT_VALUES, SCATTER_FORWARD);CHKERRQ(ierr);
+
+    ierr = VecGetArrayRead(self->_x, &xs);CHKERRQ(ierr);
+    ierr = VecGetArray(y, &ys);CHKERRQ(ierr);
+    int rows = self->_row_ptr.size() - 1;
+    for (int r = 0; r < rows; r++) {
+        PetscScalar sum = 0.;
+        for (int n = self->_row_ptr[r]; n < self->_row_ptr[r+1]; n++)
+            sum += PetscScalar(self->_values[n])*xs[self->_col[n]];
+        ys[r] = sum;
+    }
+    ierr = VecRestoreArray(y, &ys);CHKERRQ(ierr);
+    ierr = VecRestoreArrayRead(self->_x, &xs);CHKERRQ(ierr);
+    return 0;
+}
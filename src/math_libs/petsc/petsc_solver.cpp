@@ -1,7 +1,7 @@
 #include "math_libs/petsc/petsc_lib.h"
 #include <iostream>
 
-PetscSolver::PetscSolver(int restart_iter, int max_iter) {
+PetscSolver::PetscSolver(int restart_iter, int max_iter) : _memory_id(-1), _memory_sized(false), _iterations(0) {
     PetscErrorCode ierr;
     ierr = KSPCreate(PETSC_COMM_WORLD,&_petsc_ksp);PETSCASSERT(ierr);
     ierr = KSPSetType(_petsc_ksp, KSPGMRES);PETSCASSERT(ierr);
@@ -20,6 +20,8 @@ PetscSolver::~PetscSolver() {
     PetscErrorCode ierr;
 
     ierr = KSPDestroy(&_petsc_ksp);PETSCASSERT(ierr);
+    if (_memory_id >= 0)
+        Memory::Release(_memory_id);
 }
 
 void PetscSolver::SetBlockedPC(int blocks) {
@@ -29,15 +31,101 @@ void PetscSolver::SetBlockedPC(int blocks) {
     ierr = KSPSetPC(_petsc_ksp,_petsc_pc);PETSCASSERT(ierr);
 }
 
+void PetscSolver::SetPreconditionerMatrix(const Matrix P) {
+    // P is kept alive here. As long as its values do not change PETSc
+    // will not rebuild the preconditioner between solves.
+    _pc_matrix = P;
+}
+
+void PetscSolver::SetBlockDiagonalPC(const Matrix P, int blockSize, int bandwidth) {
+    PetscErrorCode ierr;
+    // The diagonal blocks of P are factored once (on the first solve). The
+    // shell never looks at the operators given to KSPSetOperators, so
+    // nothing is rebuilt between solves.
+    _pc_blocks = std::make_shared<PetscBlockTridiagonalSolver>(P, std::vector<Matrix>(), blockSize, bandwidth, true);
+    if (!_pc_blocks->Valid()) {
+        LOG_WARN("The preconditioner matrix is not block diagonal. Using block Jacobi.");
+        _pc_blocks = nullptr;
+        SetBlockedPC(P->Rows()/blockSize);
+        return;
+    }
+
+    ierr = PCSetType(_petsc_pc,PCSHELL);PETSCASSERT(ierr);
+    ierr = PCShellSetContext(_petsc_pc,this);PETSCASSERT(ierr);
+    ierr = PCShellSetApply(_petsc_pc,ApplyBlockDiagonalPC);PETSCASSERT(ierr);
+    ierr = PCShellSetName(_petsc_pc,"field free block LU");PETSCASSERT(ierr);
+    ierr = KSPSetPC(_petsc_ksp,_petsc_pc);PETSCASSERT(ierr);
+}
+
+BlockTridiagonalSolver PetscSolver::BlockDiagonalPC() const {
+    return _pc_blocks;
+}
+
+// y = P^-1 x with the factored diagonal blocks of P
+PetscErrorCode PetscSolver::ApplyBlockDiagonalPC(PC pc, Vec x, Vec y) {
+    PetscErrorCode ierr;
+    PetscSolver* self;
+
+    ierr = PCShellGetContext(pc, &self);CHKERRQ(ierr);
+    if (!self->_pc_blocks->Solve(x, y))
+        return PETSC_ERR_MAT_LU_ZRPVT;
+    return 0;
+}
+
+// GMRES keeps restart+1 basis vectors, a few work vectors and the
+// (restart+1) x restart Hessenberg matrix. The preconditioner is not counted
+// here (the block LU is tracked on its own).
+void PetscSolver::UpdateMemory(Mat A) {
+    if (_memory_id < 0 || _memory_sized) return;
+
+    PetscErrorCode ierr;
+    PetscInt rows, cols, restart = 30;
+    PetscBool gmres;
+    ierr = MatGetLocalSize(A, &rows, &cols);PETSCASSERT(ierr);
+    ierr = PetscObjectTypeCompare((PetscObject)_petsc_ksp, KSPGMRES, &gmres);PETSCASSERT(ierr);
+    if (gmres) {
+        ierr = KSPGMRESGetRestart(_petsc_ksp, &restart);PETSCASSERT(ierr);
+    }
+    double bytes = ((restart + 4.)*rows + (restart + 1.)*(restart + 2.))*sizeof(PetscScalar);
+    Memory::Update(_memory_id, 0, bytes);
+    _memory_sized = true;
+}
+
+int PetscSolver::Iterations() const {
+    return _iterations;
+}
+double PetscSolver::Residual() const {
+    PetscReal norm;
+    PetscErrorCode ierr = KSPGetResidualNorm(_petsc_ksp, &norm);PETSCASSERT(ierr);
+    return norm;
+}
+int PetscSolver::ConvergedReason() const {
+    return _reason;
+}
+void PetscSolver::SetTolerance(double rtol) {
+    PetscErrorCode ierr;
+    ierr = KSPSetTolerances(_petsc_ksp, rtol, PETSC_DEFAULT, PETSC_DEFAULT, PETSC_DEFAULT);PETSCASSERT(ierr);
+}
+double PetscSolver::Tolerance() const {
+    PetscReal rtol;
+    PetscErrorCode ierr = KSPGetTolerances(_petsc_ksp, &rtol, NULL, NULL, NULL);PETSCASSERT(ierr);
+    return rtol;
+}
+
 bool PetscSolver::Solve(const Matrix A, const Vector b, Vector x) {
     PetscErrorCode ierr;
 
     auto petscA = std::dynamic_pointer_cast<PetscMatrix>(A);
     auto petscb = std::dynamic_pointer_cast<PetscVector>(b);
     auto petscx = std::dynamic_pointer_cast<PetscVector>(x);
+    Mat P = petscA->_petsc_mat;
+    if (_pc_matrix)
+        P = std::dynamic_pointer_cast<PetscMatrix>(_pc_matrix)->_petsc_mat;
 
-    ierr = KSPSetOperators(_petsc_ksp, petscA->_petsc_mat, petscA->_petsc_mat);PETSCASSERT(ierr);
+    ierr = KSPSetOperators(_petsc_ksp, petscA->_petsc_mat, P);PETSCASSERT(ierr);
     ierr = KSPSolve(_petsc_ksp, petscb->_petsc_vec, petscx->_petsc_vec);PETSCASSERT(ierr);
+    ierr = KSPGetIterationNumber(_petsc_ksp, &_iterations);PETSCASSERT(ierr);
+    UpdateMemory(petscA->_petsc_mat);
 
     KSPGetConvergedReason(_petsc_ksp, &_reason);
     if (_reason < 0) {
@@ -46,4 +134,53 @@ bool PetscSolver::Solve(const Matrix A, const Vector b, Vector x) {
         return false;
     }
     return true;
-}
\ No newline at end of file
+}
+// All the right hand sides in one KSPMatSolve. With a block Krylov method
+// (-ksp_type hpddm -ksp_hpddm_type bgmres) the products and the
+// preconditioner are applied to all the columns at once, otherwise PETSc
+// solves them one after the other.
+bool PetscSolver::Solve(const Matrix A, const std::vector<Vector>& b, std::vector<Vector>& x) {
+    PetscErrorCode ierr;
+    Mat B, X;
+
+    auto petscA = std::dynamic_pointer_cast<PetscMatrix>(A);
+    Mat P = petscA->_petsc_mat;
+    if (_pc_matrix)
+        P = std::dynamic_pointer_cast<PetscMatrix>(_pc_matrix)->_petsc_mat;
+
+    B = CreateDenseFromVectors(b);
+    X = CreateDenseFromVectors(x);                  // the initial guess
+    ierr = KSPSetOperators(_petsc_ksp, petscA->_petsc_mat, P);PETSCASSERT(ierr);
+    ierr = KSPMatSolve(_petsc_ksp, B, X);PETSCASSERT(ierr);
+    ierr = KSPGetIterationNumber(_petsc_ksp, &_iterations);PETSCASSERT(ierr);
+    UpdateMemory(petscA->_petsc_mat);
+    CopyDenseToVectors(X, x);
+    ierr = MatDestroy(&B);PETSCASSERT(ierr);
+    ierr = MatDestroy(&X);PETSCASSERT(ierr);
+
+    KSPGetConvergedReason(_petsc_ksp, &_reason);
+    if (_reason < 0) {
+        KSPGetConvergedReasonString(_petsc_ksp, &_strreason);
+        // the reason is of the block solve, the columns it failed for are those above the tolerance
+        PetscReal rtol;
+        Vec r;
+        std::string columns;
+        ierr = KSPGetTolerances(_petsc_ksp, &rtol, NULL, NULL, NULL);PETSCASSERT(ierr);
+        ierr = VecDuplicate(std::dynamic_pointer_cast<PetscVector>(b[0])->_petsc_vec, &r);PETSCASSERT(ierr);
+        for (int k = 0; k < b.size(); k++) {
+            Vec bk = std::dynamic_pointer_cast<PetscVector>(b[k])->_petsc_vec;
+            PetscReal rnorm, bnorm;
+            ierr = MatMult(petscA->_petsc_mat, std::dynamic_pointer_cast<PetscVector>(x[k])->_petsc_vec, r);PETSCASSERT(ierr);
+            ierr = VecAYPX(r, -1., bk);PETSCASSERT(ierr);
+            ierr = VecNorm(r, NORM_2, &rnorm);PETSCASSERT(ierr);
+            ierr = VecNorm(bk, NORM_2, &bnorm);PETSCASSERT(ierr);
+            if (rnorm > rtol*bnorm)
+                columns += " " + std::to_string(k);
+        }
+        ierr = VecDestroy(&r);PETSCASSERT(ierr);
+        LOG_WARN(std::string("GMRES diverged (") + _strreason + ") for right hand side(s)" + columns
+                + " of " + std::to_string(b.size()) + ".");
+        return false;
+    }
+    return true;
+}
@@ -1,7 +1,9 @@
 #include "math_libs/petsc/petsc_lib.h"
+#include <algorithm>
 
 
 PetscVector::PetscVector() {
+    _memory_id = -1;
     _len = 0;
     _petsc_vec = 0;
     _petsc_ctx = 0;
@@ -10,6 +12,7 @@ PetscVector::PetscVector() {
 }
 PetscVector::PetscVector(int length) {
     PetscErrorCode ierr;
+    _memory_id = -1;
     _petsc_ctx = 0;
     _petsc_sca_vec = 0;
     ierr = VecCreate(PETSC_COMM_WORLD,&_petsc_vec);PETSCASSERT(ierr);
@@ -25,6 +28,8 @@ PetscVector::~PetscVector() {
     ierr = VecScatterDestroy(&_petsc_ctx); PETSCASSERT(ierr);
     ierr = VecDestroy(&_petsc_sca_vec); PETSCASSERT(ierr);
     ierr = VecDestroy(&_petsc_vec); PETSCASSERT(ierr);
+    if (_memory_id >= 0)
+        Memory::Release(_memory_id);
 }
 
 complex PetscVector::Get(int index) const {
@@ -162,6 +167,23 @@ Vector PetscVector::GetSubVector(int start, int end) {
 
     return Vector(result);
 }
+Vector PetscVector::GetSubVector(const std::vector<int>& rows) {
+    PetscVector* result = new PetscVector();
+    PetscInt low, high;
+    std::vector<PetscInt> local;
+
+    result->_len = rows.size();
+    VecGetOwnershipRange(_petsc_vec, &low, &high);
+    for (int row : rows)
+        if (row >= low && row < high)
+            local.push_back(row);
+
+    // not contiguous in general, so a copy that RestoreSubVector puts back
+    ISCreateGeneral(PETSC_COMM_WORLD, local.size(), local.data(), PETSC_COPY_VALUES, &result->_petsc_is);
+    VecGetSubVector(_petsc_vec, result->_petsc_is, &result->_petsc_vec);
+
+    return Vector(result);
+}
 void PetscVector::RestoreSubVector(Vector sub) {
     auto petsc_sub = std::dynamic_pointer_cast<PetscVector>(sub);
     VecRestoreSubVector(_petsc_vec, petsc_sub->_petsc_is, &petsc_sub->_petsc_vec);
@@ -169,6 +191,21 @@ void PetscVector::RestoreSubVector(Vector sub) {
     petsc_sub->_petsc_vec = 0;
     petsc_sub->_petsc_is = 0;
 }
+int PetscVector::LastIndexAbove(double threshold, int blockSize) {
+    PetscErrorCode ierr;
+    PetscInt low, high;
+    const PetscScalar* array;
+    int last = -1;
+
+    ierr = VecGetOwnershipRange(_petsc_vec, &low, &high);PETSCASSERT(ierr);
+    ierr = VecGetArrayRead(_petsc_vec, &array);PETSCASSERT(ierr);
+    for (PetscInt i = low; i < high; i++)
+        if (std::norm(array[i-low]) > threshold)
+            last = std::max(last, int(i % blockSize));
+    ierr = VecRestoreArrayRead(_petsc_vec, &array);PETSCASSERT(ierr);
+    ierr = MPI_Allreduce(MPI_IN_PLACE, &last, 1, MPI_INT, MPI_MAX, PETSC_COMM_WORLD);PETSCASSERT(ierr);
+    return last;
+}
 
 
 void PetscVector::AssembleBegin() {
@@ -179,3 +216,45 @@ void PetscVector::AssembleEnd() {
     PetscErrorCode ierr;
     ierr = VecAssemblyEnd(_petsc_vec); PETSCASSERT(ierr);
 }
+
+
+Mat CreateDenseFromVectors(const std::vector<Vector>& vecs) {
+    PetscErrorCode ierr;
+    PetscInt local, lda;
+    PetscScalar* array;
+    const PetscScalar* column;
+    Mat dense;
+    Vec first = std::dynamic_pointer_cast<PetscVector>(vecs[0])->_petsc_vec;
+
+    ierr = VecGetLocalSize(first, &local);PETSCASSERT(ierr);
+    ierr = MatCreateDense(PETSC_COMM_WORLD, local, PETSC_DECIDE, vecs[0]->Length(), vecs.size(), NULL, &dense);PETSCASSERT(ierr);
+    ierr = MatDenseGetLDA(dense, &lda);PETSCASSERT(ierr);
+    ierr = MatDenseGetArray(dense, &array);PETSCASSERT(ierr);
+    for (int k = 0; k < vecs.size(); k++) {
+        Vec v = std::dynamic_pointer_cast<PetscVector>(vecs[k])->_petsc_vec;
+        ierr = VecGetArrayRead(v, &column);PETSCASSERT(ierr);
+        std::copy(column, column + local, array + size_t(k)*lda);
+        ierr = VecRestoreArrayRead(v, &column);PETSCASSERT(ierr);
+    }
+    ierr = MatDenseRestoreArray(dense, &array);PETSCASSERT(ierr);
+    ierr = MatAssemblyBegin(dense, MAT_FINAL_ASSEMBLY);PETSCASSERT(ierr);
+    ierr = MatAssemblyEnd(dense, MAT_FINAL_ASSEMBLY);PETSCASSERT(ierr);
+    return dense;
+}
+void CopyDenseToVectors(Mat dense, std::vector<Vector>& vecs) {
+    PetscErrorCode ierr;
+    PetscInt local, lda;
+    PetscScalar* array;
+    PetscScalar* column;
+
+    ierr = MatGetLocalSize(dense, &local, NULL);PETSCASSERT(ierr);
+    ierr = MatDenseGetLDA(dense, &lda);PETSCASSERT(ierr);
+    ierr = MatDenseGetArray(dense, &array);PETSCASSERT(ierr);
+    for (int k = 0; k < vecs.size(); k++) {
+        Vec v = std::dynamic_pointer_cast<PetscVector>(vecs[k])->_petsc_vec;
+        ierr = VecGetArray(v, &column);PETSCASSERT(ierr);
+        std::copy(array + size_t(k)*lda, array + size_t(k)*lda + local, column);
+        ierr = VecRestoreArray(v, &column);PETSCASSERT(ierr);
+    }
+    ierr = MatDenseRestoreArray(dense, &array);PETSCASSERT(ierr);
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <fstream>
 #include <string>
 #include "utility/logger.h"
 #include "utility/file_exists.h"
@@ -128,16 +129,23 @@ void DipoleAccObservable::Compute(int it, double t, double dt) {
 void DipoleAccObservable::Flush() {
     _txt_file->Flush();
 }
+// only called on the first rank of all the groups, so plain file streams
+void DipoleAccObservable::Merge(const std::vector<std::string>& directories) {
+    std::vector<double> t, x, y, z;
+    for (auto& dir : directories) {
+        std::ifstream part(dir + "/" + _filename);
+        double ti, xi, yi, zi;
+        for (int i = 0; part >> ti >> xi >> yi >> zi; i++) {
+            if (i == t.size()) {
+                t.push_back(ti);
+                x.push_back(0.); y.push_back(0.); z.push_back(0.);
+            }
+            x[i] += xi; y[i] += yi; z[i] += zi;
+        }
+    }
 
-int DipoleAccObservable::MemoryAlloced() const {
-    int order = _tdse.Basis().getOrder();
-    int mem = _tdse.DOF();
-    if (_gradPot[X])
-        mem += _tdse.DOF()*(8*order-4);
-    if (_gradPot[Y])
-        mem += _tdse.DOF()*(8*order-4);
-    if (_gradPot[Z])
-        mem += _tdse.DOF()*(4*order-2);
-    
-    return mem;
-}
\ No newline at end of file
+    std::ofstream file(_filename);
+    file << std::setprecision(8) << std::scientific;
+    for (int i = 0; i < t.size(); i++)
+        file << t[i] << "\t" << x[i] << "\t" << y[i] << "\t" << z[i] << "\n";
+}
@@ -13,8 +13,8 @@ class DipoleAccObservable : public Observable {
 public:
     DipoleAccObservable(TDSE& tdse);
 
-    int MemoryAlloced() const;
     void Flush();
+    void Merge(const std::vector<std::string>& directories);
     void Startup(int it);
     void Shutdown();
     void Compute(int it, double t, double dt);
@@ -3,6 +3,7 @@
 #include "utility/file_exists.h"
 #include <iostream>
 #include <sstream>
+#include <fstream>
 
 NormObservable::NormObservable(TDSE& tdse) : Observable(tdse) {
 }
@@ -16,12 +17,7 @@ void NormObservable::Startup(int start_it) {
     _psi_temp = _MathLib.CreateVector(_psi->Length());
 
     // Fill overlap matrix
-    std::vector<complex> overlapStore(NBsplines*NBsplines);
-    for (int i = 0; i < NBsplines; i++) {
-        for (int j = i; j < NBsplines; j++) {
-            overlapStore[j + i*NBsplines] = overlapStore[i + j*NBsplines] = basis.Integrate(i+1, j+1);
-        }
-    }
+    std::vector<complex> overlapStore = basis.IntegrateOperators({{nullptr, 0, 0}})[0];
     _S->FillBandedBlock(order-1, NBsplines, [=,&overlapStore](int row, int col) {
         int i, j;
         i = row % NBsplines;  
@@ -79,4 +75,24 @@ void NormObservable::Compute(int it, double t, double dt) {
 
 void NormObservable::Flush() {
     _file->Flush();
-}
\ No newline at end of file
+}
+// only called on the first rank of all the groups, so plain file streams
+void NormObservable::Merge(const std::vector<std::string>& directories) {
+    if (_filename.empty())
+        return;
+
+    std::vector<complex> norm;
+    for (auto& dir : directories) {
+        std::ifstream part(dir + "/" + _filename);
+        double real, imag;
+        for (int i = 0; part >> real >> imag; i++) {
+            if (i == norm.size())
+                norm.push_back(0.);
+            norm[i] += complex(real, imag);
+        }
+    }
+
+    std::ofstream file(_filename);
+    for (auto& n : norm)
+        file << std::real(n) << "\t" << std::imag(n) << "\n";
+}
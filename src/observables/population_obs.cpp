@@ -3,6 +3,7 @@
 #include "utility/index_manip.h"
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <iomanip>
 #include <string>
 
@@ -49,12 +50,7 @@ void PopulationObservable::Startup(int start_it) {
     hdf5->PopGroup();
 
     // Fill overlap matrix
-    std::vector<complex> overlapStore(_N*_N);
-    for (int i = 0; i < _N; i++) {
-        for (int j = i; j < _N; j++) {
-            overlapStore[j + i*_N] = overlapStore[i + j*_N] = basis.Integrate(i+1, j+1);
-        }
-    }
+    std::vector<complex> overlapStore = basis.IntegrateOperators({{nullptr, 0, 0}})[0];
     _S->FillBandedBlock(order-1, _N, [=,&overlapStore](int row, int col) {
         int i, j;
         i = row % _N;  
@@ -157,4 +153,20 @@ void PopulationObservable::Compute(int it, double t, double dt) {
 
 void PopulationObservable::Flush() {
     _file->Flush();
-}
\ No newline at end of file
+}
+// only called on the first rank of all the groups, so plain file streams.
+// Every group projected its own m's, the parts are appended under one header.
+void PopulationObservable::Merge(const std::vector<std::string>& directories) {
+    if (_filename.empty())
+        return;
+
+    std::ofstream file(_filename);
+    file << "(n, l, m)\n";
+    for (auto& dir : directories) {
+        std::ifstream part(dir + "/" + _filename);
+        std::string line;
+        std::getline(part, line);                   // header
+        while (std::getline(part, line))
+            file << line << "\n";
+    }
+}
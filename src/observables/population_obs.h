@@ -21,4 +21,5 @@ public:
     void Shutdown();
     void Compute(int it, double t, double  dt);
     void Flush();
+    void Merge(const std::vector<std::string>& directories);
 };
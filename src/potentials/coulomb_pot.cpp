@@ -237,25 +237,11 @@ void CoulombPotential::FillMatrixGradZ(const Basis::BSpline& basis, Matrix m, in
 
 // utility functions
 void BuildInvR(const Basis::BSpline& basis, int N, double Z, std::vector<complex>& invR) {
-    invR.resize(N*N);
-    for (int i = 0; i < N; i++) {
-        for (int j = i; j < N; j++) {
-            invR[i + j*N] = invR[j + i*N] = basis.Integrate(i+1, j+1, [Z] (complex r) -> complex {
-                return -Z/r;
-            });
-        }
-    }
+    invR = basis.IntegrateOperators({Basis::BSpline::Power(-1, -Z)})[0];
 }
 void BuildInvRR(const Basis::BSpline& basis, int N, double Z, 
     std::vector<complex>& invRR) {
-    invRR.resize(N*N);
-    for (int i = 0; i < N; i++) {
-        for (int j = i; j < N; j++) {
-            invRR[i + j*N] = invRR[j + i*N] = basis.Integrate(i+1, j+1, [Z] (complex r) -> complex {
-                return Z/r/r;
-            });
-        }
-    }
+    invRR = basis.IntegrateOperators({Basis::BSpline::Power(-2, Z)})[0];
 }
 
 void FillBlock( int l1, int m1, int l2, int m2,
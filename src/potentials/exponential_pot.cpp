@@ -161,14 +161,9 @@ void ExponentialPotential::FillMatrixGradZ(const Basis::BSpline& basis, Matrix m
 
 // utility functions
 void BuildExpR(const Basis::BSpline& basis, int N, double Z, double D, std::vector<complex>& expR) {
-    expR.resize(N*N);
-    for (int i = 0; i < N; i++) {
-        for (int j = i; j < N; j++) {
-            expR[i + j*N] = expR[j + i*N] = basis.Integrate(i+1, j+1, [Z,D] (complex r) -> complex {
-                return -Z*std::exp(-D*r);
-            });
-        }
-    }
+    expR = basis.IntegrateOperators({{[Z,D] (complex r) -> complex {
+        return -Z*std::exp(-D*r);
+    }, 0, 0}})[0];
 }
 
 void FillBlock( int l1, int m1, int l2, int m2,
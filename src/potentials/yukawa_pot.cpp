@@ -168,24 +168,14 @@ void YukawaPotential::FillMatrixGradZ(const Basis::BSpline& basis, Matrix m, int
 
 // utility functions
 void BuildExpInvR(const Basis::BSpline& basis, int N, double Z, double D, std::vector<complex>& invR) {
-    invR.resize(N*N);
-    for (int i = 0; i < N; i++) {
-        for (int j = i; j < N; j++) {
-            invR[i + j*N] = invR[j + i*N] = basis.Integrate(i+1, j+1, [Z,D] (complex r) -> complex {
-                return (-Z/r)*std::exp(-D*r);
-            });
-        }
-    }
+    invR = basis.IntegrateOperators({{[Z,D] (complex r) -> complex {
+        return (-Z/r)*std::exp(-D*r);
+    }, 0, 0}})[0];
 }
 void BuildExpInvRR(const Basis::BSpline& basis, int N, double Z, double D, std::vector<complex>& invRR) {
-    invRR.resize(N*N);
-    for (int i = 0; i < N; i++) {
-        for (int j = i; j < N; j++) {
-            invRR[i + j*N] = invRR[j + i*N] = basis.Integrate(i+1, j+1, [Z,D] (complex r) -> complex {
-                return (Z/r/r)*std::exp(-D*r);
-            });
-        }
-    }
+    invRR = basis.IntegrateOperators({{[Z,D] (complex r) -> complex {
+        return (Z/r/r)*std::exp(-D*r);
+    }, 0, 0}})[0];
 }
 
 void FillBlock( int l1, int m1, int l2, int m2,
@@ -0,0 +1,196 @@
+#include "arnoldi.h"
+#include "maths/dense.h"
+#include "utility/logger.h"
+#include "utility/profiler.h"
+#include "utility/memory_tracker.h"
+#include <cmath>
+
+using namespace std::complex_literals;
+
+ArnoldiTDSE::ArnoldiTDSE(MathLib& lib) : TDSE(lib), _tol(1e-10), _max_dim(30), _dims(0), _steps(0), _substeps(0) {
+}
+void ArnoldiTDSE::SetTolerance(double tol) {
+    _tol = tol;
+}
+void ArnoldiTDSE::SetMaxDimension(int dim) {
+    _max_dim = dim;
+}
+
+void ArnoldiTDSE::Initialize() {
+    ProfilerPush();
+
+    double memory = Resources().bytes/1024./1024./1024.;
+
+    LOG_INFO("Initialize TDSE");
+    LOG_INFO("Building Hamiltonian and overlap matrix...");
+    LOG_INFO("Estimated memory required: " + std::to_string(memory) + " GB.");
+    Log::flush();
+    BuildMatrices();
+    BuildKrylov();
+
+    Log::info("Arnoldi initialization complete.");
+    ProfilerPop();
+}
+
+TDSE::resources ArnoldiTDSE::Resources() const {
+    resources r = TDSE::Resources();
+    r.AddVectors(_max_dim + 2, _dof);           // Krylov basis and a temporary
+    return r;
+}
+
+void ArnoldiTDSE::BuildMatrices() {
+    MemoryOwner owner("Hamiltonian");
+    _H0 = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+    _S = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+    if (_pol[X])
+        _HI[X] = _MathLib.CreateMatrix(_dof, _dof, 8*_order-4);
+    if (_pol[Y])
+        _HI[Y] = _MathLib.CreateMatrix(_dof, _dof, 8*_order-4);
+    if (_pol[Z])
+        _HI[Z] = _MathLib.CreateMatrix(_dof, _dof, 4*_order-2);
+
+    FillFieldFree(_H0);
+    FillOverlap(_S);
+    if (_pol[X])
+        FillInteractionX(_HI[X]);
+    if (_pol[Y])
+        FillInteractionY(_HI[Y]);
+    if (_pol[Z])
+        FillInteractionZ(_HI[Z]);
+
+    std::vector<Matrix> terms;
+    for (int xn = X; xn <= Z; xn++)
+        if (_HI[xn])
+            terms.push_back(_HI[xn]);
+    _coeffs.resize(terms.size());
+    _H = _MathLib.CreateCompositeMatrix(_H0, terms);
+}
+
+void ArnoldiTDSE::BuildKrylov() {
+    MemoryOwner owner("propagator");
+    // S is the same radial overlap in every (l,m)-block
+    Log::info("Factoring the overlap matrix...");
+    _S_solver = _MathLib.CreateBlockTridiagonalSolver(_S, std::vector<Matrix>(), _N, _order-1, true);
+    if (!_S_solver)
+        LOG_CRITICAL("Arnoldi: the overlap matrix is not block diagonal.");
+
+    for (int i = 0; i <= _max_dim; i++)
+        _V.push_back(_MathLib.CreateVector(_dof));
+}
+
+void ArnoldiTDSE::Finish() {
+    if (_substeps > 0)
+        LOG_INFO("Arnoldi: " + std::to_string(double(_dims)/_substeps) + " Krylov vectors per exponential, "
+                + std::to_string(double(_substeps)/_steps) + " exponentials per step.");
+
+    _S = nullptr;
+    _H0 = nullptr;
+    _HI[X] = nullptr;
+    _HI[Y] = nullptr;
+    _HI[Z] = nullptr;
+    _H = nullptr;
+    _S_solver = nullptr;
+    _V.clear();
+    _psi = nullptr;
+}
+
+bool ArnoldiTDSE::DoStep(int it, double t, double dt) {
+    // H at the middle of the step, exp(-i dt H) is then second order in dt
+    if (!DoStepAt(t, dt)) {
+        LOG_CRITICAL("Arnoldi: no convergence at iteration " + std::to_string(it));
+        return false;
+    }
+
+    if ((_checkpoints != 0) && (it % _checkpoints == 0))
+        LOG_INFO("Krylov vectors per exponential: " + std::to_string(double(_dims)/_substeps)
+                + ", exponentials per step: " + std::to_string(double(_substeps)/_steps));
+    return true;
+}
+
+bool ArnoldiTDSE::DoStepAt(double t, double dt) {
+    Vec3 f = FieldAt(t + 0.5*dt);
+    const double field[DimIndex::NUM] = {f.x, f.y, f.z};
+
+    int k = 0;
+    for (int xn = X; xn <= Z; xn++)
+        if (_HI[xn])
+            _coeffs[k++] = -1.i*field[xn];
+    if (!_coeffs.empty())
+        _MathLib.SetCompositeCoefficients(_H, _coeffs);
+
+    _steps++;
+    return Exponential(dt);
+}
+int ArnoldiTDSE::StepOrder() const {
+    return 2;
+}
+
+bool ArnoldiTDSE::Exponential(double dt) {
+    int ld = _max_dim + 1;
+    double remaining = dt;
+    if (!_S_solver)
+        return false;
+
+    while (remaining > 0.) {
+        complex dot;
+        _MathLib.Dot(_psi, _psi, dot);
+        double beta = std::sqrt(dot.real());
+        if (beta == 0.)
+            return true;
+        _V[0]->Copy(_psi);
+        _V[0]->Scale(1./beta);
+
+        std::vector<complex> H(ld*_max_dim, 0.), small, E;
+        double tau = remaining, err = 0.;
+        int m = 0;
+
+        // exp(-i tau H_m) e1 and its error estimate beta*h_m+1,m*|e_m^T exp(-i tau H_m) e1|
+        auto exponential = [&](double h) {
+            small.assign(m*m, 0.);
+            for (int j = 0; j < m; j++)
+                for (int i = 0; i <= std::min(j+1, m-1); i++)
+                    small[i + j*m] = -1.i*tau*H[i + j*ld];
+            E = Dense::Expm(m, small);
+            err = beta*h*std::abs(E[m-1]);
+        };
+
+        for (int j = 0; j < _max_dim; j++) {
+            // V_j+1 = S^-1 H V_j, orthogonalized against the basis
+            _MathLib.Mult(_H, _V[j], _V[j+1]);
+            if (!_S_solver->Solve(_V[j+1], _V[j+1]))
+                return false;
+            for (int i = 0; i <= j; i++) {
+                _MathLib.Dot(_V[j+1], _V[i], H[i + j*ld]);
+                _MathLib.AXPY(_V[j+1], -H[i + j*ld], _V[i]);
+            }
+            _MathLib.Dot(_V[j+1], _V[j+1], dot);
+            double h = std::sqrt(dot.real());
+            H[j+1 + j*ld] = h;
+            m = j+1;
+
+            exponential(h);
+            if (err <= _tol*tau/dt)
+                break;
+            if (j == _max_dim-1) {
+                // the basis does not depend on tau: shorten the substep until it is accurate enough
+                for (int halvings = 0; err > _tol*tau/dt; halvings++) {
+                    if (halvings == 50)
+                        return false;
+                    tau /= 2.;
+                    exponential(h);
+                }
+                break;
+            }
+            _V[j+1]->Scale(1./h);
+        }
+
+        _psi->Zero();
+        for (int i = 0; i < m; i++)
+            _MathLib.AXPY(_psi, beta*E[i], _V[i]);
+
+        remaining -= tau;
+        _dims += m;
+        _substeps++;
+    }
+    return true;
+}
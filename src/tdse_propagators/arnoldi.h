@@ -0,0 +1,37 @@
+#pragma once
+
+#include "tdse/tdse.h"
+#include <complex>
+
+// Short iterative Arnoldi propagator: psi(t+dt) = exp(-i dt S^-1 H(t)) psi(t)
+// is approximated in the Krylov space of S^-1 H(t). The dimension grows
+// until the a posteriori error estimate is below the tolerance; if the
+// maximum dimension is not enough the step is split into substeps.
+class ArnoldiTDSE : public TDSE {
+protected:
+    Matrix _S, _H0, _HI[DimIndex::NUM];
+    Matrix _H;                                  // H0 + sum_k c_k(t)*HI_k, applied as products
+    BlockTridiagonalSolver _S_solver;           // banded LU of the (l,m)-blocks of S
+    std::vector<complex> _coeffs;
+
+    std::vector<Vector> _V;                     // Krylov basis
+    double _tol;                                // error per time step
+    int _max_dim;
+    long _dims;                                 // statistics: total Krylov dimension
+    int _steps, _substeps;
+
+    void BuildMatrices();                       // S, H0, HI and the composite H
+    void BuildKrylov();                         // the LU of S and the basis
+    bool Exponential(double dt);                // _psi = exp(-i dt S^-1 H) _psi
+public:
+    ArnoldiTDSE(MathLib& lib);
+    void SetTolerance(double tol);
+    void SetMaxDimension(int dim);
+
+    void Initialize();
+    resources Resources() const;
+    bool DoStep(int it, double t, double dt);
+    bool DoStepAt(double t, double dt);         // exponential midpoint rule
+    int StepOrder() const;
+    void Finish();
+};
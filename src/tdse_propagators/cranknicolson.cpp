@@ -6,10 +6,12 @@
 #include <sstream>
 #include <string>
 #include <algorithm>
+#include <cmath>
 
 #include "utility/index_manip.h"
 #include "utility/logger.h"
 #include "utility/profiler.h"
+#include "utility/memory_tracker.h"
 
 
 
@@ -18,18 +20,86 @@
 
 using namespace std::complex_literals;
 
-CrankNicolsonTDSE::CrankNicolsonTDSE(MathLib& lib) : TDSE(lib) {
+CrankNicolsonTDSE::CrankNicolsonTDSE(MathLib& lib) : TDSE(lib), _solver_type(GMRES), _pc_type(BlockJacobi), _krylov_dim(40), _recycle(10), _iterations(0), _steps(0),
+    _guess_type(Previous), _history_size(4), _history_count(0), _propagator_dt(0.), _matrix_free(false),
+    _mixed_precision(false), _refinements(0), _inner_iterations(0), _refined_residual(0.), _double_tolerance(1e-15),
+    _adaptive_l(false), _l_threshold(1e-12), _l_increment(2), _l_start(-1), _l_active(0),
+    _radial_window(false), _r_threshold(1e-16), _r_margin(40), _r_start(0), _r_active(0) {
+}
+void CrankNicolsonTDSE::SetMatrixFree(bool flag) {
+    _matrix_free = flag;
+}
+void CrankNicolsonTDSE::SetSolver(Solver solver) {
+    _solver_type = solver;
+}
+void CrankNicolsonTDSE::SetPreconditioner(Preconditioner pc) {
+    _pc_type = pc;
+}
+void CrankNicolsonTDSE::SetMixedPrecision(bool flag) {
+    _mixed_precision = flag;
+}
+void CrankNicolsonTDSE::SetAdaptiveL(double threshold, int increment, int lstart) {
+    _adaptive_l = true;
+    _l_threshold = threshold;
+    _l_increment = increment;
+    _l_start = lstart;
+}
+void CrankNicolsonTDSE::SetRadialWindow(double threshold, int margin, int start) {
+    _radial_window = true;
+    _r_threshold = threshold;
+    _r_margin = margin;
+    _r_start = start;
+}
+void CrankNicolsonTDSE::SetRecycling(int krylovDim, int recycle) {
+    _krylov_dim = krylovDim;
+    _recycle = recycle;
 }
 void CrankNicolsonTDSE::Initialize() {
     ProfilerPush();
+    MemoryOwner owner("Hamiltonian");
+
+    if (_solver_type == BlockTridiagonal && (_pol[X] || _pol[Y])) {
+        LOG_WARN("The block tridiagonal solver needs z-polarization only. Using GMRES.");
+        _solver_type = GMRES;
+    }
+    if (_solver_type == GCRODR && _pc_type != FieldFreeLU) {
+        LOG_INFO("GCRO-DR is always preconditioned with the field free LU.");
+        _pc_type = FieldFreeLU;
+    }
+    if (_mixed_precision && _solver_type == BlockTridiagonal) {
+        LOG_WARN("The block tridiagonal solver is direct. Mixed precision is ignored.");
+        _mixed_precision = false;
+    }
+    if (BatchSize() > 1 && _guess_type != Previous) {
+        LOG_WARN("The initial guess history is kept for a single state. Using the previous psi for the batch.");
+        _guess_type = Previous;
+    }
+    if (_mixed_precision && _pc_type != FieldFreeLU) {
+        LOG_INFO("Mixed precision GMRES is always preconditioned with the field free LU.");
+        _pc_type = FieldFreeLU;             // block Jacobi would need the single precision U+ assembled
+    }
+    if ((_adaptive_l || _radial_window) && BatchSize() > 1) {
+        LOG_WARN("The active range is tracked for a single state. Propagating all rows for the batch.");
+        _adaptive_l = _radial_window = false;
+    }
+    // a few l above the highest of the initial state
+    if (_adaptive_l && _l_start < 0) {
+        _l_start = 0;
+        for (auto& state : _initial_state)
+            _l_start = std::max(_l_start, state.l + _l_increment);
+    }
+    _l_start = (_adaptive_l ? std::min(_l_start, _lmax) : _lmax);
+    // without a start the window is sized from the initial state on the first step,
+    // the propagator is built for the margin until then
+    _r_start = (_radial_window ? std::min(_r_start, _N) : _N);
+    SetActiveRange(_l_start, (_r_start > 0 ? _r_start : std::min(_r_margin, _N)));
+    _trajectory.clear();
+    if (!_active_rows.empty())
+        LOG_INFO("Active range: l <= " + std::to_string(_l_active) + " of " + std::to_string(_lmax)
+                + ", B-splines " + std::to_string(_r_active) + " of " + std::to_string(_N)
+                + " (" + std::to_string(_active_rows.size()) + " of " + std::to_string(_dof) + " rows).");
 
-    double memory = 2*(2*_order-1) + 4*_maxBands;
-    if (_pol[X]) memory += 8*_order-4;
-    if (_pol[Y]) memory += 8*_order-4;
-    if (_pol[Z]) memory += 4*_order-2;
-    memory += 2; 
-    memory *= _dof;
-    memory = memory*16/1024./1024./1024.;
+    double memory = Resources().bytes/1024./1024./1024.;
 
     LOG_INFO("Initialize TDSE");
     // ---------------------------------------------------------------
@@ -38,8 +108,8 @@ void CrankNicolsonTDSE::Initialize() {
     LOG_INFO("Estimated memory required: " + std::to_string(memory) + " GB.");
     Log::flush();
     LOG_INFO("Allocating space...");
-    Matrix H0 = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
-    Matrix S = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+    _H0 = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+    _S = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
     
     if (_pol[X])
         _HI[X] = _MathLib.CreateMatrix(_dof, _dof, 8*_order-4);
@@ -47,16 +117,11 @@ void CrankNicolsonTDSE::Initialize() {
         _HI[Y] = _MathLib.CreateMatrix(_dof, _dof, 8*_order-4);
     if (_pol[Z])
         _HI[Z] = _MathLib.CreateMatrix(_dof, _dof, 4*_order-2);
-    
-    _U0p = _MathLib.CreateMatrix(_dof, _dof, _maxBands);
-    _U0m = _MathLib.CreateMatrix(_dof, _dof, _maxBands);
-    _Up = _MathLib.CreateMatrix(_dof, _dof, _maxBands);
-    _Um = _MathLib.CreateMatrix(_dof, _dof, _maxBands);
 
     Log::info("...");
-    FillFieldFree(H0);
+    FillFieldFree(_H0);
     Log::info("...");
-    FillOverlap(S);
+    FillOverlap(_S);
     Log::info("...");
 
     if (_pol[X])
@@ -66,10 +131,64 @@ void CrankNicolsonTDSE::Initialize() {
     if (_pol[Z])
         FillInteractionZ(_HI[Z]);
 
+    BuildPropagator();
+    //-----------------------------------------------
+    Log::info("Crank-Nicolson initialization complete.");
+
+    // z -> m=m, l=l+-1
+    // x -> m=m+-1, l=l+-1
+    // y -> m=m+-1, l=l+-1
+    
+    ProfilerPop();
+}
+TDSE::resources CrankNicolsonTDSE::Resources() const {
+    resources r = TDSE::Resources();
+    int numU = 2;                                   // U0+/-
+    if (!_matrix_free)
+        numU += (_solver_type == BlockTridiagonal ? 1 : 2);     // U+ is not needed by the direct solver
+    r.AddMatrix(double(numU)*_maxBands*_dof);
+    r.AddVectors(BatchSize(), _dof);                // psi_temp and the U- psi of the other members
+    if (_solver_type == GCRODR)
+        r.AddVectors(_krylov_dim + 4*_recycle + 4, _dof);   // Krylov basis, U and C of the recycled subspace and the next ones
+    if (_guess_type != Previous)
+        r.AddVectors(2*_history_size + 1, _dof);
+    if (_mixed_precision) {
+        double single = 2*_order-1;                 // 8 bytes per value plus a 4 byte index
+        if (_pol[X]) single += 8*_order-4;
+        if (_pol[Y]) single += 8*_order-4;
+        if (_pol[Z]) single += 4*_order-2;
+        r.nnz += single*_dof;
+        r.bytes += single*_dof*(sizeof(std::complex<float>) + sizeof(int));
+        r.AddVectors(2, _dof);
+    }
+    // Banded LUs with kl = ku = kd and kl fill-in diagonals, rows are split
+    // among the ranks (a chain over several ranks by radial index).
+    auto lu_bytes = [](double rows, int kd) { return rows*((3*kd+1)*sizeof(complex) + sizeof(int)); };
+    // the (l,m)-blocks of U0+, shared by the field free LU preconditioner and the field free steps
+    r.bytes += lu_bytes(_dof, _order-1);
+    if (_solver_type == BlockTridiagonal) {
+        // HI_z couples the l of each m into one chain, factored as a single band,
+        // and the banded blocks of U0+ and HI_z are cached to refactor every step
+        for (int m : _Ms) {
+            int blocks = _lmax - std::abs(m) + 1;
+            r.bytes += lu_bytes(double(blocks)*_N, (_order-1)*blocks + (blocks > 1 ? 1 : 0));
+            r.bytes += 2.*3*blocks*_N*(2*_order-1)*sizeof(complex);
+        }
+    }
+    if (!_matrix_free)
+        r.work = double(_maxBands)*_dof;            // U+/- assembled
+    return r;
+}
+// U0+/- and everything built from them: the solver, its preconditioner
+// and U+/-. H0, S and HI are kept so this can be redone for another dt.
+void CrankNicolsonTDSE::BuildPropagator() {
+    MemoryOwner owner("propagator");
     // ---------------------------------------------------------------
     // Initialize the static propagator matrices (U0+/-)
     Log::info("Building propagator matrix...");
 
+    _U0p = _MathLib.CreateMatrix(_dof, _dof, _maxBands);
+    _U0m = _MathLib.CreateMatrix(_dof, _dof, _maxBands);
     FillU0(_U0p);
     FillU0(_U0m);
 
@@ -80,65 +199,522 @@ void CrankNicolsonTDSE::Initialize() {
 
 
     // add overlap (and zero off-diagonal blocks)
-    _MathLib.AYPX(_U0p, 0, S);
-    _MathLib.AYPX(_U0m, 0, S);
+    _MathLib.AYPX(_U0p, 0, _S);
+    _MathLib.AYPX(_U0m, 0, _S);
     // add fieldfree hamiltonian
-    _MathLib.AXPY(_U0p, 0.5i*_dt, H0);
-    _MathLib.AXPY(_U0m, -0.5i*_dt, H0);
+    _MathLib.AXPY(_U0p, 0.5i*_dt, _H0);
+    _MathLib.AXPY(_U0m, -0.5i*_dt, _H0);
+    _propagator_dt = _dt;
+
+    // only the active rows are propagated (blocks of _r_active B-splines), the rest of psi is still zero
+    for (int xn = X; xn <= Z; xn++)
+        _HI_active[xn] = _HI[xn];
+    if (!_active_rows.empty()) {
+        _U0p = _MathLib.CreateSubMatrix(_U0p, _active_rows);
+        _U0m = _MathLib.CreateSubMatrix(_U0m, _active_rows);
+        for (int xn = X; xn <= Z; xn++)
+            if (_HI[xn])
+                _HI_active[xn] = _MathLib.CreateSubMatrix(_HI[xn], _active_rows);
+    }
+    int dof = (_active_rows.empty() ? _dof : _active_rows.size());
 
     // std::cout << "M=" << _initial_state[0].m << std::endl;
     // MatView(std::dynamic_pointer_cast<PetscMatrix>(_U0p)->_petsc_mat, 0);
     // exit(0);
 
-    _Up->Duplicate(_U0p);
-    _Um->Duplicate(_U0m);
-    
-    _psi_temp = _MathLib.CreateVector(_dof);        // storage used to hold intermediate psi during propagation
+    _psi_temp = _MathLib.CreateVector(_U0p);       // U- psi, laid out like the active rows of psi
+    std::vector<Matrix> terms;
+    for (int xn = X; xn <= Z; xn++)
+        if (_HI_active[xn])
+            terms.push_back(_HI_active[xn]);
+    _coeffs.resize(terms.size());
     //-----------------------------------------------
     // Create solver
-    _solver = _MathLib.CreateGMRESSolver();
-    _solver->SetBlockedPC(_N);
-    //-----------------------------------------------
-    Log::info("Crank-Nicolson initialization complete.");
+    _solver = nullptr;
+    _field_free_solver = nullptr;               // factored from U0+ on the next field free step
+    if (_solver_type == BlockTridiagonal) {
+        // U+ is only ever factored from the cached blocks of U0+ and HI_z
+        Log::info("Caching propagator blocks for the direct solver...");
+        _block_solver = _MathLib.CreateBlockTridiagonalSolver(_U0p, terms, _r_active, _order-1);
+        if (!_block_solver) {
+            LOG_WARN("The propagator is not block tridiagonal. Using GMRES.");
+            _solver_type = GMRES;
+        }
+    }
+    if (_solver_type != BlockTridiagonal) {
+        if (_solver_type == GCRODR)
+            _solver = _MathLib.CreateGCRODRSolver(_krylov_dim, _recycle);
+        else
+            _solver = _MathLib.CreateGMRESSolver();
+        if (_pc_type == FieldFreeLU)
+            _solver->SetBlockDiagonalPC(_U0p, _r_active, _order-1);      // S + i dt/2 H0_l is the same every step
+        else
+            _solver->SetBlockedPC(dof/_r_active);
+    }
 
-    // z -> m=m, l=l+-1
-    // x -> m=m+-1, l=l+-1
-    // y -> m=m+-1, l=l+-1
-    
+    if (_matrix_free) {
+        // U+/- = U0+/- + sum_k c_k(t)*HI_k are only ever applied, never built.
+        // The field free U0+ stands in for U+ when building the preconditioner.
+        _Um = _MathLib.CreateCompositeMatrix(_U0m, terms);
+        if (_solver) {
+            _Up = _MathLib.CreateCompositeMatrix(_U0p, terms);
+            _solver->SetPreconditionerMatrix(_U0p);
+        }
+    } else {
+        _Um = _MathLib.CreateMatrix(dof, dof, _maxBands);
+        _Um->Duplicate(_U0m);
+        if (_solver) {
+            _Up = _MathLib.CreateMatrix(dof, dof, _maxBands);
+            _Up->Duplicate(_U0p);
+        }
+    }
+    // U+ in single precision for the inner solves. The Krylov vectors stay in
+    // double, the matrix values (most of the traffic of a product) are halved.
+    if (_mixed_precision) {
+        Log::info("Single precision copy of the propagator...");
+        std::vector<Matrix> single_terms;
+        _U0p_single = _MathLib.CreateSinglePrecisionMatrix(_U0p);
+        for (int xn = X; xn <= Z; xn++) {
+            if (_HI_active[xn]) {
+                _HI_single[xn] = _MathLib.CreateSinglePrecisionMatrix(_HI_active[xn]);
+                single_terms.push_back(_HI_single[xn]);
+            }
+        }
+        _Up_single = _MathLib.CreateCompositeMatrix(_U0p_single, single_terms);
+        _residual = _MathLib.CreateVector(_U0p);
+        _correction = _MathLib.CreateVector(_U0p);
+        _double_tolerance = _solver->Tolerance();
+        _solver->SetTolerance(1e-6);                // about the accuracy of the single precision operator
+    }
+    // recent solutions for the initial guess, plus work space (U+ psi_i and a residual)
+    _history.clear();
+    _history_work.clear();
+    if (_solver && _guess_type != Previous) {
+        _history_count = 0;
+        _history_t.assign(_history_size, 0.);
+        for (int i = 0; i < _history_size; i++)
+            _history.push_back(_MathLib.CreateVector(_U0p));
+        for (int i = 0; i < (_guess_type == Projection ? _history_size : 0) + 1; i++)
+            _history_work.push_back(_MathLib.CreateVector(_U0p));
+    }
+}
+void CrankNicolsonTDSE::Reinitialize() {
+    _history_count = 0;                         // the last solutions are from another run
+    bool rebuild = (_dt != _propagator_dt);
+    int radial = (_r_start > 0 ? _r_start : _r_active);
+    if (_l_active != _l_start || _r_active != radial) {
+        SetActiveRange(_l_start, radial);       // the next run starts from the initial state again
+        _trajectory.clear();
+        rebuild = true;
+    }
+    if (rebuild) {
+        ProfilerPush();
+        LOG_INFO("Rebuilding the propagator for dt = " + std::to_string(_dt) + "...");
+        BuildPropagator();
+        ProfilerPop();
+    }
+}
+// Rows of the (l,m)-blocks with l <= l_active, and in each of them the
+// first radial B-splines, in the order of psi
+void CrankNicolsonTDSE::SetActiveRange(int l, int radial) {
+    _l_active = l;
+    _r_active = radial;
+    _active_rows.clear();
+    if (l >= _lmax && radial >= _N)
+        return;                                 // everything is active
+
+    for (int i = 0; i < _Ms.size(); i++) {
+        int blocks = std::max(0, std::min(l, _lmax) - std::abs(_Ms[i]) + 1);
+        for (int block = 0; block < blocks; block++)
+            for (int row = 0; row < radial; row++)
+                _active_rows.push_back(_mRows[i] + block*_N + row);
+    }
+}
+double CrankNicolsonTDSE::BlockNorm(int l) {
+    double norm = 0.;
+    complex dot;
+    for (int i = 0; i < _Ms.size(); i++) {
+        if (std::abs(_Ms[i]) > l)
+            continue;
+        int start = _mRows[i] + (l - std::abs(_Ms[i]))*_N;
+        Vector block = _psi->GetSubVector(start, start+_N);
+        _MathLib.Dot(block, block, dot);
+        _psi->RestoreSubVector(block);
+        norm = std::max(norm, std::abs(dot));
+    }
+    return norm;
+}
+// The radial window starts a margin beyond the last B-spline the initial
+// state populates (in any block).
+void CrankNicolsonTDSE::StartRadialWindow() {
+    _r_start = std::min(_psi->LastIndexAbove(_r_threshold, _N) + 1 + _r_margin, _N);
+    if (_r_start == _r_active)
+        return;
+
+    ProfilerPush();
+    SetActiveRange(_l_active, _r_start);
+    LOG_INFO("Active range starts at l <= " + std::to_string(_l_active) + ", " + std::to_string(_r_start) + " B-splines ("
+            + std::to_string(_active_rows.empty() ? _dof : _active_rows.size()) + " of " + std::to_string(_dof) + " rows).");
+    BuildPropagator();
+    ProfilerPop();
+}
+// Grows the active range where psi reached its edge and rebuilds the
+// propagator for it. The range never shrinks. Without field only the
+// radial window moves.
+void CrankNicolsonTDSE::GrowActiveRange(double t, bool field) {
+    if (_radial_window && _r_start <= 0)
+        StartRadialWindow();
+    int l = _l_active, radial = _r_active;
+
+    // The interaction only couples l to l+-1, so population reaches the
+    // inactive blocks through the outermost active one.
+    if (_adaptive_l && field)
+        while (l < _lmax && BlockNorm(l) > _l_threshold)
+            l = std::min(l + _l_increment, _lmax);
+
+    // A margin of empty B-splines is kept ahead of the wavepacket (in every
+    // block), once half of it is used up the window moves out.
+    if (_radial_window && radial < _N) {
+        int outer = _psi->LastIndexAbove(_r_threshold, _N);
+        if (outer + 1 + _r_margin/2 > radial)
+            radial = std::min(outer + 1 + _r_margin, _N);
+    }
+    if (l == _l_active && radial == _r_active)
+        return;
+
+    ProfilerPush();
+    SetActiveRange(l, radial);
+    _trajectory.push_back(growth{t, l, radial});
+    LOG_INFO("Active range grows to l <= " + std::to_string(l) + ", " + std::to_string(radial) + " B-splines at t = "
+            + std::to_string(t) + " (" + std::to_string(_active_rows.empty() ? _dof : _active_rows.size())
+            + " of " + std::to_string(_dof) + " rows).");
+    BuildPropagator();
     ProfilerPop();
 }
 
 void CrankNicolsonTDSE::Finish() {
+    if (_solver && _steps > 0)
+        LOG_INFO("GMRES iterations: " + std::to_string(_iterations) + " total, "
+                + std::to_string(double(_iterations)/_steps) + " per step ("
+                + (_solver_type == GCRODR ? "GCRO-DR, " : "")
+                + (_pc_type == FieldFreeLU ? "field free LU" : "block Jacobi")
+                + (_mixed_precision ? ", single precision with refinement" : "") + ").");
+    if (_adaptive_l || _radial_window) {
+        std::string trajectory = "Active range: l <= " + std::to_string(_l_start) + ", " + std::to_string(_r_start) + " B-splines";
+        for (auto& g : _trajectory)
+            trajectory += "; " + std::to_string(g.l) + ", " + std::to_string(g.radial) + " (t = " + std::to_string(g.t) + ")";
+        LOG_INFO(trajectory);
+    }
+
     _U0p = nullptr;
     _U0m = nullptr;
+    _H0 = nullptr;
+    _S = nullptr;
     _HI[X] = nullptr;
     _HI[Y] = nullptr;
     _HI[Z] = nullptr;
+    _HI_active[X] = nullptr;
+    _HI_active[Y] = nullptr;
+    _HI_active[Z] = nullptr;
     _Up = nullptr;
     _Um = nullptr;
     _psi = nullptr;
     _psi_temp = nullptr;
     _solver = nullptr;
+    _block_solver = nullptr;
+    _field_free_solver = nullptr;
+    _U0p_single = nullptr;
+    _HI_single[X] = nullptr;
+    _HI_single[Y] = nullptr;
+    _HI_single[Z] = nullptr;
+    _Up_single = nullptr;
+    _residual = nullptr;
+    _correction = nullptr;
+    _batch_temp.clear();
+    _history.clear();
+    _history_work.clear();
 }
-bool CrankNicolsonTDSE::DoStep(int it, double t, double dt) {
-    _Up->Copy(_U0p);
-    _Um->Copy(_U0m);
+// U+ and U- of iteration it: the coefficients of the composites or the assembled sums
+void CrankNicolsonTDSE::UpdatePropagator(int it, double dt) {
+    // coefficients of the interaction matrices in U+ (U- has the opposite sign)
+    int k = 0;
+    for (int xn = X; xn <= Z; xn++)
+        if (_HI_active[xn])
+            _coeffs[k++] = 0.5i*dt*(-1.i*_field[xn][it]);
+
+    if (_block_solver)
+        _block_solver->SetCoefficients(_coeffs);
+    if (_Up_single)
+        _MathLib.SetCompositeCoefficients(_Up_single, _coeffs);
+
+    if (_matrix_free) {
+        if (_Up)
+            _MathLib.SetCompositeCoefficients(_Up, _coeffs);
 
-    for (int xn = X; xn <= Z; xn++) {
-        if (_HI[xn]) {
-            _MathLib.AXPY(_Up, 0.5i*dt*(-1.i*_field[xn][it]), _HI[xn]);
-            _MathLib.AXPY(_Um, -0.5i*dt*(-1.i*_field[xn][it]), _HI[xn]);
+        for (auto& coeff : _coeffs)
+            coeff = -coeff;
+        _MathLib.SetCompositeCoefficients(_Um, _coeffs);
+    } else {
+        if (_Up)
+            _Up->Copy(_U0p);
+        _Um->Copy(_U0m);
+
+        for (int xn = X; xn <= Z; xn++) {
+            if (_HI_active[xn]) {
+                if (_Up)
+                    _MathLib.AXPY(_Up, 0.5i*dt*(-1.i*_field[xn][it]), _HI_active[xn]);
+                _MathLib.AXPY(_Um, -0.5i*dt*(-1.i*_field[xn][it]), _HI_active[xn]);
+            }
         }
     }
-    
+}
+// With an active range (adaptive l, radial window) the propagator only has the active rows: psi
+// is cut down to them for the step and put back into the full vector.
+bool CrankNicolsonTDSE::DoStep(int it, double t, double dt) {
+    if (_adaptive_l || _radial_window)
+        GrowActiveRange(t);
+    if (_active_rows.empty())
+        return Step(it, t, dt);
+
+    Vector full = _psi;
+    _psi = full->GetSubVector(_active_rows);
+    _step_info.rows = _active_rows.size();
+    bool success = Step(it, t, dt);
+    full->RestoreSubVector(_psi);
+    _psi = full;
+    return success;
+}
+bool CrankNicolsonTDSE::Step(int it, double t, double dt) {
+    Timer timer;
+    timer.Reset();
+    UpdatePropagator(it, dt);
+    _step_info.update = timer.Elapsed();
     _MathLib.Mult(_Um, _psi, _psi_temp);
-    if (!_solver->Solve(_Up, _psi_temp, _psi)) {
-        std::cout << "divergence!" << std::endl;
-        return false;               // failure
+    _step_info.mult = timer.Elapsed();
+    if (_block_solver) {
+        bool solved = _block_solver->Solve(_psi_temp, _psi);
+        _step_info.solve = timer.Elapsed();
+        if (!solved)
+            return false;           // failure
+    } else {
+        bool checkpoint = (_checkpoints != 0) && (it % _checkpoints == 0);
+        double res_previous = 0., res_guess = 0.;
+        if (!_history.empty()) {
+            if (_history_count == 0)
+                StoreSolution(t);
+            if (checkpoint)
+                res_previous = ResidualNorm(_psi_temp, _psi);
+            BuildInitialGuess(_psi_temp, t+dt);
+            if (checkpoint)
+                res_guess = ResidualNorm(_psi_temp, _psi);
+        }
+
+        bool solved = (_mixed_precision ? SolveMixedPrecision(_psi_temp) : _solver->Solve(_Up, _psi_temp, _psi));
+        _step_info.solve = timer.Elapsed();
+        _step_info.residual = (_mixed_precision ? _refined_residual : _solver->Residual());
+        _step_info.reason = _solver->ConvergedReason();
+        if (!solved) {
+            std::cout << "divergence!" << std::endl;
+            return false;           // failure
+        }
+        int iterations = (_mixed_precision ? _inner_iterations : _solver->Iterations());
+        _step_info.iterations = iterations;
+        _iterations += iterations;
+        _steps++;
+
+        if (!_history.empty())
+            StoreSolution(t+dt);
+
+        if (checkpoint) {
+            LOG_INFO("GMRES iterations: " + std::to_string(iterations)
+                    + " (average " + std::to_string(double(_iterations)/_steps) + ")");
+            if (_mixed_precision)
+                LOG_INFO("Refinements: " + std::to_string(_refinements) + ", relative residual (double): "
+                        + std::to_string(_refined_residual));
+
+            // iterations saved, assuming GMRES reduces the residual at the same rate from either start
+            double res_final = ResidualNorm(_psi_temp, _psi);
+            if (res_previous > 0. && res_guess > 0. && res_final > 0. && res_final < res_guess && iterations > 0) {
+                double rate = std::log(res_guess/res_final)/iterations;
+                LOG_INFO("Initial guess residual: " + std::to_string(res_guess) + " (previous psi: "
+                        + std::to_string(res_previous) + "), about "
+                        + std::to_string(std::log(res_previous/res_guess)/rate) + " GMRES iterations saved");
+            }
+        }
     }
 
 
 
     return true;
 }
+// Iterative refinement: the residual b - U+ psi is computed in double and
+// the correction is solved with the single precision U+, until the double
+// residual is as small as a double precision GMRES solve would leave it
+// (its tolerance, or the round off of the double product). If it stops
+// improving above that, psi is solved again in double precision.
+bool CrankNicolsonTDSE::SolveMixedPrecision(const Vector b) {
+    const int max_refinements = 10;
+    double target = std::max(_double_tolerance, 1e-14);
+    double previous = 0.;
+    complex dot;
+
+    _MathLib.Dot(b, b, dot);
+    double norm_b = std::sqrt(dot.real());
+    auto residual = [&]() {
+        _MathLib.Mult(_Up, _psi, _residual);
+        _MathLib.AYPX(_residual, -1., b);
+        _MathLib.Dot(_residual, _residual, dot);
+        _refined_residual = (norm_b > 0. ? std::sqrt(dot.real())/norm_b : 0.);
+    };
+    _inner_iterations = 0;
+    for (_refinements = 0; _refinements <= max_refinements; _refinements++) {
+        residual();
+        if (_refined_residual <= target)
+            return true;
+        if (_refinements > 0 && _refined_residual > 0.5*previous)
+            break;                                  // stalled
+        previous = _refined_residual;
+        if (_refinements == max_refinements)
+            break;
+
+        _correction->Zero();
+        if (!_solver->Solve(_Up_single, _residual, _correction))
+            break;
+        _inner_iterations += _solver->Iterations();
+        _MathLib.AXPY(_psi, 1., _correction);
+    }
+    LOG_WARN("Mixed precision: relative residual " + std::to_string(_refined_residual) + " after "
+            + std::to_string(_refinements) + " refinements, solving in double precision.");
+    _solver->SetTolerance(_double_tolerance);
+    bool solved = _solver->Solve(_Up, b, _psi);
+    _inner_iterations += _solver->Iterations();
+    _solver->SetTolerance(1e-6);
+    residual();
+    return solved;
+}
+void CrankNicolsonTDSE::BuildFieldFreeSolver() {
+    // U+ = U0+ is block diagonal in (l,m): one banded LU per block, factored once.
+    // The field free LU preconditioner is exactly that, its factors are shared.
+    if (!_field_free_solver && _solver)
+        _field_free_solver = _solver->BlockDiagonalPC();
+    if (!_field_free_solver) {
+        Log::info("Factoring the field free propagator...");
+        _field_free_solver = _MathLib.CreateBlockTridiagonalSolver(_U0p, std::vector<Matrix>(), _r_active, _order-1, true);
+        if (!_field_free_solver)
+            LOG_CRITICAL("The field free propagator is not block diagonal.");
+    }
+}
+bool CrankNicolsonTDSE::DoFieldFreeStep(int it, double t, double dt) {
+    // the l-blocks do not couple without field, but the wavepacket still spreads
+    if (_radial_window)
+        GrowActiveRange(t, false);
+    if (_active_rows.empty())
+        return FieldFreeStep(it, t, dt);
+
+    Vector full = _psi;
+    _psi = full->GetSubVector(_active_rows);
+    _step_info.rows = _active_rows.size();
+    bool success = FieldFreeStep(it, t, dt);
+    full->RestoreSubVector(_psi);
+    _psi = full;
+    return success;
+}
+bool CrankNicolsonTDSE::FieldFreeStep(int it, double t, double dt) {
+    Timer timer;
+    timer.Reset();
+    BuildFieldFreeSolver();
+    if (!_field_free_solver)
+        return false;
+    _step_info.update = timer.Elapsed();
+    _MathLib.Mult(_U0m, _psi, _psi_temp);
+    _step_info.mult = timer.Elapsed();
+    bool solved = _field_free_solver->Solve(_psi_temp, _psi);
+    _step_info.solve = timer.Elapsed();
+    if (!solved)
+        return false;               // failure
+
+    if (!_history.empty())
+        StoreSolution(t+dt);        // keep the initial guess history continuous
+    return true;
+}
+// All the members with one product of U- and one (multi right hand side)
+// solve with U+, so the matrices are streamed from memory once per step
+// instead of once per member.
+bool CrankNicolsonTDSE::DoBatchStep(int it, double t, double dt) {
+    MemoryOwner owner("propagator");
+    bool field_free = FieldIsZero(it);
+
+    if (_batch_temp.size() != _batch.size()) {
+        _batch_temp.clear();
+        for (int k = 0; k < _batch.size(); k++)
+            _batch_temp.push_back(_MathLib.CreateVector(_dof));
+    }
+
+    Timer timer;
+    timer.Reset();
+    if (field_free) {
+        BuildFieldFreeSolver();
+        if (!_field_free_solver)
+            return false;
+        _step_info.update = timer.Elapsed();
+        _MathLib.Mult(_U0m, _batch, _batch_temp);
+        _step_info.mult = timer.Elapsed();
+        bool solved = _field_free_solver->Solve(_batch_temp, _batch);
+        _step_info.solve = timer.Elapsed();
+        return solved;
+    }
+
+    UpdatePropagator(it, dt);
+    _step_info.update = timer.Elapsed();
+    _MathLib.Mult(_Um, _batch, _batch_temp);
+    _step_info.mult = timer.Elapsed();
+    if (_block_solver) {
+        bool solved = _block_solver->Solve(_batch_temp, _batch);
+        _step_info.solve = timer.Elapsed();
+        return solved;
+    }
 
+    int iterations = 0;
+    if (_mixed_precision) {
+        // the refinement is per member, the single precision U+ is cheap to stream
+        for (int k = 0; k < _batch.size(); k++) {
+            _psi = _batch[k];
+            if (!SolveMixedPrecision(_batch_temp[k])) {
+                _psi = _batch[0];
+                return false;
+            }
+            iterations += _inner_iterations;
+        }
+        _psi = _batch[0];
+        iterations /= _batch.size();
+    } else {
+        if (!_solver->Solve(_Up, _batch_temp, _batch)) {
+            // the reason is that of the whole solve, the members it failed for are those still above the tolerance
+            std::string members;
+            for (int k = 0; k < _batch.size(); k++) {
+                complex rr, bb;
+                _MathLib.Mult(_Up, _batch[k], _psi_temp);
+                _MathLib.AYPX(_psi_temp, -1., _batch_temp[k]);
+                _MathLib.Dot(_psi_temp, _psi_temp, rr);
+                _MathLib.Dot(_batch_temp[k], _batch_temp[k], bb);
+                if (std::sqrt(std::abs(rr)) > _solver->Tolerance()*std::sqrt(std::abs(bb)))
+                    members += " " + std::to_string(k);
+            }
+            LOG_WARN("Batch step " + std::to_string(it) + ": GMRES diverged (reason "
+                    + std::to_string(_solver->ConvergedReason()) + ") for member(s)" + members + ".");
+            return false;           // failure
+        }
+        iterations = _solver->Iterations();
+    }
+    _step_info.solve = timer.Elapsed();
+    _step_info.iterations = iterations;
+    _step_info.residual = (_mixed_precision ? _refined_residual : _solver->Residual());
+    _step_info.reason = _solver->ConvergedReason();
+    _iterations += iterations;
+    _steps++;
+
+    if ((_checkpoints != 0) && (it % _checkpoints == 0))
+        LOG_INFO("GMRES iterations per member: " + std::to_string(iterations)
+                + " (average " + std::to_string(double(_iterations)/_steps) + ")");
+    return true;
+}
@@ -5,24 +5,103 @@
 #include <map>
 
 class CrankNicolsonTDSE : public TDSE {
+public:
+    enum Solver {
+        GMRES,
+        BlockTridiagonal,                       // direct, z-polarization only
+        GCRODR                                  // GMRES recycling a subspace between time steps
+    };
+    enum Preconditioner {
+        BlockJacobi,
+        FieldFreeLU                             // banded LU of the (l,m)-blocks of U0+
+    };
+    enum InitialGuess {
+        Previous,                               // psi of the last step
+        Extrapolate,                            // polynomial through the last few steps
+        Projection                              // least squares in the span of the last few steps
+    };
+private:
     GMRESSolver _solver;
+    BlockTridiagonalSolver _block_solver;
+    BlockTridiagonalSolver _field_free_solver;  // LU of the (l,m)-blocks of U0+, the preconditioner's or built on the first field free step
+    Solver _solver_type;
+    Preconditioner _pc_type;
+    int _krylov_dim, _recycle;                  // GCRO-DR only
+    long _iterations;                           // total GMRES iterations
+    int _steps;
+
+    InitialGuess _guess_type;
+    int _history_size, _history_count;          // ring buffer of the last solutions
+    std::vector<Vector> _history, _history_work;
+    std::vector<double> _history_t;
 
     Vector _psi_temp;
+    std::vector<Vector> _batch_temp;            // U- psi of every member of the batch
+    Matrix _H0, _S;                             // kept to rebuild U0+/- for another dt
     Matrix _U0p, _U0m, _HI[DimIndex::NUM];
+    double _propagator_dt;                      // the dt of U0+/-
     Matrix _Up, _Um;
+
+    bool _matrix_free;                          // _Up/_Um are composite operators over _U0p/_U0m and _HI
+    std::vector<complex> _coeffs;
+
+    bool _mixed_precision;                      // GMRES on single precision copies, refined in double
+    Matrix _U0p_single, _HI_single[DimIndex::NUM], _Up_single;
+    Vector _residual, _correction;
+    int _refinements, _inner_iterations;        // of the last solve
+    double _refined_residual;                   // relative residual of the last solve, in double
+    double _double_tolerance;                   // of the solver before it was loosened for the inner solves
+
+    bool _adaptive_l;                           // only l <= _l_active is propagated, grown when it fills up
+    double _l_threshold;                        // |psi|^2 of the outermost active l-block that grows the range
+    int _l_increment, _l_start, _l_active;
+    bool _radial_window;                        // only the B-splines i < _r_active, grown as the wavepacket spreads
+    double _r_threshold;                        // |c_i|^2 that counts as populated
+    int _r_margin, _r_start, _r_active;
+    std::vector<int> _active_rows;              // of the active range in every m-block, empty when all rows are active
+    struct growth {
+        double t;
+        int l, radial;
+    };
+    std::vector<growth> _trajectory;            // of the active range
+    Matrix _HI_active[DimIndex::NUM];           // _HI on the active rows (_HI itself without restriction)
+
+    bool Step(int it, double t, double dt);     // DoStep on the active rows
+    bool FieldFreeStep(int it, double t, double dt);
 public:
     CrankNicolsonTDSE(MathLib& lib);
+    void SetMatrixFree(bool flag);
+    void SetSolver(Solver solver);
+    void SetPreconditioner(Preconditioner pc);
+    void SetRecycling(int krylovDim, int recycle);
+    void SetInitialGuess(InitialGuess guess, int history);
+    void SetMixedPrecision(bool flag);
+    void SetAdaptiveL(double threshold, int increment, int lstart);     // lstart < 0: from the initial state
+    void SetRadialWindow(double threshold, int margin, int start);      // start <= 0: the margin
+
     void Initialize();
+    resources Resources() const;
+    void Reinitialize();
     bool DoStep(int it, double t, double dt);
+    bool DoFieldFreeStep(int it, double t, double dt);
+    bool DoBatchStep(int it, double t, double dt);
     void Finish();
 
-    void FillFieldFree(Matrix& m);
-    void FillOverlap(Matrix& m);
-    void FillInteractionX(Matrix& m);
-    void FillInteractionY(Matrix& m);
-    void FillInteractionZ(Matrix& m);
+    void BuildPropagator();
+    void UpdatePropagator(int it, double dt);
+    void BuildFieldFreeSolver();
+    void SetActiveRange(int l, int radial);
+    double BlockNorm(int l);                    // largest |psi|^2 of the (l,m)-blocks
+    void StartRadialWindow();                   // sized from the initial state, without "initial_size"
+    void GrowActiveRange(double t, bool field = true);
+
     void FillU0(Matrix& m);
 
+    void BuildInitialGuess(const Vector b, double t);
+    void StoreSolution(double t);
+    double ResidualNorm(const Vector b, const Vector x);
+    bool SolveMixedPrecision(const Vector b);
+
     void DoCheckpoint();
     void DoObservables();
 };
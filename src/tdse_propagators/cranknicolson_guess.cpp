@@ -0,0 +1,81 @@
+#include "tdse_propagators/cranknicolson.h"
+#include "utility/logger.h"
+#include <cmath>
+
+void CrankNicolsonTDSE::SetInitialGuess(InitialGuess guess, int history) {
+    _guess_type = guess;
+    _history_size = history;
+}
+
+double CrankNicolsonTDSE::ResidualNorm(const Vector b, const Vector x) {
+    complex norm;
+    Vector r = _history_work.back();                // spare vector, see Initialize
+    _MathLib.Mult(_Up, x, r);
+    _MathLib.AYPX(r, -1., b);
+    _MathLib.Dot(r, r, norm);
+    return std::sqrt(norm.real());
+}
+
+// keep psi(t) in the ring buffer (the oldest entry is overwritten)
+void CrankNicolsonTDSE::StoreSolution(double t) {
+    int slot = _history_count % _history_size;
+    _history[slot]->Copy(_psi);
+    _history_t[slot] = t;
+    _history_count++;
+}
+
+// Replace _psi (the solution of the last step) with a better starting
+// point for the solve of U+ psi(t) = b.
+void CrankNicolsonTDSE::BuildInitialGuess(const Vector b, double t) {
+    int n = std::min(_history_count, _history_size);
+    if (n < 2)
+        return;
+
+    std::vector<complex> alpha(n, 0.);
+    if (_guess_type == Extrapolate) {
+        // Lagrange polynomial through the stored times, evaluated at t
+        for (int i = 0; i < n; i++) {
+            double w = 1.;
+            for (int j = 0; j < n; j++)
+                if (j != i)
+                    w *= (t - _history_t[j])/(_history_t[i] - _history_t[j]);
+            alpha[i] = w;
+        }
+    } else {
+        // min |b - U+ sum_i alpha_i psi_i|: QR of W = U+ Psi, alpha = R^-1 Q^H b.
+        // The solutions are nearly parallel, so dependent columns are dropped.
+        std::vector<complex> R(n*n, 0.), qb(n, 0.);
+        std::vector<int> used;
+        for (int i = 0; i < n; i++) {
+            Vector w = _history_work[i];
+            complex h;
+            _MathLib.Mult(_Up, _history[i], w);
+            _MathLib.Dot(w, w, h);
+            double norm0 = std::sqrt(h.real());
+            for (int j : used) {
+                _MathLib.Dot(w, _history_work[j], h);
+                _MathLib.AXPY(w, -h, _history_work[j]);
+                R[j + i*n] = h;
+            }
+            _MathLib.Dot(w, w, h);
+            double norm = std::sqrt(h.real());
+            if (norm <= 1.e-10*norm0)
+                continue;
+            w->Scale(1./norm);
+            R[i + i*n] = norm;
+            _MathLib.Dot(b, w, qb[i]);
+            used.push_back(i);
+        }
+        for (int k = used.size()-1; k >= 0; k--) {
+            int i = used[k];
+            complex sum = qb[i];
+            for (int l = k+1; l < used.size(); l++)
+                sum -= R[i + used[l]*n]*alpha[used[l]];
+            alpha[i] = sum/R[i + i*n];
+        }
+    }
+
+    _psi->Zero();
+    for (int i = 0; i < n; i++)
+        _MathLib.AXPY(_psi, alpha[i], _history[i]);
+}
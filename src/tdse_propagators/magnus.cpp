@@ -0,0 +1,190 @@
+#include "magnus.h"
+#include "utility/logger.h"
+#include "utility/profiler.h"
+#include "utility/memory_tracker.h"
+#include <cmath>
+
+using namespace std::complex_literals;
+
+MagnusTDSE::MagnusTDSE(MathLib& lib) : ArnoldiTDSE(lib), _method(Pade), _iterations(0), _pade_dt(0.) {
+}
+void MagnusTDSE::SetExponential(ExponentialMethod method) {
+    _method = method;
+}
+
+void MagnusTDSE::Initialize() {
+    ProfilerPush();
+
+    double memory = Resources().bytes/1024./1024./1024.;
+
+    LOG_INFO("Initialize TDSE");
+    LOG_INFO("Building Hamiltonian and overlap matrix...");
+    LOG_INFO("Estimated memory required: " + std::to_string(memory) + " GB.");
+    Log::flush();
+    BuildMatrices();
+
+    if (_method == Krylov)
+        BuildKrylov();
+    else
+        BuildPade();
+
+    Log::info("Magnus initialization complete.");
+    ProfilerPop();
+}
+
+TDSE::resources MagnusTDSE::Resources() const {
+    resources r = TDSE::Resources();
+    r.AddVectors(1, _dof);
+    if (_method == Krylov) {
+        r.AddVectors(_max_dim + 1, _dof);       // Krylov basis
+    } else {
+        r.AddMatrix(4.*(2*_order-1)*_dof);      // S +- kappa_j H0 of both factors
+        r.AddVectors(1, _dof);
+    }
+    return r;
+}
+
+void MagnusTDSE::BuildPade() {
+    MemoryOwner owner("propagator");
+    // R22(z) = (1 + z/2 + z^2/12)/(1 - z/2 + z^2/12) = prod_j (1 + z/a_j)/(1 - z/a_j), a_j = 3 +- i sqrt(3).
+    // With z = -i dt S^-1 H every factor is a solve with S + kappa_j H, kappa_j = i dt/a_j.
+    // The dt of each exponential is half the time step (the Magnus weights add up to 1/2).
+    Log::info("Building propagator matrices...");
+    bool direct = !(_pol[X] || _pol[Y]);            // z-polarization: U+ is block tridiagonal
+    std::vector<Matrix> terms;
+    for (int xn = X; xn <= Z; xn++)
+        if (_HI[xn])
+            terms.push_back(_HI[xn]);
+
+    _psi_temp = _MathLib.CreateVector(_dof);
+    for (int j = 0; j < 2; j++) {
+        _kappa[j] = 1.i*(0.5*_dt)/(3. + (j == 0 ? 1. : -1.)*1.i*std::sqrt(3.));
+
+        _U0p[j] = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+        _U0m[j] = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
+        _U0p[j]->Duplicate(_S);
+        _U0m[j]->Duplicate(_S);
+        _MathLib.AXPY(_U0p[j], _kappa[j], _H0);
+        _MathLib.AXPY(_U0m[j], -_kappa[j], _H0);
+
+        _Um[j] = _MathLib.CreateCompositeMatrix(_U0m[j], terms);
+        if (direct) {
+            _block_solver[j] = _MathLib.CreateBlockTridiagonalSolver(_U0p[j], terms, _N, _order-1);
+            if (!_block_solver[j]) {
+                LOG_WARN("The Pade factor is not block tridiagonal. Using GMRES.");
+                direct = false;
+            }
+        }
+        if (!direct) {
+            _Up[j] = _MathLib.CreateCompositeMatrix(_U0p[j], terms);
+            _solver[j] = _MathLib.CreateGMRESSolver();
+            _solver[j]->SetBlockDiagonalPC(_U0p[j], _N, _order-1);
+            _solver[j]->SetPreconditionerMatrix(_U0p[j]);
+        }
+    }
+    _pade_dt = _dt;
+}
+void MagnusTDSE::Reinitialize() {
+    if (_method == Pade && _dt != _pade_dt) {
+        LOG_INFO("Rebuilding the Pade factors for dt = " + std::to_string(_dt) + "...");
+        BuildPade();
+    }
+}
+
+void MagnusTDSE::Finish() {
+    if (_solver[0] && _steps > 0)
+        LOG_INFO("GMRES iterations: " + std::to_string(_iterations) + " total, "
+                + std::to_string(double(_iterations)/_steps) + " per step (4 solves).");
+
+    for (int j = 0; j < 2; j++) {
+        _U0p[j] = nullptr;
+        _U0m[j] = nullptr;
+        _Up[j] = nullptr;
+        _Um[j] = nullptr;
+        _solver[j] = nullptr;
+        _block_solver[j] = nullptr;
+    }
+    _psi_temp = nullptr;
+    ArnoldiTDSE::Finish();
+}
+
+bool MagnusTDSE::DoStep(int it, double t, double dt) {
+    if (!DoStepAt(t, dt)) {
+        LOG_CRITICAL("Magnus: exponential failed at iteration " + std::to_string(it));
+        return false;
+    }
+
+    if ((_checkpoints != 0) && (it % _checkpoints == 0)) {
+        if (_method == Krylov)
+            LOG_INFO("Krylov vectors per exponential: " + std::to_string(double(_dims)/_substeps));
+        else if (_solver[0])
+            LOG_INFO("GMRES iterations per step: " + std::to_string(double(_iterations)/_steps));
+    }
+    return true;
+}
+
+bool MagnusTDSE::DoStepAt(double t, double dt) {
+    const double c[2] = {0.5 - std::sqrt(3.)/6., 0.5 + std::sqrt(3.)/6.};       // Gauss-Legendre points
+    const double a[2] = {0.25 - std::sqrt(3.)/6., 0.25 + std::sqrt(3.)/6.};
+    Vec3 field[2] = {FieldAt(t + c[0]*dt), FieldAt(t + c[1]*dt)};
+
+    if (_method == Pade && std::abs(dt - _dt) > 1e-12*_dt) {
+        LOG_CRITICAL("Magnus: the Pade factors are built for the fixed time step.");
+        return false;
+    }
+
+    // the first exponential leans on H(t1), the second on H(t2)
+    for (int e = 0; e < 2; e++) {
+        double w1 = 2.*a[1-e], w2 = 2.*a[e];
+        Vec3 f = w1*field[0] + w2*field[1];
+        const double fn[DimIndex::NUM] = {f.x, f.y, f.z};
+
+        int k = 0;
+        for (int xn = X; xn <= Z; xn++)
+            if (_HI[xn])
+                _coeffs[k++] = -1.i*fn[xn];
+
+        if (_method == Krylov) {
+            if (!_coeffs.empty())
+                _MathLib.SetCompositeCoefficients(_H, _coeffs);
+            if (!ArnoldiTDSE::Exponential(0.5*dt))
+                return false;
+        } else {
+            if (!PadeExponential())
+                return false;
+        }
+    }
+    _steps++;
+    return true;
+}
+int MagnusTDSE::StepOrder() const {
+    return 4;
+}
+
+bool MagnusTDSE::PadeExponential() {
+    std::vector<complex> coeffs(_coeffs.size());
+
+    for (int j = 0; j < 2; j++) {
+        // (S + kappa_j H) psi' = (S - kappa_j H) psi
+        for (int k = 0; k < _coeffs.size(); k++)
+            coeffs[k] = -_kappa[j]*_coeffs[k];
+        if (!coeffs.empty())
+            _MathLib.SetCompositeCoefficients(_Um[j], coeffs);
+        _MathLib.Mult(_Um[j], _psi, _psi_temp);
+
+        for (auto& coeff : coeffs)
+            coeff = -coeff;
+        if (_block_solver[j]) {
+            _block_solver[j]->SetCoefficients(coeffs);
+            if (!_block_solver[j]->Solve(_psi_temp, _psi))
+                return false;
+        } else {
+            if (!coeffs.empty())
+                _MathLib.SetCompositeCoefficients(_Up[j], coeffs);
+            if (!_solver[j]->Solve(_Up[j], _psi_temp, _psi))
+                return false;
+            _iterations += _solver[j]->Iterations();
+        }
+    }
+    return true;
+}
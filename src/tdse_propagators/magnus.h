@@ -0,0 +1,43 @@
+#pragma once
+
+#include "tdse_propagators/arnoldi.h"
+#include <complex>
+
+// Fourth order commutator-free Magnus propagator (two exponentials):
+//   psi(t+dt) = exp(-i dt (a1 H(t1) + a2 H(t2))) exp(-i dt (a2 H(t1) + a1 H(t2))) psi(t)
+// with t1, t2 the Gauss-Legendre points of the step, a1,2 = 1/4 -+ sqrt(3)/6.
+// The field is evaluated from the pulses at t1 and t2. Each exponential is
+// applied with the Arnoldi exponential or with the (2,2) Pade approximant,
+// which factors into two Crank-Nicolson like solves with complex shifts.
+class MagnusTDSE : public ArnoldiTDSE {
+public:
+    enum ExponentialMethod {
+        Pade,                                   // two solves, any dt
+        Krylov                                  // Arnoldi, see ArnoldiTDSE
+    };
+private:
+    ExponentialMethod _method;
+    Matrix _U0p[2], _U0m[2];                    // S +- kappa_j H0 for the two Pade factors
+    Matrix _Up[2], _Um[2];                      // and with the interaction, applied as products
+    GMRESSolver _solver[2];
+    BlockTridiagonalSolver _block_solver[2];    // z-polarization only
+    Vector _psi_temp;
+    complex _kappa[2];
+    long _iterations;                           // total GMRES iterations
+    double _pade_dt;                            // the dt of the Pade factors
+
+    void BuildPade();                           // S +- kappa_j H0 and their solvers
+
+    bool PadeExponential();                     // _psi = R22(-i dt/2 S^-1 H) _psi, dt/2 is in kappa_j
+public:
+    MagnusTDSE(MathLib& lib);
+    void SetExponential(ExponentialMethod method);
+
+    void Initialize();
+    resources Resources() const;
+    void Reinitialize();
+    bool DoStep(int it, double t, double dt);
+    bool DoStepAt(double t, double dt);         // any dt with the Krylov exponential only
+    int StepOrder() const;
+    void Finish();
+};
@@ -1,26 +1,24 @@
 
-#include "tdse_propagators/cranknicolson.h"
+#include "tdse/tdse.h"
 #include "utility/index_manip.h"
 
-void CrankNicolsonTDSE::FillFieldFree(Matrix& H0) {
+void TDSE::FillFieldFree(Matrix& H0) {
     // int nl = _lmax + 2*_lmax*_mmax - _mmax*(_mmax+1); ?
 
     // TODO: decide on banded structure in non-central case
     // - for now assuming central
     Matrix temp = _MathLib.CreateMatrix(_dof, _dof, 2*_order-1);
-    std::vector<complex> kinBlockStore(_N*_N);
-    std::vector<complex> r2BlockStore(_N*_N);
 
     // Fill H0 with kinetic energy
     // derivative part is always the same (only depends on i,j)
-    for (int i = 0; i < _N; i++) {
-        for (int j = i; j < _N; j++) {
-            kinBlockStore[i + j*_N] = kinBlockStore[j + i*_N] = _basis.Integrate(i+1, j+1, 1,1) /2.;
-            r2BlockStore [i + j*_N] =  r2BlockStore[j + i*_N] = _basis.Integrate(i+1, j+1, [] (complex r) {
-                return 1./r/r;
-            });
-        }
-    }
+    auto radial = _basis.IntegrateOperators({
+        {nullptr, 1, 1},
+        Basis::BSpline::Power(-2)
+    });
+    std::vector<complex>& kinBlockStore = radial[0];
+    std::vector<complex>& r2BlockStore = radial[1];
+    for (auto& kin : kinBlockStore)
+        kin /= 2.;
     H0->FillBandedBlock(_order-1, _N, [=](int row, int col) {
         int i, j, l1, l2, m1, m2;
         ILMFrom(row, i, l1, m1, _N, _Ms, _mRows);
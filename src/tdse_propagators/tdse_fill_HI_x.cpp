@@ -1,23 +1,19 @@
 
-#include "tdse_propagators/cranknicolson.h"
+#include "tdse/tdse.h"
 #include "utility/index_manip.h"
 #include "utility/spherical_harmonics.h"
 #include "utility/logger.h"
 
-void CrankNicolsonTDSE::FillInteractionX(Matrix& HI) {
+void TDSE::FillInteractionX(Matrix& HI) {
     // if we made it here we assume there IS m->m+1 coupling
     // so a full -mmax to mmax matrix
-    std::vector<complex> ddr(_N*_N);
-    std::vector<complex> invR(_N*_N);
-    
-    for (int r = 0; r < _N; r++) {
-        for (int c = 0; c < _N; c++) {
-            ddr[r + c*_N] = _basis.Integrate(r+1, c+1, 0, 1);
-            invR[r + c*_N] = _basis.Integrate(r+1, c+1, [](complex x) {
-                return 1./x;
-            });
-        }
-	}
+    // <Bi|d/dr|Bj> and <Bi|1/r|Bj> in one pass
+    auto radial = _basis.IntegrateOperators({
+        {nullptr, 0, 1},
+        Basis::BSpline::Power(-1)
+    });
+    std::vector<complex>& ddr = radial[0];
+    std::vector<complex>& invR = radial[1];
 
     // for each m-block (block rows)
     for (int i = 0; i < _Ms.size(); i++) {              
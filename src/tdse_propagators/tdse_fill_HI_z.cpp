@@ -1,22 +1,17 @@
 
-#include "tdse_propagators/cranknicolson.h"
+#include "tdse/tdse.h"
 #include "utility/index_manip.h"
 #include "utility/logger.h"
 #include "math_libs/petsc/petsc_lib.h"
 
-void CrankNicolsonTDSE::FillInteractionZ(Matrix& HI) {
-    std::vector<complex> ddr(_N*_N);
-    std::vector<complex> invR(_N*_N);
-    
-    // cache some common matrix elements
-    for (int r = 0; r < _N; r++) {
-        for (int c = 0; c < _N; c++) {
-            ddr[r + c*_N] = _basis.Integrate(r+1, c+1, 0, 1);                   // <Bi|d/dr|Bj>
-            invR[r + c*_N] = _basis.Integrate(r+1, c+1, [](complex x) {         // <Bi|1/r|Bj>
-                return 1./x;
-            });
-        }
-	}
+void TDSE::FillInteractionZ(Matrix& HI) {
+    // <Bi|d/dr|Bj> and <Bi|1/r|Bj> in one pass
+    auto radial = _basis.IntegrateOperators({
+        {nullptr, 0, 1},
+        Basis::BSpline::Power(-1)
+    });
+    std::vector<complex>& ddr = radial[0];
+    std::vector<complex>& invR = radial[1];
 
     for (int i = 0; i < _Ms.size(); i++) {              
         int m1 = _Ms[i];
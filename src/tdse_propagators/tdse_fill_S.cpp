@@ -0,0 +1,16 @@
+
+#include "tdse/tdse.h"
+#include "utility/index_manip.h"
+
+
+
+void TDSE::FillOverlap(Matrix& S) {
+    std::vector<complex> overlapStore = _basis.IntegrateOperators({{nullptr, 0, 0}})[0];
+    S->FillBandedBlock(_order-1, _N, [=,&overlapStore](int row, int col) {
+        int i, j, l1, l2, m1, m2;
+        ILMFrom(row, i, l1, m1, _N, _Ms, _mRows);
+        ILMFrom(col, j, l2, m2, _N, _Ms, _mRows);
+
+        return overlapStore[i + j*_N];
+    });
+}